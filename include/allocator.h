@@ -10,6 +10,7 @@
 
 namespace st {
     typedef unsigned int index_t;
+    typedef int stride_t; // signed step between elements, may be negative or zero
     class Alloc {
     public:
         class trivial_delete_handler {
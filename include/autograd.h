@@ -0,0 +1,144 @@
+#ifndef TENSOR_AUTOGRAD_H
+#define TENSOR_AUTOGRAD_H
+
+// reverse-mode automatic differentiation. a Variable wraps a tensor value, and every
+// op on variables that require grad evaluates its result eagerly through the expression
+// templates and records a node with the backward function of the op. backward() walks
+// the recorded nodes from the output in reverse order and accumulates gradients into
+// the .grad of every leaf that requires grad.
+//
+// a backward function is one fused expression per input (e.g. g * cos(x) for sin), it
+// keeps only the tensors it reads, and drops them as soon as it has run unless the graph
+// is retained. gradients of broadcast operands are summed back to the operand's shape.
+//
+// values are shared with the tensors they were built from and saved for backward as
+// handles, so writing into a value between forward and backward changes the gradients.
+
+#include "tensor.h"
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace st {
+    class Variable;
+
+    namespace autograd {
+        struct Node;
+        struct VariableImpl;
+
+        // where the gradient of an input goes: the node that produced it, or the
+        // leaf itself. both are empty when the input doesn't require grad.
+        struct Edge {
+            std::shared_ptr<Node> fn;
+            std::shared_ptr<VariableImpl> leaf;
+            [[nodiscard]] bool needed() const { return fn || leaf; }
+        };
+
+        struct Node {
+            // gradient of the output in, one gradient per input out, left empty for inputs
+            // that aren't needed. reset once it has run, which frees what it captured.
+            using Backward = std::function<std::vector<std::optional<Tensor>>(const Tensor& grad, const Node& node)>;
+            std::vector<Edge> next;
+            Backward backward;
+            [[nodiscard]] bool needs(index_t input) const { return next[input].needed(); }
+        };
+
+        struct VariableImpl {
+            Tensor value;
+            bool requires_grad;
+            std::optional<Tensor> grad;
+            std::shared_ptr<Node> grad_fn; // null for a leaf
+        };
+
+        [[nodiscard]] bool grad_enabled();
+
+        // sums a gradient over the dims that were broadcast to reach its shape
+        [[nodiscard]] Tensor reduce_to(const Tensor& grad, const Shape& shape);
+    } // autograd
+
+    // ops inside its scope are not recorded, e.g. for parameter updates or inference
+    class NoGradGuard {
+    public:
+        NoGradGuard();
+        ~NoGradGuard();
+        NoGradGuard(const NoGradGuard&) = delete;
+        NoGradGuard& operator=(const NoGradGuard&) = delete;
+    private:
+        bool previous;
+    };
+
+    class Variable { // handle to a value and its place in the graph, cheap to copy
+    public:
+        explicit Variable(const Tensor& value, bool requires_grad = false);
+
+        [[nodiscard]] const Tensor& value() const { return impl->value; }
+        [[nodiscard]] Tensor& value() { return impl->value; }
+        [[nodiscard]] const Shape& size() const { return impl->value.size(); }
+        [[nodiscard]] index_t size(index_t idx) const { return impl->value.size(idx); }
+        [[nodiscard]] index_t n_dim() const { return impl->value.n_dim(); }
+        [[nodiscard]] bool requires_grad() const { return impl->requires_grad; }
+        [[nodiscard]] bool is_leaf() const { return !impl->grad_fn; }
+        [[nodiscard]] const std::shared_ptr<autograd::Node>& grad_fn() const { return impl->grad_fn; }
+        // only leaves that require grad accumulate one
+        [[nodiscard]] const std::optional<Tensor>& grad() const { return impl->grad; }
+        void zero_grad() { impl->grad.reset(); }
+        // a leaf with the same value that is cut off from the graph
+        [[nodiscard]] Variable detach() const { return Variable(impl->value); }
+
+        // the output must have a single element unless a gradient is given. the saved
+        // tensors of the graph are released on the way unless retain_graph is set.
+        void backward(bool retain_graph = false) const;
+        void backward(const Tensor& grad, bool retain_graph = false) const;
+
+        // views share the value of their input, their backward is the inverse view
+        [[nodiscard]] Variable transpose(index_t dim0, index_t dim1) const;
+        [[nodiscard]] Variable view(const Shape& shape) const;
+        [[nodiscard]] Variable unsqueeze(index_t dim) const;
+        [[nodiscard]] Variable squeeze(index_t dim) const;
+        [[nodiscard]] Variable slice(index_t start, index_t end, index_t dim) const;
+        [[nodiscard]] Variable select(index_t dim, index_t idx) const;
+        [[nodiscard]] Variable expand(const Shape& shape) const;
+        [[nodiscard]] Variable sum() const;
+        [[nodiscard]] Variable sum(int dim) const;
+
+        [[nodiscard]] const std::shared_ptr<autograd::VariableImpl>& ptr() const { return impl; }
+        // records value as the output of an op on inputs, unless none of them requires grad
+        static Variable record(Tensor value, const std::vector<const Variable*>& inputs,
+                               autograd::Node::Backward backward);
+    private:
+        std::shared_ptr<autograd::VariableImpl> impl;
+    };
+
+    [[nodiscard]] Variable operator+(const Variable& lhs, const Variable& rhs);
+    [[nodiscard]] Variable operator-(const Variable& lhs, const Variable& rhs);
+    [[nodiscard]] Variable operator*(const Variable& lhs, const Variable& rhs);
+    [[nodiscard]] Variable operator/(const Variable& lhs, const Variable& rhs);
+    [[nodiscard]] Variable operator+(const Variable& lhs, data_t rhs);
+    [[nodiscard]] Variable operator-(const Variable& lhs, data_t rhs);
+    [[nodiscard]] Variable operator*(const Variable& lhs, data_t rhs);
+    [[nodiscard]] Variable operator/(const Variable& lhs, data_t rhs);
+    [[nodiscard]] Variable operator+(data_t lhs, const Variable& rhs);
+    [[nodiscard]] Variable operator-(data_t lhs, const Variable& rhs);
+    [[nodiscard]] Variable operator*(data_t lhs, const Variable& rhs);
+    [[nodiscard]] Variable operator/(data_t lhs, const Variable& rhs);
+    [[nodiscard]] Variable operator-(const Variable& x);
+    [[nodiscard]] Variable sin(const Variable& x);
+    [[nodiscard]] Variable cos(const Variable& x);
+    [[nodiscard]] Variable tan(const Variable& x);
+    [[nodiscard]] Variable abs(const Variable& x);
+    [[nodiscard]] Variable relu(const Variable& x);
+    // both operands need at least 2 dims, leading dims broadcast like in matmul
+    [[nodiscard]] Variable matmul(const Variable& lhs, const Variable& rhs);
+
+    // activation checkpointing: fn runs without recording, so only its output is kept.
+    // backward runs fn again with recording on and backpropagates through that copy, so
+    // the activations inside fn only exist while its gradient is computed. fn must give
+    // the same result both times. variables fn reads other than inputs (e.g. parameters
+    // it closes over) get their gradients too, as long as some input requires grad.
+    using CheckpointFn = std::function<Variable(const std::vector<Variable>&)>;
+    [[nodiscard]] Variable checkpoint(const CheckpointFn& fn, const std::vector<Variable>& inputs);
+} // st
+
+#endif //TENSOR_AUTOGRAD_H
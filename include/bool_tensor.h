@@ -0,0 +1,97 @@
+#ifndef TENSOR_BOOL_TENSOR_H
+#define TENSOR_BOOL_TENSOR_H
+
+// tensor of 1-byte booleans, the compact result of comparisons and logical ops
+
+#include "shape.h"
+#include "storage.h"
+#include "allocator.h"
+#include "exception.h"
+#include "exp.h"
+
+#include <initializer_list>
+#include <vector>
+
+namespace st {
+    class BoolTensorImpl {
+    public:
+        // constructor
+        explicit BoolTensorImpl(const Shape& shape);
+        BoolTensorImpl(const BoolStorage& storage, const Shape& shape, const StrideArray& stride);
+        BoolTensorImpl(const BoolTensorImpl& other) = default;
+        BoolTensorImpl(BoolTensorImpl&& other) = default;
+        template<typename ImplType>
+        explicit BoolTensorImpl(const ImplType& src) : BoolTensorImpl(src.size()) {
+            std::vector<index_t> dim_cnt(n_dim(), 0);
+            for (index_t cnt = 0; cnt < d_size(); ++cnt) {
+                _storage[cnt] = src.eval(dim_cnt) != 0;
+                for (int i = n_dim()-1; i >= 0; --i) {
+                    if (dim_cnt[i]+1 < _shape[i]) {
+                        dim_cnt[i]++;
+                        break;
+                    }
+                    dim_cnt[i] = 0;
+                }
+            }
+        }
+
+        // inline function
+        [[nodiscard]] index_t n_dim() const { return _shape.n_dim(); }
+        [[nodiscard]] index_t d_size() const { return _shape.d_size(); }
+        [[nodiscard]] index_t size(index_t idx) const {
+            CHECK_IN_RANGE(idx, 0, n_dim(), "Index out of range (expected to be in range of [0, %d), but got %d)",
+                           n_dim(), idx);
+            return _shape[idx];
+        }
+        [[nodiscard]] const Shape& size() const { return _shape; }
+        [[nodiscard]] const StrideArray& stride() const { return _stride; }
+        [[nodiscard]] bool_t* data() const { return _storage.data(); }
+        [[nodiscard]] bool_t item(stride_t idx) const { return _storage[idx]; }
+        [[nodiscard]] bool_t& item(stride_t idx) { return _storage[idx]; }
+
+        // methods
+        bool_t& operator[](std::initializer_list<index_t> dims);
+        bool_t operator[](std::initializer_list<index_t> dims) const;
+        [[nodiscard]] data_t eval(IndexArray idx) const;
+        [[nodiscard]] index_t count() const;
+        [[nodiscard]] bool any() const { return count() > 0; }
+        [[nodiscard]] bool all() const { return count() == d_size(); }
+
+    protected:
+        BoolStorage _storage;
+        Shape _shape;
+        StrideArray _stride;
+    };
+
+    class BoolTensor : public Exp<BoolTensor> {
+    public:
+        explicit BoolTensor(const Shape& shape);
+        explicit BoolTensor(Alloc::NonTrivalUniquePtr<BoolTensorImpl>&& ptr);
+        BoolTensor(const BoolTensor& other) = default;
+        BoolTensor(BoolTensor&& other) = default;
+        BoolTensor& operator=(const BoolTensor& other) = default;
+        BoolTensor& operator=(BoolTensor&& other) = default;
+        template<typename ImplType>
+        BoolTensor(const Exp<ImplType>& src) :
+            BoolTensor(Alloc::unique_construct<BoolTensorImpl>(src.self().node())) {}
+
+        [[nodiscard]] index_t n_dim() const { return impl_ptr->n_dim(); }
+        [[nodiscard]] index_t d_size() const { return impl_ptr->d_size(); }
+        [[nodiscard]] index_t size(index_t idx) const { return impl_ptr->size(idx); }
+        [[nodiscard]] const Shape& size() const { return impl_ptr->size(); }
+        using Exp<BoolTensor>::eval;
+        [[nodiscard]] data_t eval(IndexArray idx) const { return impl_ptr->eval(std::move(idx)); }
+        [[nodiscard]] ImplRef<BoolTensorImpl> node() const& { return ImplRef<BoolTensorImpl>(*impl_ptr); }
+        [[nodiscard]] ImplHold<BoolTensorImpl> node() const&& { return ImplHold<BoolTensorImpl>(impl_ptr); }
+        [[nodiscard]] const std::shared_ptr<BoolTensorImpl>& ptr() const { return impl_ptr; }
+        bool_t& operator[](std::initializer_list<index_t> dims) { return impl_ptr->operator[](dims); }
+        bool_t operator[](std::initializer_list<index_t> dims) const { return impl_ptr->operator[](dims); }
+        [[nodiscard]] index_t count() const { return impl_ptr->count(); }
+        [[nodiscard]] bool any() const { return impl_ptr->any(); }
+        [[nodiscard]] bool all() const { return impl_ptr->all(); }
+    private:
+        std::shared_ptr<BoolTensorImpl> impl_ptr;
+    };
+} // st
+
+#endif //TENSOR_BOOL_TENSOR_H
@@ -54,11 +54,11 @@ namespace st {
     #define CHECK_EXP_BROADCAST(e1_, e2_) do { \
     auto& e1 = (e1_);                          \
     auto& e2 = (e2_);                          \
-    int i = e1->n_dim()-1;                   \
-    int j = e2->n_dim()-1;                   \
+    int i = e1.n_dim()-1;                   \
+    int j = e2.n_dim()-1;                   \
     for (; i >= 0 && j >= 0; --i, --j) {   \
-        CHECK_TRUE(e1->size(i) == e2->size(j) || e1->size(i) == 1 || e2->size(j) == 1, \
-            "Broadcast error with %d in tensor a but %d in tensor b.", e1->size(i), e2->size(j) \
+        CHECK_TRUE(e1.size(i) == e2.size(j) || e1.size(i) == 1 || e2.size(j) == 1, \
+            "Broadcast error with %d in tensor a but %d in tensor b.", e1.size(i), e2.size(j) \
         );                                     \
     }                                      \
     } while(0);
@@ -1,67 +1,188 @@
 #ifndef TENSOR_EXP_H
 #define TENSOR_EXP_H
 
+#include "shape.h"
 #include "storage.h"
 
+#include <memory>
+#include <type_traits>
+#include <utility>
+
 namespace st {
+    class Tensor;
+
+    // CRTP base of everything that can appear in an expression. Nodes hold
+    // their operands by value and tensors enter the tree as ImplRef handles,
+    // so building an expression never touches the heap. A handle to a named
+    // tensor does not own it, the expression must not outlive that tensor. A
+    // temporary tensor is kept alive by its handle, so `auto e = A.transpose(0, 1) + B;`
+    // stays valid after the full-expression ends.
     template<typename SubType>
     class Exp {
     public:
-        Exp(std::shared_ptr<SubType>&& ptr) : impl_ptr(std::move(ptr)) {}
         inline const SubType& self() const {
-            return *impl_ptr;
+            return *static_cast<const SubType*>(this);
+        }
+        // what a parent node stores for this operand, leaves override it with a handle
+        inline const SubType& node() const {
+            return self();
+        }
+        // materialise the expression into a new tensor, defined in tensor.h
+        [[nodiscard]] Tensor eval() const;
+    };
+
+    // the node type a parent keeps for an operand of type ExpType
+    template<typename ExpType>
+    using node_t = std::decay_t<decltype(std::declval<const ExpType&>().node())>;
+
+    template<typename T>
+    struct is_exp_base : std::false_type {};
+    template<typename T>
+    struct is_exp_base<Exp<T>> : std::true_type {};
+
+    // an expression type, or the Exp<> base generic code sees one through
+    template<typename T>
+    concept expression = is_exp_base<std::remove_cvref_t<T>>::value ||
+                         std::is_base_of_v<Exp<std::remove_cvref_t<T>>, std::remove_cvref_t<T>>;
+
+    // what a parent node stores for an operand passed as T&&, a temporary tensor gives an owning handle
+    template<expression T>
+    inline auto operand(T&& x) {
+        if constexpr (is_exp_base<std::remove_cvref_t<T>>::value)
+            return x.self().node();
+        else
+            return std::forward<T>(x).node();
+    }
+    template<typename T>
+    using operand_t = decltype(operand(std::declval<T>()));
+
+    template<typename ImplType>
+    class ImplRef { // non-owning leaf handle that reads straight from a tensor impl
+    public:
+        explicit ImplRef(const ImplType& impl) : impl_ptr(&impl) {}
+        [[nodiscard]] inline data_t eval(IndexArray idx) const {
+            return impl_ptr->eval(std::move(idx));
         }
-        inline const std::shared_ptr<SubType>& ptr() const {
-            return impl_ptr;
+        [[nodiscard]] const ImplType& get() const { return *impl_ptr; }
+        [[nodiscard]] const Shape& size() const { return impl_ptr->size(); }
+        [[nodiscard]] index_t size(index_t idx) const { return impl_ptr->size(idx); }
+        [[nodiscard]] index_t n_dim() const { return impl_ptr->n_dim(); }
+    private:
+        const ImplType* impl_ptr;
+    };
+
+    // leaf of a temporary tensor, keeps the impl alive for as long as the expression.
+    // kernels see it as the ImplRef it derives from.
+    template<typename ImplType>
+    class ImplHold : public ImplRef<ImplType> {
+    public:
+        explicit ImplHold(std::shared_ptr<const ImplType> impl) : ImplRef<ImplType>(*impl), owner(std::move(impl)) {}
+    private:
+        std::shared_ptr<const ImplType> owner;
+    };
+
+    class ScalarExp { // Scalar leaf, broadcasts against any shape as a single element
+    public:
+        explicit ScalarExp(data_t value) : value(value) {}
+        [[nodiscard]] inline data_t eval(const IndexArray&) const {
+            return value;
         }
-    protected:
-        std::shared_ptr<SubType> impl_ptr;
+        [[nodiscard]] data_t item() const { return value; }
+        [[nodiscard]] Shape size() const { return Shape({1}); }
+        [[nodiscard]] index_t size(index_t) const { return 1; }
+        [[nodiscard]] index_t n_dim() const { return 1; }
+    private:
+        data_t value;
     };
 
     template<typename Op, typename LhsType, typename RhsType>
-    class BinaryExp { // Binary Expression
+    class BinaryExp : public Exp<BinaryExp<Op, LhsType, RhsType>> { // Binary Expression
     public:
+        using Exp<BinaryExp>::eval;
         [[nodiscard]] inline data_t eval(IndexArray idx) const {
-            return Op::eval(idx, lhs_ptr, rhs_ptr);
+            return Op::eval(idx, lhs_, rhs_);
         }
-        BinaryExp(const std::shared_ptr<LhsType>& _lhs, const std::shared_ptr<RhsType> _rhs)
-            :lhs_ptr(_lhs), rhs_ptr(_rhs) {}
+        BinaryExp(const LhsType& _lhs, const RhsType& _rhs)
+            :lhs_(_lhs), rhs_(_rhs) {}
+        [[nodiscard]] const LhsType& lhs() const { return lhs_; }
+        [[nodiscard]] const RhsType& rhs() const { return rhs_; }
         [[nodiscard]] Shape size() const {
-            return Op::size(lhs_ptr, rhs_ptr);
+            return Op::size(lhs_, rhs_);
         }
         [[nodiscard]] index_t size(index_t idx) const {
-            if (idx >= lhs_ptr->n_dim()) return rhs_ptr->size(idx);
-            if (idx >= rhs_ptr->n_dim()) return lhs_ptr->size(idx);
-            return std::max(lhs_ptr->size(idx), rhs_ptr->size(idx));
+            if constexpr (requires { Op::size(idx, lhs_, rhs_); })
+                return Op::size(idx, lhs_, rhs_);
+            else
+                return size()[idx];
         }
         [[nodiscard]] index_t n_dim() const {
-            return std::max(lhs_ptr->n_dim(), rhs_ptr->n_dim());
+            return std::max(lhs_.n_dim(), rhs_.n_dim());
         }
-        ~BinaryExp() = default;
     private:
-        std::shared_ptr<LhsType> lhs_ptr;
-        std::shared_ptr<RhsType> rhs_ptr;
+        LhsType lhs_;
+        RhsType rhs_;
     };
 
     template<typename Op, typename LhsType>
-    class UnaryExp { // Unary Expression
+    class UnaryExp : public Exp<UnaryExp<Op, LhsType>> { // Unary Expression
+    public:
+        using Exp<UnaryExp>::eval;
+        [[nodiscard]] inline data_t eval(IndexArray idx) const {
+            return Op::eval(idx, lhs_);
+        }
+        explicit UnaryExp(const LhsType& _lhs): lhs_(_lhs) {}
+        [[nodiscard]] const LhsType& lhs() const { return lhs_; }
+        [[nodiscard]] Shape size() const {
+            return lhs_.size();
+        }
+        [[nodiscard]] index_t size(index_t idx) const {
+            return lhs_.size(idx);
+        }
+        [[nodiscard]] index_t n_dim() const {
+            return lhs_.n_dim();
+        }
+    private:
+        LhsType lhs_;
+    };
+
+    template<typename Op, typename CondType, typename LhsType, typename RhsType>
+    class TernaryExp : public Exp<TernaryExp<Op, CondType, LhsType, RhsType>> { // Ternary Expression
     public:
+        using Exp<TernaryExp>::eval;
         [[nodiscard]] inline data_t eval(IndexArray idx) const {
-            return Op::eval(idx, lhs_ptr);
+            return Op::eval(idx, cond_, lhs_, rhs_);
         }
-        UnaryExp(const std::shared_ptr<LhsType>&& ptr): lhs_ptr(ptr) {}
-        [[nodiscard]] Shape& size() const {
-            return lhs_ptr->size();
+        TernaryExp(const CondType& _cond, const LhsType& _lhs, const RhsType& _rhs)
+            :cond_(_cond), lhs_(_lhs), rhs_(_rhs) {}
+        [[nodiscard]] const CondType& cond() const { return cond_; }
+        [[nodiscard]] const LhsType& lhs() const { return lhs_; }
+        [[nodiscard]] const RhsType& rhs() const { return rhs_; }
+        [[nodiscard]] Shape size() const {
+            return Op::size(cond_, lhs_, rhs_);
         }
         [[nodiscard]] index_t size(index_t idx) const {
-            return lhs_ptr->size(idx);
+            return size()[idx];
         }
         [[nodiscard]] index_t n_dim() const {
-            return lhs_ptr->n_dim();
+            return std::max(cond_.n_dim(), std::max(lhs_.n_dim(), rhs_.n_dim()));
         }
     private:
-        std::shared_ptr<LhsType> lhs_ptr;
+        CondType cond_;
+        LhsType lhs_;
+        RhsType rhs_;
     };
+
+    // right-aligned broadcast of two shapes, size-1 dims stretch to the other side
+    inline Shape broadcast_shape(const Shape& lhs, const Shape& rhs) {
+        index_t n = std::max(lhs.n_dim(), rhs.n_dim());
+        IndexArray dim(n);
+        for (index_t i = 0; i < n; ++i) {
+            index_t l = i + lhs.n_dim() >= n ? lhs[i + lhs.n_dim() - n] : 1;
+            index_t r = i + rhs.n_dim() >= n ? rhs[i + rhs.n_dim() - n] : 1;
+            dim[i] = l == 1 ? r : l;
+        }
+        return Shape(std::move(dim));
+    }
 }// st
 
-#endif //TENSOR_EXP_H
\ No newline at end of file
+#endif //TENSOR_EXP_H
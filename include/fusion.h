@@ -0,0 +1,347 @@
+#ifndef TENSOR_FUSION_H
+#define TENSOR_FUSION_H
+
+// lowers an Exp tree into a single loop over the output. each tensor leaf
+// becomes a strided pointer and each elementwise node calls its op's scalar
+// apply(), so the whole expression is one pass over memory. nodes whose op has
+// no apply() (matmul) are evaluated into a temporary first and read as a leaf.
+
+#include "exp.h"
+#include "oper.h"
+#include "shape.h"
+#include "parallel.h"
+#include "gemm.h"
+
+#include <array>
+#include <cstdlib>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace st {
+    namespace fusion {
+        constexpr index_t max_dim = 8;      // deeper outputs fall back to element-wise eval()
+        constexpr index_t tile = 64;        // edge of the square tiles used for strided inner reads
+        constexpr index_t grain = 1 << 14;  // elements per parallel chunk
+
+        using StrideSet = std::array<stride_t, max_dim>;
+
+        template<typename Op>
+        concept unary_apply = requires(data_t a) { Op::apply(a); };
+        template<typename Op>
+        concept binary_apply = requires(data_t a) { Op::apply(a, a); };
+        template<typename Op>
+        concept ternary_apply = requires(data_t a) { Op::apply(a, a, a); };
+
+        // kernels are trivially copyable, every parallel chunk works on its own copy
+        template<typename T>
+        struct LeafKernel {
+            const T* base;
+            StrideSet stride;
+            const T* cur;
+            stride_t inner;
+
+            void seek(const index_t* idx, index_t n_outer, index_t col) {
+                stride_t offset = (stride_t)col * stride[n_outer];
+                for (index_t i = 0; i < n_outer; ++i)
+                    offset += (stride_t)idx[i] * stride[i];
+                cur = base + offset;
+                inner = stride[n_outer];
+            }
+            template<bool Unit>
+            [[nodiscard]] data_t at(index_t j) const {
+                if constexpr (Unit) return cur[j];
+                else return cur[(stride_t)j * inner];
+            }
+            template<typename Fn>
+            void strides(Fn&& fn) { fn(stride); }
+        };
+
+        struct ScalarKernel {
+            data_t value;
+
+            void seek(const index_t*, index_t, index_t) {}
+            template<bool Unit>
+            [[nodiscard]] data_t at(index_t) const { return value; }
+            template<typename Fn>
+            void strides(Fn&&) {}
+        };
+
+        template<typename Op, typename LhsKernel>
+        struct UnaryKernel {
+            LhsKernel lhs;
+
+            void seek(const index_t* idx, index_t n_outer, index_t col) {
+                lhs.seek(idx, n_outer, col);
+            }
+            template<bool Unit>
+            [[nodiscard]] data_t at(index_t j) const {
+                return Op::apply(lhs.template at<Unit>(j));
+            }
+            template<typename Fn>
+            void strides(Fn&& fn) { lhs.strides(fn); }
+        };
+
+        template<typename Op, typename LhsKernel, typename RhsKernel>
+        struct BinaryKernel {
+            LhsKernel lhs;
+            RhsKernel rhs;
+
+            void seek(const index_t* idx, index_t n_outer, index_t col) {
+                lhs.seek(idx, n_outer, col);
+                rhs.seek(idx, n_outer, col);
+            }
+            template<bool Unit>
+            [[nodiscard]] data_t at(index_t j) const {
+                return Op::apply(lhs.template at<Unit>(j), rhs.template at<Unit>(j));
+            }
+            template<typename Fn>
+            void strides(Fn&& fn) { lhs.strides(fn); rhs.strides(fn); }
+        };
+
+        template<typename Op, typename CondKernel, typename LhsKernel, typename RhsKernel>
+        struct TernaryKernel {
+            CondKernel cond;
+            LhsKernel lhs;
+            RhsKernel rhs;
+
+            void seek(const index_t* idx, index_t n_outer, index_t col) {
+                cond.seek(idx, n_outer, col);
+                lhs.seek(idx, n_outer, col);
+                rhs.seek(idx, n_outer, col);
+            }
+            template<bool Unit>
+            [[nodiscard]] data_t at(index_t j) const {
+                return Op::apply(cond.template at<Unit>(j), lhs.template at<Unit>(j), rhs.template at<Unit>(j));
+            }
+            template<typename Fn>
+            void strides(Fn&& fn) { cond.strides(fn); lhs.strides(fn); rhs.strides(fn); }
+        };
+
+        template<typename DstImpl>
+        struct Context {
+            const Shape& shape;                          // output shape every leaf is broadcast to
+            std::vector<std::shared_ptr<DstImpl>> temps; // materialised non-elementwise subtrees
+        };
+
+        // maps a node type to its kernel at compile time, unknown nodes are materialised
+        template<typename NodeType>
+        struct Lower {
+            template<typename DstImpl>
+            static auto make(const NodeType& node, Context<DstImpl>& ctx) {
+                ctx.temps.push_back(std::make_shared<DstImpl>(node));
+                return Lower<ImplRef<DstImpl>>::make(ImplRef<DstImpl>(*ctx.temps.back()), ctx);
+            }
+        };
+
+        template<typename ImplType>
+        struct Lower<ImplRef<ImplType>> {
+            template<typename DstImpl>
+            static auto make(const ImplRef<ImplType>& ref, Context<DstImpl>& ctx) {
+                using T = std::remove_pointer_t<decltype(ref.get().data())>;
+                StrideArray expanded = expand_stride(ref.size(), ref.get().stride(), ctx.shape);
+                LeafKernel<std::remove_const_t<T>> kernel{ref.get().data(), {}, nullptr, 0};
+                for (index_t i = 0; i < ctx.shape.n_dim(); ++i)
+                    kernel.stride[i] = expanded[i];
+                return kernel;
+            }
+        };
+
+        template<typename ImplType>
+        struct Lower<ImplHold<ImplType>> : Lower<ImplRef<ImplType>> {};
+
+        template<>
+        struct Lower<ScalarExp> {
+            template<typename DstImpl>
+            static ScalarKernel make(const ScalarExp& node, Context<DstImpl>&) {
+                return ScalarKernel{node.item()};
+            }
+        };
+
+        template<typename Op, typename LhsType>
+        struct Lower<UnaryExp<Op, LhsType>> {
+            template<typename DstImpl>
+            static auto make(const UnaryExp<Op, LhsType>& node, Context<DstImpl>& ctx) {
+                if constexpr (unary_apply<Op>) {
+                    auto lhs = Lower<LhsType>::make(node.lhs(), ctx);
+                    return UnaryKernel<Op, decltype(lhs)>{lhs};
+                } else {
+                    ctx.temps.push_back(std::make_shared<DstImpl>(node));
+                    return Lower<ImplRef<DstImpl>>::make(ImplRef<DstImpl>(*ctx.temps.back()), ctx);
+                }
+            }
+        };
+
+        template<typename Op, typename LhsType, typename RhsType>
+        struct Lower<BinaryExp<Op, LhsType, RhsType>> {
+            template<typename DstImpl>
+            static auto make(const BinaryExp<Op, LhsType, RhsType>& node, Context<DstImpl>& ctx) {
+                if constexpr (binary_apply<Op>) {
+                    auto lhs = Lower<LhsType>::make(node.lhs(), ctx);
+                    auto rhs = Lower<RhsType>::make(node.rhs(), ctx);
+                    return BinaryKernel<Op, decltype(lhs), decltype(rhs)>{lhs, rhs};
+                } else {
+                    ctx.temps.push_back(std::make_shared<DstImpl>(node));
+                    return Lower<ImplRef<DstImpl>>::make(ImplRef<DstImpl>(*ctx.temps.back()), ctx);
+                }
+            }
+        };
+
+        template<typename Op, typename CondType, typename LhsType, typename RhsType>
+        struct Lower<TernaryExp<Op, CondType, LhsType, RhsType>> {
+            template<typename DstImpl>
+            static auto make(const TernaryExp<Op, CondType, LhsType, RhsType>& node, Context<DstImpl>& ctx) {
+                auto cond = Lower<CondType>::make(node.cond(), ctx);
+                auto lhs = Lower<LhsType>::make(node.lhs(), ctx);
+                auto rhs = Lower<RhsType>::make(node.rhs(), ctx);
+                return TernaryKernel<Op, decltype(cond), decltype(lhs), decltype(rhs)>{cond, lhs, rhs};
+            }
+        };
+
+        // whether the root of the tree lowers to a loop, a matmul root keeps its own eval()
+        template<typename NodeType>
+        constexpr bool fusable = true;
+        template<typename Op, typename LhsType, typename RhsType>
+        constexpr bool fusable<BinaryExp<Op, LhsType, RhsType>> = binary_apply<Op>;
+        template<typename Op, typename LhsType>
+        constexpr bool fusable<UnaryExp<Op, LhsType>> = unary_apply<Op>;
+
+        // a matmul root goes straight to the strided, batched GEMM
+        template<typename NodeType>
+        constexpr bool gemm_root = false;
+        template<typename LhsType, typename RhsType>
+        constexpr bool gemm_root<BinaryExp<op::MatrixMul_2dim, LhsType, RhsType>> = true;
+        template<typename LhsType, typename RhsType>
+        constexpr bool gemm_root<BinaryExp<op::MatrixMul_3dim, LhsType, RhsType>> = true;
+        template<typename LhsType, typename RhsType>
+        constexpr bool gemm_root<BinaryExp<op::MatrixMul, LhsType, RhsType>> = true;
+
+        // a tensor leaf is handed to the GEMM with its own strides, so a transposed view
+        // folds into the kernel's addressing. any other operand is evaluated first.
+        template<typename DstImpl, typename NodeType>
+        const DstImpl& gemm_operand(const NodeType& node, Context<DstImpl>& ctx) {
+            if constexpr (std::is_base_of_v<ImplRef<DstImpl>, NodeType>) {
+                return node.get();
+            } else {
+                ctx.temps.push_back(std::make_shared<DstImpl>(node));
+                return *ctx.temps.back();
+            }
+        }
+
+        // batch dims missing from an operand or of size 1 in it get stride 0, so one
+        // matrix is reused across the whole batch without being copied
+        template<typename DstImpl, typename Op, typename LhsType, typename RhsType>
+        void assign_matmul(DstImpl& dst, const BinaryExp<Op, LhsType, RhsType>& src) {
+            index_t la = src.lhs().n_dim(), lb = src.rhs().n_dim();
+            if constexpr (std::is_same_v<Op, op::MatrixMul_2dim>) {
+                CHECK_TRUE(la == 2 && lb == 2, "mm() expects 2D tensors, but got %dD and %dD", la, lb);
+            } else if constexpr (std::is_same_v<Op, op::MatrixMul_3dim>) {
+                CHECK_TRUE(la == 3 && lb == 3, "bmm() expects 3D tensors, but got %dD and %dD", la, lb);
+            } else {
+                CHECK_TRUE(la >= 2 && lb >= 2, "matmul() expects tensors with at least 2 dims, but got %dD and %dD", la, lb);
+            }
+            Context<DstImpl> ctx{dst.size(), {}};
+            const DstImpl& a = gemm_operand(src.lhs(), ctx);
+            const DstImpl& b = gemm_operand(src.rhs(), ctx);
+            index_t m = a.size(la-2), k = a.size(la-1), n = b.size(lb-1);
+            CHECK_EQUAL(k, b.size(lb-2),
+                        "mat1 and mat2 shapes cannot be multiplied (%dx%d and %dx%d)", m, k, b.size(lb-2), n);
+
+            index_t nd = dst.n_dim();
+            BatchLayout batch;
+            for (index_t i = 0; i + 2 < nd; ++i) {
+                index_t size = dst.size(i);
+                auto operand_stride = [&](const DstImpl& x, index_t nx) -> stride_t {
+                    if (i + nx < nd) return 0;
+                    index_t d = i + nx - nd;
+                    CHECK_TRUE(x.size(d) == size || x.size(d) == 1,
+                               "Broadcast error with %d in tensor a but %d in tensor b.", x.size(d), size);
+                    return x.size(d) == 1 ? 0 : x.stride()[d];
+                };
+                batch.size.push_back(size);
+                batch.a.push_back(operand_stride(a, la));
+                batch.b.push_back(operand_stride(b, lb));
+                batch.c.push_back(dst.stride()[i]);
+            }
+            if constexpr (std::is_same_v<Op, op::MatrixMul_3dim>)
+                CHECK_EQUAL(a.size(0), b.size(0), "bmm() expects equal batch sizes, but got %d and %d",
+                            a.size(0), b.size(0));
+            gemm_batched(batch, m, n, k, 1, a.data(), a.stride()[la-2], a.stride()[la-1],
+                         b.data(), b.stride()[lb-2], b.stride()[lb-1],
+                         0, dst.data(), dst.stride()[nd-2], dst.stride()[nd-1]);
+        }
+
+        // merges adjacent dims that every operand walks contiguously and drops size-1 dims,
+        // returns the number of dims left. sizes and strides are rewritten in place.
+        index_t coalesce(index_t* size, index_t n_dim, const std::vector<stride_t*>& strides);
+
+        // writes src into dst in one fused pass. returns false if dst has too many dims,
+        // the caller then evaluates element by element.
+        template<typename DstImpl, typename NodeType>
+        bool assign(DstImpl& dst, const NodeType& src) {
+            index_t n_dim = dst.n_dim();
+            if (n_dim > max_dim || n_dim == 0) return false;
+            if (dst.d_size() == 0) return true;
+
+            Context<DstImpl> ctx{dst.size(), {}};
+            auto kernel = Lower<NodeType>::make(src, ctx);
+
+            std::array<index_t, max_dim> size{};
+            StrideSet out_stride{};
+            for (index_t i = 0; i < n_dim; ++i) {
+                size[i] = dst.size(i);
+                out_stride[i] = dst.stride()[i];
+            }
+            std::vector<stride_t*> strides{out_stride.data()};
+            kernel.strides([&](StrideSet& s) { strides.push_back(s.data()); });
+            n_dim = coalesce(size.data(), n_dim, strides);
+
+            index_t n_outer = n_dim - 1;
+            index_t inner = size[n_outer];
+            index_t rows = dst.d_size() / inner;
+            // unit: every leaf and the output step by one element in the inner loop
+            bool unit = true, strided = false;
+            for (auto s : strides) {
+                unit = unit && s[n_outer] == 1;
+                strided = strided || std::abs(s[n_outer]) > 1;
+            }
+            // strided inner reads are walked in square tiles so each cache line is reused
+            index_t row_step = strided && n_outer > 0 ? tile : rows;
+            index_t col_step = strided && n_outer > 0 ? tile : inner;
+            data_t* out = dst.data();
+
+            parallel_for(0, rows, std::max<index_t>(1, grain / inner), [&](index_t begin, index_t end) {
+                auto k = kernel;
+                std::array<index_t, max_dim> idx{};
+                for (index_t r0 = begin; r0 < end; r0 += row_step) {
+                    index_t r1 = std::min(end, r0 + row_step);
+                    for (index_t c0 = 0; c0 < inner; c0 += col_step) {
+                        index_t len = std::min(inner, c0 + col_step) - c0;
+                        for (index_t r = r0; r < r1; ++r) {
+                            index_t rest = r;
+                            stride_t offset = (stride_t)c0 * out_stride[n_outer];
+                            for (int i = (int)n_outer - 1; i >= 0; --i) {
+                                idx[i] = rest % size[i];
+                                rest /= size[i];
+                                offset += (stride_t)idx[i] * out_stride[i];
+                            }
+                            k.seek(idx.data(), n_outer, c0);
+                            data_t* o = out + offset;
+                            if (unit) {
+                                for (index_t j = 0; j < len; ++j)
+                                    o[j] = k.template at<true>(j);
+                            } else {
+                                stride_t os = out_stride[n_outer];
+                                for (index_t j = 0; j < len; ++j)
+                                    o[(stride_t)j * os] = k.template at<false>(j);
+                            }
+                        }
+                    }
+                }
+            });
+            return true;
+        }
+    } // fusion
+} // st
+
+#endif //TENSOR_FUSION_H
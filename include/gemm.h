@@ -0,0 +1,45 @@
+#ifndef TENSOR_GEMM_H
+#define TENSOR_GEMM_H
+
+// general matrix multiply on strided operands. every matrix is addressed as
+// ptr[i * row_stride + j * col_stride], so a transposed view is a swap of its
+// strides and never needs a copy.
+
+#include "allocator.h"
+#include "storage.h"
+
+#include <vector>
+
+namespace st {
+    // C = alpha * A * B + beta * C, A is m x k, B is k x n and C is m x n.
+    // when beta is 0, C is overwritten without being read. square products of
+    // size 2, 3, 4, 8 and 16 run on fully unrolled kernels.
+    void gemm(index_t m, index_t n, index_t k, data_t alpha,
+              const data_t* a, stride_t a_rs, stride_t a_cs,
+              const data_t* b, stride_t b_rs, stride_t b_cs,
+              data_t beta, data_t* c, stride_t c_rs, stride_t c_cs);
+
+    // y = alpha * A * x + beta * y, A is m x n. rows are split across threads and each
+    // thread walks A in whichever direction is contiguous, so a transposed A costs the same.
+    void gemv(index_t m, index_t n, data_t alpha, const data_t* a, stride_t a_rs, stride_t a_cs,
+              const data_t* x, stride_t x_s, data_t beta, data_t* y, stride_t y_s);
+    [[nodiscard]] data_t dot(index_t n, const data_t* x, stride_t x_s, const data_t* y, stride_t y_s);
+    // y += alpha * x
+    void axpy(index_t n, data_t alpha, const data_t* x, stride_t x_s, data_t* y, stride_t y_s);
+
+    // leading dims of a batched product. every operand has its own stride per dim,
+    // a stride of 0 broadcasts that operand along the dim.
+    struct BatchLayout {
+        std::vector<index_t> size;
+        std::vector<stride_t> a, b, c;
+    };
+
+    // one gemm per batch index. small problems are grouped so each task gets enough
+    // work, a few large ones run one after another and split their own tiles instead.
+    void gemm_batched(const BatchLayout& batch, index_t m, index_t n, index_t k, data_t alpha,
+                      const data_t* a, stride_t a_rs, stride_t a_cs,
+                      const data_t* b, stride_t b_rs, stride_t b_cs,
+                      data_t beta, data_t* c, stride_t c_rs, stride_t c_cs);
+} // st
+
+#endif //TENSOR_GEMM_H
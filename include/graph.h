@@ -0,0 +1,135 @@
+#ifndef TENSOR_GRAPH_H
+#define TENSOR_GRAPH_H
+
+// lazy-graph mode: ops on LazyTensor handles are recorded into a DAG instead
+// of being evaluated. identical sub-expressions are merged as they are recorded,
+// and eval() picks which nodes to write to memory from their reuse count and
+// cost. everything else is fused into the kernel of the node that reads it, and
+// independent kernels run side by side on the thread pool.
+//
+// recording also rewrites: constants fold, x*1, x+0, x-0 and x/1 drop out when
+// they don't broadcast, -(-x) and double transposes cancel, and matmul chains
+// are re-associated when the other order needs fewer multiply-adds. transposes
+// are views, so a transposed matmul operand is read through its strides by the GEMM.
+// an output that rewrites down to an input is copied, results never alias inputs.
+//
+// intermediates that are written out share one arena, laid out by plan_memory() from
+// the levels each of them is alive for, so ones that never coexist reuse the same memory.
+
+#include "tensor.h"
+#include "memory_plan.h"
+
+#include <climits>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace st {
+    class Graph;
+
+    class LazyTensor { // handle to one node of a Graph, cheap to copy
+    public:
+        LazyTensor(Graph* graph, index_t id) : graph(graph), id(id) {}
+        [[nodiscard]] index_t node() const { return id; }
+        [[nodiscard]] Graph& owner() const { return *graph; }
+        [[nodiscard]] const Shape& size() const;
+        [[nodiscard]] Tensor eval() const;
+    private:
+        Graph* graph;
+        index_t id;
+    };
+
+    class Graph {
+    public:
+        enum class OpKind : uint8_t {
+            Input, Scalar,
+            Neg, Sin, Cos, Tan, Abs, Relu,
+            Add, Sub, Mul, Div, Maximum, Minimum,
+            MatMul,
+            Transpose
+        };
+        static constexpr index_t none = UINT_MAX;
+        // a node is materialised when (uses - 1) * cost reaches this, i.e. when recomputing
+        // it in every consumer costs more than writing it out once and reading it back
+        static constexpr index_t materialise_cost = 2;
+
+        struct Node {
+            OpKind kind;
+            index_t lhs;
+            index_t rhs;
+            data_t value;                 // Scalar only
+            Shape shape;
+            std::optional<Tensor> tensor; // Input only
+            index_t dim0 = 0, dim1 = 0;   // Transpose only, dim0 < dim1
+        };
+
+        Graph() = default;
+        Graph(const Graph& other) = delete; // handles point back at the graph
+        Graph& operator=(const Graph& other) = delete;
+
+        LazyTensor input(const Tensor& tensor);
+        LazyTensor scalar(data_t value);
+        LazyTensor unary(OpKind kind, const LazyTensor& x);
+        LazyTensor binary(OpKind kind, const LazyTensor& lhs, const LazyTensor& rhs);
+        LazyTensor transpose(const LazyTensor& x, index_t dim0, index_t dim1);
+
+        [[nodiscard]] Tensor eval(const LazyTensor& output);
+        [[nodiscard]] std::vector<Tensor> eval(const std::vector<LazyTensor>& outputs);
+
+        [[nodiscard]] index_t n_nodes() const { return nodes.size(); }
+        [[nodiscard]] const Node& node(index_t id) const { return nodes[id]; }
+        // number of kernels the last eval() ran, outputs included
+        [[nodiscard]] index_t n_materialised() const { return last_materialised; }
+        // elements of the arena the last eval() used, and what its intermediates add up to
+        [[nodiscard]] size_t arena_size() const { return last_arena; }
+        [[nodiscard]] size_t intermediate_size() const { return last_intermediates; }
+
+    private:
+        struct Key {
+            OpKind kind;
+            index_t lhs;
+            index_t rhs;
+            uint64_t bits; // scalar value or input impl address
+            bool operator==(const Key& other) const = default;
+        };
+        struct KeyHash {
+            size_t operator()(const Key& key) const;
+        };
+
+        index_t record(const Key& key, Node&& node);
+        [[nodiscard]] bool is_scalar(index_t id, data_t value) const;
+        [[nodiscard]] std::optional<LazyTensor> rewrite(OpKind kind, index_t l, index_t r, const Shape& shape);
+
+        std::vector<Node> nodes;
+        std::unordered_map<Key, index_t, KeyHash> cache;
+        index_t last_materialised = 0;
+        size_t last_arena = 0;
+        size_t last_intermediates = 0;
+    };
+
+    [[nodiscard]] LazyTensor operator+(const LazyTensor& lhs, const LazyTensor& rhs);
+    [[nodiscard]] LazyTensor operator-(const LazyTensor& lhs, const LazyTensor& rhs);
+    [[nodiscard]] LazyTensor operator*(const LazyTensor& lhs, const LazyTensor& rhs);
+    [[nodiscard]] LazyTensor operator/(const LazyTensor& lhs, const LazyTensor& rhs);
+    [[nodiscard]] LazyTensor operator+(const LazyTensor& lhs, data_t rhs);
+    [[nodiscard]] LazyTensor operator-(const LazyTensor& lhs, data_t rhs);
+    [[nodiscard]] LazyTensor operator*(const LazyTensor& lhs, data_t rhs);
+    [[nodiscard]] LazyTensor operator/(const LazyTensor& lhs, data_t rhs);
+    [[nodiscard]] LazyTensor operator+(data_t lhs, const LazyTensor& rhs);
+    [[nodiscard]] LazyTensor operator-(data_t lhs, const LazyTensor& rhs);
+    [[nodiscard]] LazyTensor operator*(data_t lhs, const LazyTensor& rhs);
+    [[nodiscard]] LazyTensor operator/(data_t lhs, const LazyTensor& rhs);
+    [[nodiscard]] LazyTensor operator-(const LazyTensor& x);
+    [[nodiscard]] LazyTensor sin(const LazyTensor& x);
+    [[nodiscard]] LazyTensor cos(const LazyTensor& x);
+    [[nodiscard]] LazyTensor tan(const LazyTensor& x);
+    [[nodiscard]] LazyTensor abs(const LazyTensor& x);
+    [[nodiscard]] LazyTensor relu(const LazyTensor& x);
+    [[nodiscard]] LazyTensor maximum(const LazyTensor& lhs, const LazyTensor& rhs);
+    [[nodiscard]] LazyTensor minimum(const LazyTensor& lhs, const LazyTensor& rhs);
+    [[nodiscard]] LazyTensor matmul(const LazyTensor& lhs, const LazyTensor& rhs);
+    [[nodiscard]] LazyTensor transpose(const LazyTensor& x, index_t dim0, index_t dim1);
+} // st
+
+#endif //TENSOR_GRAPH_H
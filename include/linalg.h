@@ -0,0 +1,86 @@
+#ifndef TENSOR_LINALG_H
+#define TENSOR_LINALG_H
+
+// linear algebra routines that work on whole matrices rather than through
+// expression templates. products are computed by the strided GEMM in gemm.h.
+
+#include "tensor.h"
+
+#include <string>
+#include <vector>
+
+namespace st {
+    // product of a chain of matrices, multiplied in the order that needs the fewest
+    // multiply-adds. the first tensor may be 1-d (a row vector) and the last one may
+    // be 1-d (a column vector), their dim is dropped from the result like in matmul.
+    [[nodiscard]] Tensor multi_dot(const std::vector<Tensor>& tensors);
+
+    // matrix-vector and vector-vector products, on the gemv/dot/axpy kernels of gemm.h.
+    // strided and transposed operands are read in place.
+    [[nodiscard]] Tensor mv(const Tensor& mat, const Tensor& vec);
+    [[nodiscard]] data_t dot(const Tensor& x, const Tensor& y);
+    [[nodiscard]] Tensor outer(const Tensor& x, const Tensor& y);
+    // y += alpha * x, in place
+    Tensor& axpy(data_t alpha, const Tensor& x, Tensor& y);
+
+    // dense factorisations and solvers. every function takes a batch of matrices in the
+    // leading dims, batch dims of the operands must match. a right-hand side with one dim
+    // less than the matrix is a (batch of) vector(s). they work on a row-major copy of the
+    // input and do their bulk updates in blocks through the GEMM.
+    struct LUFactor {
+        Tensor lu;                   // unit lower L below the diagonal, U on and above it
+        std::vector<index_t> pivots; // n per matrix, row i was swapped with row pivots[i] at step i
+    };
+    struct QRFactor {
+        Tensor q; // m x k with orthonormal columns, k = min(m, n)
+        Tensor r; // k x n upper triangular
+    };
+
+    // LU with partial pivoting, square matrices only. a singular matrix still factors,
+    // with a zero on the diagonal of U
+    [[nodiscard]] LUFactor lu_factor(const Tensor& a);
+    [[nodiscard]] Tensor lu_solve(const LUFactor& factor, const Tensor& b);
+    // lower L with L * L^T = a, throws if a is not positive-definite
+    [[nodiscard]] Tensor cholesky(const Tensor& a);
+    // reduced QR by Householder reflections
+    [[nodiscard]] QRFactor qr(const Tensor& a);
+    // solves a * x = b with a triangular, only the named triangle of a is read
+    [[nodiscard]] Tensor triangular_solve(const Tensor& a, const Tensor& b, bool upper, bool unitriangular = false);
+    // solves a * x = b for square a, throws if a is singular
+    [[nodiscard]] Tensor solve(const Tensor& a, const Tensor& b);
+    // least-squares solution of a * x = b for a of full rank. with fewer rows than
+    // columns it is the solution of minimum norm
+    [[nodiscard]] Tensor lstsq(const Tensor& a, const Tensor& b);
+    [[nodiscard]] Tensor inv(const Tensor& a);
+    // one value per matrix, of shape {1} for a single matrix
+    [[nodiscard]] Tensor det(const Tensor& a);
+
+    struct EighResult {
+        Tensor values;  // ascending
+        Tensor vectors; // eigenvector i in column i
+    };
+    struct SVDResult {
+        Tensor u;  // m x k, left singular vectors in the columns
+        Tensor s;  // k, descending
+        Tensor vh; // k x n, right singular vectors in the rows
+    };
+
+    // eigendecomposition of a symmetric matrix: Householder reduction to tridiagonal
+    // form, then implicit QL iteration. only the lower triangle of a is read
+    [[nodiscard]] EighResult eigh(const Tensor& a);
+    // thin SVD, k = min(m, n), or the leading `rank` triplets when rank is given. the
+    // matrix is reduced to its square R factor first, then R goes through one-sided Jacobi
+    [[nodiscard]] SVDResult svd(const Tensor& a, index_t rank = 0);
+    // randomised SVD of a 2D matrix for a rank-`rank` approximation. the range is found
+    // from a Gaussian sketch with `n_oversamples` extra columns, refined by `n_iter` power
+    // iterations, so almost all of the work is GEMM against a
+    [[nodiscard]] SVDResult svd_lowrank(const Tensor& a, index_t rank, index_t n_oversamples = 10, index_t n_iter = 2);
+
+    // Einstein summation, e.g. einsum("bij,bjk->bik", {a, b}). labels are single letters,
+    // a label repeated within one operand takes its diagonal, and without "->" the output
+    // holds the labels that appear once, in alphabetical order. operands are contracted
+    // pairwise, cheapest pair first, each pair as a batched GEMM on strided views.
+    [[nodiscard]] Tensor einsum(const std::string& equation, const std::vector<Tensor>& operands);
+} // st
+
+#endif //TENSOR_LINALG_H
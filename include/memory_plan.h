@@ -0,0 +1,30 @@
+#ifndef TENSOR_MEMORY_PLAN_H
+#define TENSOR_MEMORY_PLAN_H
+
+// static memory planning: given every buffer of a schedule with its size and the steps
+// it is alive for, assign each an offset in one arena so that buffers whose lifetimes
+// overlap never overlap in memory, and all others may share it.
+
+#include "allocator.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace st {
+    struct Lifetime {
+        size_t size;  // in elements
+        index_t first; // step that writes it
+        index_t last;  // last step that reads it, inclusive
+    };
+
+    struct MemoryPlan {
+        std::vector<size_t> offset; // one per buffer, in elements
+        size_t arena_size = 0;
+    };
+
+    // greedy by size: the largest buffers are placed first, each one into the smallest gap
+    // left between the buffers already placed that are alive at the same time
+    [[nodiscard]] MemoryPlan plan_memory(const std::vector<Lifetime>& buffers);
+} // st
+
+#endif //TENSOR_MEMORY_PLAN_H
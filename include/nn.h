@@ -0,0 +1,81 @@
+#ifndef TENSOR_NN_H
+#define TENSOR_NN_H
+
+// neural-network layers on batched NCHW tensors. like linalg.h these work on whole
+// tensors rather than through expression templates.
+
+#include "tensor.h"
+
+#include <optional>
+#include <utility>
+
+namespace st {
+    // the same value applies to every spatial dim
+    struct ConvOptions {
+        index_t stride = 1;
+        index_t padding = 0;
+        index_t dilation = 1;
+        index_t groups = 1;
+    };
+
+    // input is (N, C, L) / (N, C, H, W), weight is (O, C / groups, K) / (O, C / groups, KH, KW),
+    // bias is (O). a convolution whose reduction (C / groups * KH * KW) is short, such as a
+    // depthwise one, runs a direct kernel; anything larger goes through im2col and the GEMM.
+    [[nodiscard]] Tensor conv1d(const Tensor& input, const Tensor& weight,
+                                const std::optional<Tensor>& bias = std::nullopt, const ConvOptions& options = {});
+    [[nodiscard]] Tensor conv2d(const Tensor& input, const Tensor& weight,
+                                const std::optional<Tensor>& bias = std::nullopt, const ConvOptions& options = {});
+
+    // pooling windows of kernel_size with the given stride (0 means kernel_size) and zero
+    // padding on both sides. inputs are (N, C, L) for the 1d and (N, C, H, W) for the 2d
+    // versions, read through their strides, so a permuted or sliced view needs no copy.
+    [[nodiscard]] Tensor max_pool1d(const Tensor& input, index_t kernel_size, index_t stride = 0, index_t padding = 0);
+    [[nodiscard]] Tensor max_pool2d(const Tensor& input, index_t kernel_size, index_t stride = 0, index_t padding = 0);
+    // also returns the position of each maximum, as a flat index into its input plane
+    [[nodiscard]] std::pair<Tensor, Tensor> max_pool1d_with_indices(const Tensor& input, index_t kernel_size,
+                                                                    index_t stride = 0, index_t padding = 0);
+    [[nodiscard]] std::pair<Tensor, Tensor> max_pool2d_with_indices(const Tensor& input, index_t kernel_size,
+                                                                    index_t stride = 0, index_t padding = 0);
+    // padding counts towards the divisor
+    [[nodiscard]] Tensor avg_pool1d(const Tensor& input, index_t kernel_size, index_t stride = 0, index_t padding = 0);
+    [[nodiscard]] Tensor avg_pool2d(const Tensor& input, index_t kernel_size, index_t stride = 0, index_t padding = 0);
+    [[nodiscard]] Tensor adaptive_avg_pool1d(const Tensor& input, index_t output_size);
+    [[nodiscard]] Tensor adaptive_avg_pool2d(const Tensor& input, index_t output_h, index_t output_w);
+
+    [[nodiscard]] Tensor upsample_nearest2d(const Tensor& input, index_t output_h, index_t output_w);
+    [[nodiscard]] Tensor upsample_bilinear2d(const Tensor& input, index_t output_h, index_t output_w,
+                                             bool align_corners = false);
+
+    // along any dim, with any strides. one pass keeps a running max and rescales the sum
+    // of exponentials whenever the max grows, a second writes the result, so no row is
+    // ever exponentiated without its max subtracted.
+    [[nodiscard]] Tensor softmax(const Tensor& input, int dim);
+    [[nodiscard]] Tensor log_softmax(const Tensor& input, int dim);
+    // log(sum(exp(input))) along dim, which is dropped unless keepdim is set
+    [[nodiscard]] Tensor logsumexp(const Tensor& input, int dim, bool keepdim = false);
+
+    // layer_norm and rms_norm normalise over the trailing dims given by normalized_shape,
+    // weight and bias have that shape. each row takes one pass for its statistics (Welford
+    // for the mean and variance) and one to write. the variance is the biased one.
+    [[nodiscard]] Tensor layer_norm(const Tensor& input, const Shape& normalized_shape,
+                                    const std::optional<Tensor>& weight = std::nullopt,
+                                    const std::optional<Tensor>& bias = std::nullopt, data_t eps = 1e-5);
+    [[nodiscard]] Tensor rms_norm(const Tensor& input, const Shape& normalized_shape,
+                                  const std::optional<Tensor>& weight = std::nullopt, data_t eps = 1e-5);
+    // inference mode: input is (N, C, *) and is normalised with the running statistics,
+    // every parameter is (C). scale and shift are folded per channel into a single pass.
+    [[nodiscard]] Tensor batch_norm(const Tensor& input, const Tensor& running_mean, const Tensor& running_var,
+                                    const std::optional<Tensor>& weight = std::nullopt,
+                                    const std::optional<Tensor>& bias = std::nullopt, data_t eps = 1e-5);
+    // the same, writing the result over the input
+    Tensor& layer_norm_(Tensor& input, const Shape& normalized_shape,
+                        const std::optional<Tensor>& weight = std::nullopt,
+                        const std::optional<Tensor>& bias = std::nullopt, data_t eps = 1e-5);
+    Tensor& rms_norm_(Tensor& input, const Shape& normalized_shape,
+                      const std::optional<Tensor>& weight = std::nullopt, data_t eps = 1e-5);
+    Tensor& batch_norm_(Tensor& input, const Tensor& running_mean, const Tensor& running_var,
+                        const std::optional<Tensor>& weight = std::nullopt,
+                        const std::optional<Tensor>& bias = std::nullopt, data_t eps = 1e-5);
+} // st
+
+#endif //TENSOR_NN_H
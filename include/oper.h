@@ -11,67 +11,68 @@
 
 namespace st {
     namespace op {
-        struct Add {
+        // elementwise ops whose result takes the broadcast shape of both operands
+        struct BroadcastBinary {
+            static constexpr bool elementwise = true; // output element i only reads input element i
             template<typename LhsType, typename RhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
-                CHECK_EXP_BROADCAST(lhs, rhs);
-                return lhs->eval(idx)+rhs->eval(idx);
+            static Shape size(const LhsType& lhs, const RhsType& rhs) {
+                return broadcast_shape(lhs.size(), rhs.size());
             }
             template<typename LhsType, typename RhsType>
-            static Shape size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return lhs->size();
+            static index_t size(index_t idx, const LhsType& lhs, const RhsType& rhs) {
+                index_t n = std::max(lhs.n_dim(), rhs.n_dim());
+                index_t l = idx + lhs.n_dim() >= n ? lhs.size(idx + lhs.n_dim() - n) : 1;
+                index_t r = idx + rhs.n_dim() >= n ? rhs.size(idx + rhs.n_dim() - n) : 1;
+                return l == 1 ? r : l;
             }
-            template<typename LhsType, typename RhsType>
-            static index_t size(index_t idx, const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                if (idx >= lhs->ndim()) return rhs->size(idx);
-                if (idx >= rhs->ndim()) return lhs->size(idx);
-                return std::max(lhs->size(idx), rhs->size(idx));
+        };
+        struct Add : BroadcastBinary {
+            static data_t apply(data_t a, data_t b) {
+                return a+b;
             }
             template<typename LhsType, typename RhsType>
-            static index_t n_dim(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return max(lhs->ndim(), rhs->ndim());
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                return apply(lhs.eval(idx), rhs.eval(idx));
             }
         };
-        struct Sub {
-            template<typename LhsType, typename RhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
-                CHECK_EXP_BROADCAST(lhs, rhs);
-                return lhs->eval(idx)-rhs->eval(idx);
+        struct Sub : BroadcastBinary {
+            static data_t apply(data_t a, data_t b) {
+                return a-b;
             }
             template<typename LhsType, typename RhsType>
-            static Shape size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return lhs->size();
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                return apply(lhs.eval(idx), rhs.eval(idx));
             }
         };
-        struct Mul {
-            template<typename LhsType, typename RhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
-                CHECK_EXP_BROADCAST(lhs, rhs);
-                return lhs->eval(idx)*rhs->eval(idx);
+        struct Mul : BroadcastBinary {
+            static data_t apply(data_t a, data_t b) {
+                return a*b;
             }
             template<typename LhsType, typename RhsType>
-            static Shape size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return lhs->size();
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                return apply(lhs.eval(idx), rhs.eval(idx));
             }
         };
-        struct Div {
-            template<typename LhsType, typename RhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
-                CHECK_EXP_BROADCAST(lhs, rhs);
-                data_t r = rhs->eval(idx);
-                CHECK_FLOAT_EQUAL(r, 0, "divisor cannot be zero");
-                return lhs->eval(idx)/rhs->eval(idx);
+        struct Div : BroadcastBinary {
+            static data_t apply(data_t a, data_t b) {
+                CHECK_FLOAT_EQUAL(b, 0, "divisor cannot be zero");
+                return a/b;
             }
             template<typename LhsType, typename RhsType>
-            static const Shape& size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return lhs->size();
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                return apply(lhs.eval(idx), rhs.eval(idx));
             }
         };
         struct MatrixMul_2dim {
+            static constexpr bool elementwise = false;
             template<typename LhsType, typename RhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
-                const Shape& ls = lhs->size();
-                const Shape& rs = rhs->size();
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                const Shape& ls = lhs.size();
+                const Shape& rs = rhs.size();
                 index_t l0 = ls[0], l1 = ls[1], r0 = rs[0], r1 = rs[1];
                 // default l1 == r0
                 // default lhs and rhs is 2-dimensional
@@ -79,189 +80,462 @@ namespace st {
                             "mat1 and mat2 shapes cannot be multiplied (%dx%d and %dx%d)", l0, l1, r0, r1);
                 data_t res = 0;
                 for (index_t i = 0; i < l1; ++i) {
-                    res += lhs->eval({idx[0], i})*rhs->eval({i, idx[1]});
+                    res += lhs.eval({idx[0], i})*rhs.eval({i, idx[1]});
                 }
                 return res;
             }
             template<typename LhsType, typename RhsType>
-            static Shape size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return Shape({lhs->size()[0], rhs->size()[1]});
+            static Shape size(const LhsType& lhs, const RhsType& rhs) {
+                CHECK_TRUE(lhs.n_dim() == 2 && rhs.n_dim() == 2,
+                           "mm() expects 2D tensors, but got %dD and %dD", lhs.n_dim(), rhs.n_dim());
+                return Shape({lhs.size()[0], rhs.size()[1]});
             }
         };
         struct MatrixMul_3dim {
+            static constexpr bool elementwise = false;
             template<typename LhsType, typename RhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
-                const Shape& ls = lhs->size();
-                const Shape& rs = rhs->size();
-                index_t l0 = ls[0], l1 = ls[1], l2 = ls[2], r0 = rs[0], r1 = rs[1], r2 = rs[2];
-                // default l2 == r1
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                const Shape& ls = lhs.size();
+                const Shape& rs = rhs.size();
+                index_t l1 = ls[1], l2 = ls[2], r1 = rs[1], r2 = rs[2];
                 // default lhs and rhs is 3-dimensional
-                CHECK_EQUAL(l1, r0,
-                            "mat1 and mat2 shapes cannot be multiplied (%dx%d and %dx%d)", l0, l1, r0, r1);
+                CHECK_EQUAL(l2, r1,
+                            "mat1 and mat2 shapes cannot be multiplied (%dx%d and %dx%d)", l1, l2, r1, r2);
                 data_t res = 0;
                 for (index_t i = 0; i < l2; ++i) {
-                    res += lhs->eval({idx[0], idx[1], i})*rhs->eval({idx[0], i, idx[2]});
+                    res += lhs.eval({idx[0], idx[1], i})*rhs.eval({idx[0], i, idx[2]});
                 }
                 return res;
             }
             template<typename LhsType, typename RhsType>
-            static Shape size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return Shape({lhs->size()[0], lhs->size()[1], rhs->size()[2]});
+            static Shape size(const LhsType& lhs, const RhsType& rhs) {
+                CHECK_TRUE(lhs.n_dim() == 3 && rhs.n_dim() == 3,
+                           "bmm() expects 3D tensors, but got %dD and %dD", lhs.n_dim(), rhs.n_dim());
+                return Shape({lhs.size()[0], lhs.size()[1], rhs.size()[2]});
             }
         };
         struct MatrixMul {
+            static constexpr bool elementwise = false;
             template<typename LhsType, typename RhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs, std::shared_ptr<RhsType> rhs) {
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
                 int l0, l1;
-                l0 = lhs->size()[lhs->n_dim()-2];
-                l1 = lhs->size()[lhs->n_dim()-1];
+                l0 = lhs.size()[lhs.n_dim()-2];
+                l1 = lhs.size()[lhs.n_dim()-1];
                 int r0, r1;
-                r0 = rhs->size()[rhs->n_dim()-2];
-                r1 = rhs->size()[rhs->n_dim()-1];
+                r0 = rhs.size()[rhs.n_dim()-2];
+                r1 = rhs.size()[rhs.n_dim()-1];
                 data_t res = 0;
                 CHECK_EQUAL(l1, r0,
                             "mat1 and mat2 shapes cannot be multiplied (%dx%d and %dx%d)", l0, l1, r0, r1);
+                IndexArray lidx = idx;
+                IndexArray ridx = idx;
                 for (int i = 0; i < l1; ++i) {
-                    IndexArray lidx = idx;
-                    IndexArray ridx = idx;
                     lidx[idx.size()-1] = i;
                     ridx[idx.size()-2] = i;
-                    res += lhs->eval(lidx)*rhs->eval(ridx);
+                    res += lhs.eval(lidx)*rhs.eval(ridx);
                 }
                 return res;
             }
             template<typename LhsType, typename RhsType>
-            static Shape size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                Shape res(std::max(lhs->n_dim(), rhs->n_dim()));
+            static Shape size(const LhsType& lhs, const RhsType& rhs) {
+                CHECK_TRUE(lhs.n_dim() >= 2 && rhs.n_dim() >= 2,
+                           "matmul() expects tensors with at least 2 dims, but got %dD and %dD", lhs.n_dim(), rhs.n_dim());
+                Shape res(std::max(lhs.n_dim(), rhs.n_dim()));
                 int n = res.n_dim();
-                int nl = lhs->n_dim()-2, nr = rhs->n_dim()-2;
+                int nl = lhs.n_dim()-2, nr = rhs.n_dim()-2;
                 for (int i = 0; i < n-2; ++i) {
-                    if (n-2-nl > i) res[i] = rhs->size()[n-2-nr+i];
-                    else if (n-2-nr > i) res[i] = lhs->size()[n-2-nl+i];
-                    else res[i] = std::max(lhs->size()[i-(n-2-nl)], rhs->size()[i-(n-2-nr)]);
+                    if (n-2-nl > i) res[i] = rhs.size()[n-2-nr+i];
+                    else if (n-2-nr > i) res[i] = lhs.size()[n-2-nl+i];
+                    else res[i] = std::max(lhs.size()[i-(n-2-nl)], rhs.size()[i-(n-2-nr)]);
                 }
-                res[n-2] = lhs->size()[lhs->n_dim()-2];
-                res[n-1] = rhs->size()[rhs->n_dim()-1];
+                res[n-2] = lhs.size()[lhs.n_dim()-2];
+                res[n-1] = rhs.size()[rhs.n_dim()-1];
                 return res;
             }
         };
         struct Neg {
-            template<typename LhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs) {
-                return -lhs->eval(idx);
+            static data_t apply(data_t a) {
+                return -a;
             }
-            template<typename LhsType, typename RhsType>
-            static const Shape& size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return lhs->size();
+            template<typename LhsType>
+            static data_t eval(IndexArray& idx, const LhsType& lhs) {
+                return apply(lhs.eval(idx));
             }
         };
         struct Sin {
-            template<typename LhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs) {
-                return std::sin(lhs->eval(idx));
+            static data_t apply(data_t a) {
+                return std::sin(a);
             }
-            template<typename LhsType, typename RhsType>
-            static const Shape& size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return lhs->size();
+            template<typename LhsType>
+            static data_t eval(IndexArray& idx, const LhsType& lhs) {
+                return apply(lhs.eval(idx));
             }
         };
         struct Cos {
-            template<typename LhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs) {
-                return std::cos(lhs->eval(idx));
+            static data_t apply(data_t a) {
+                return std::cos(a);
             }
-            template<typename LhsType, typename RhsType>
-            static const Shape& size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return lhs->size();
+            template<typename LhsType>
+            static data_t eval(IndexArray& idx, const LhsType& lhs) {
+                return apply(lhs.eval(idx));
             }
         };
         struct Tan {
+            static data_t apply(data_t a) {
+                return std::tan(a);
+            }
             template<typename LhsType>
-            static data_t eval(IndexArray& idx, std::shared_ptr<LhsType> lhs) {
-                return std::tan(lhs->eval(idx));
+            static data_t eval(IndexArray& idx, const LhsType& lhs) {
+                return apply(lhs.eval(idx));
+            }
+        };
+        struct Less : BroadcastBinary {
+            static data_t apply(data_t a, data_t b) {
+                return a < b;
+            }
+            template<typename LhsType, typename RhsType>
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                return apply(lhs.eval(idx), rhs.eval(idx));
+            }
+        };
+        struct LessEqual : BroadcastBinary {
+            static data_t apply(data_t a, data_t b) {
+                return a <= b;
+            }
+            template<typename LhsType, typename RhsType>
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                return apply(lhs.eval(idx), rhs.eval(idx));
+            }
+        };
+        struct Greater : BroadcastBinary {
+            static data_t apply(data_t a, data_t b) {
+                return a > b;
             }
             template<typename LhsType, typename RhsType>
-            static const Shape& size(const std::shared_ptr<LhsType>& lhs, const std::shared_ptr<RhsType>& rhs) {
-                return lhs->size();
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                return apply(lhs.eval(idx), rhs.eval(idx));
+            }
+        };
+        struct GreaterEqual : BroadcastBinary {
+            static data_t apply(data_t a, data_t b) {
+                return a >= b;
+            }
+            template<typename LhsType, typename RhsType>
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                return apply(lhs.eval(idx), rhs.eval(idx));
+            }
+        };
+        struct Equal : BroadcastBinary {
+            static data_t apply(data_t a, data_t b) {
+                return a == b;
+            }
+            template<typename LhsType, typename RhsType>
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                return apply(lhs.eval(idx), rhs.eval(idx));
+            }
+        };
+        struct NotEqual : BroadcastBinary {
+            static data_t apply(data_t a, data_t b) {
+                return a != b;
+            }
+            template<typename LhsType, typename RhsType>
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                return apply(lhs.eval(idx), rhs.eval(idx));
+            }
+        };
+        struct LogicalAnd : BroadcastBinary {
+            static data_t apply(data_t a, data_t b) {
+                return a != 0 && b != 0;
+            }
+            template<typename LhsType, typename RhsType>
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                return apply(lhs.eval(idx), rhs.eval(idx));
+            }
+        };
+        struct LogicalOr : BroadcastBinary {
+            static data_t apply(data_t a, data_t b) {
+                return a != 0 || b != 0;
+            }
+            template<typename LhsType, typename RhsType>
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                return apply(lhs.eval(idx), rhs.eval(idx));
+            }
+        };
+        struct LogicalXor : BroadcastBinary {
+            static data_t apply(data_t a, data_t b) {
+                return (a != 0) != (b != 0);
+            }
+            template<typename LhsType, typename RhsType>
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                return apply(lhs.eval(idx), rhs.eval(idx));
+            }
+        };
+        struct Maximum : BroadcastBinary {
+            static data_t apply(data_t a, data_t b) {
+                return std::max(a, b);
+            }
+            template<typename LhsType, typename RhsType>
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                return apply(lhs.eval(idx), rhs.eval(idx));
+            }
+        };
+        struct Minimum : BroadcastBinary {
+            static data_t apply(data_t a, data_t b) {
+                return std::min(a, b);
+            }
+            template<typename LhsType, typename RhsType>
+            static data_t eval(IndexArray& idx, const LhsType& lhs, const RhsType& rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                return apply(lhs.eval(idx), rhs.eval(idx));
+            }
+        };
+        struct Abs {
+            static data_t apply(data_t a) {
+                return std::fabs(a);
+            }
+            template<typename LhsType>
+            static data_t eval(IndexArray& idx, const LhsType& lhs) {
+                return apply(lhs.eval(idx));
+            }
+        };
+        struct Relu {
+            static data_t apply(data_t a) {
+                return a > 0 ? a : 0;
+            }
+            template<typename LhsType>
+            static data_t eval(IndexArray& idx, const LhsType& lhs) {
+                return apply(lhs.eval(idx));
+            }
+        };
+        struct LogicalNot {
+            static data_t apply(data_t a) {
+                return a == 0;
+            }
+            template<typename LhsType>
+            static data_t eval(IndexArray& idx, const LhsType& lhs) {
+                return apply(lhs.eval(idx));
+            }
+        };
+        struct Where {
+            template<typename CondType, typename LhsType, typename RhsType>
+            static data_t eval(IndexArray& idx, const CondType& cond,
+                               const LhsType& lhs, const RhsType& rhs) {
+                CHECK_EXP_BROADCAST(lhs, rhs);
+                CHECK_EXP_BROADCAST(cond, lhs);
+                return cond.eval(idx) != 0 ? lhs.eval(idx) : rhs.eval(idx);
+            }
+            static data_t apply(data_t c, data_t a, data_t b) {
+                return c != 0 ? a : b;
+            }
+            template<typename CondType, typename LhsType, typename RhsType>
+            static Shape size(const CondType& cond,
+                              const LhsType& lhs, const RhsType& rhs) {
+                return broadcast_shape(cond.size(), broadcast_shape(lhs.size(), rhs.size()));
             }
         };
     } // op
 
-    template<typename LhsType, typename RhsType>
-    [[nodiscard]] inline Exp<BinaryExp<op::Add, LhsType, RhsType>> operator+(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs) {
-        return Exp<BinaryExp<op::Add, LhsType, RhsType>>(
-                std::make_shared<BinaryExp<op::Add, LhsType, RhsType>>(lhs.ptr(), rhs.ptr())
-        );
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::Add, operand_t<LhsType>, operand_t<RhsType>> operator+(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::Add, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
+    }
+
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::Sub, operand_t<LhsType>, operand_t<RhsType>> operator-(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::Sub, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
+    }
+
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::Mul, operand_t<LhsType>, operand_t<RhsType>> operator*(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::Mul, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
     }
 
-    template<typename LhsType, typename RhsType>
-    [[nodiscard]] inline Exp<BinaryExp<op::Sub, LhsType, RhsType>> operator-(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs) {
-        return Exp<BinaryExp<op::Sub, LhsType, RhsType>>(
-                std::make_shared<BinaryExp<op::Sub, LhsType, RhsType>>(lhs.ptr(), rhs.ptr())
-        );
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::Div, operand_t<LhsType>, operand_t<RhsType>> operator/(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::Div, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
     }
 
-    template<typename LhsType, typename RhsType>
-    [[nodiscard]] inline Exp<BinaryExp<op::Mul, LhsType, RhsType>> operator*(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs) {
-        return Exp<BinaryExp<op::Mul, LhsType, RhsType>>(
-                std::make_shared<BinaryExp<op::Mul, LhsType, RhsType>>(lhs.ptr(), rhs.ptr())
-        );
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::MatrixMul_2dim, operand_t<LhsType>, operand_t<RhsType>> mm(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::MatrixMul_2dim, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
     }
 
-    template<typename RhsType>
-    [[nodiscard]] inline Exp<BinaryExp<op::Mul, TensorImpl, RhsType>> operator*(data_t lhs_value, const Exp<RhsType>& rhs) {
-        auto lhs = Exp<TensorImpl>(std::make_shared<TensorImpl>(Storage(1, lhs_value), Shape({1})));
-        return Exp<BinaryExp<op::Mul, TensorImpl, RhsType>>(
-                std::make_shared<BinaryExp<op::Mul, TensorImpl, RhsType>>(lhs.ptr(), rhs.ptr())
-        );
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::MatrixMul_3dim, operand_t<LhsType>, operand_t<RhsType>> bmm(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::MatrixMul_3dim, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
     }
 
-    template<typename LhsType, typename RhsType>
-    [[nodiscard]] inline Exp<BinaryExp<op::Div, LhsType, RhsType>> operator/(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs) {
-        return Exp<BinaryExp<op::Div, LhsType, RhsType>>(
-                std::make_shared<BinaryExp<op::Div, LhsType, RhsType>>(lhs.ptr(), rhs.ptr())
-        );
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::MatrixMul, operand_t<LhsType>, operand_t<RhsType>> matmul(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::MatrixMul, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
     }
 
-    template<typename LhsType, typename RhsType>
-    [[nodiscard]] inline Exp<BinaryExp<op::MatrixMul_2dim, LhsType, RhsType>> mm(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs) {
-        return Exp<BinaryExp<op::MatrixMul_2dim, LhsType, RhsType>>(
-                std::make_shared<BinaryExp<op::MatrixMul_2dim, LhsType, RhsType>>(lhs.ptr(), rhs.ptr())
-        );
+    template<expression LhsType>
+    [[nodiscard]] inline UnaryExp<op::Neg, operand_t<LhsType>> operator-(LhsType&& lhs) {
+        return UnaryExp<op::Neg, operand_t<LhsType>>(operand(std::forward<LhsType>(lhs)));
     }
 
-    template<typename LhsType, typename RhsType>
-    [[nodiscard]] inline Exp<BinaryExp<op::MatrixMul_3dim, LhsType, RhsType>> bmm(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs) {
-        return Exp<BinaryExp<op::MatrixMul_3dim, LhsType, RhsType>>(
-                std::make_shared<BinaryExp<op::MatrixMul_3dim, LhsType, RhsType>>(lhs.ptr(), rhs.ptr())
-        );
+    template<expression LhsType>
+    [[nodiscard]] inline UnaryExp<op::Sin, operand_t<LhsType>> sin(LhsType&& lhs) {
+        return UnaryExp<op::Sin, operand_t<LhsType>>(operand(std::forward<LhsType>(lhs)));
     }
 
-    template<typename LhsType, typename RhsType>
-    [[nodiscard]] inline Exp<BinaryExp<op::MatrixMul, LhsType, RhsType>> matmul(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs) {
-        return Exp<BinaryExp<op::MatrixMul, LhsType, RhsType>>(
-                std::make_shared<BinaryExp<op::MatrixMul, LhsType, RhsType>>(lhs.ptr(), rhs.ptr())
-        );
+    template<expression LhsType>
+    [[nodiscard]] inline UnaryExp<op::Cos, operand_t<LhsType>> cos(LhsType&& lhs) {
+        return UnaryExp<op::Cos, operand_t<LhsType>>(operand(std::forward<LhsType>(lhs)));
     }
 
-    template<typename LhsType>
-    [[nodiscard]] inline UnaryExp<op::Neg, LhsType> operator-(const Exp<LhsType>& lhs) {
-        return UnaryExp<op::Neg, LhsType>(lhs.ptr());
+    template<expression LhsType>
+    [[nodiscard]] inline UnaryExp<op::Tan, operand_t<LhsType>> tan(LhsType&& lhs) {
+        return UnaryExp<op::Tan, operand_t<LhsType>>(operand(std::forward<LhsType>(lhs)));
     }
 
-    template<typename LhsType>
-    [[nodiscard]] inline UnaryExp<op::Sin, LhsType> sin(const Exp<LhsType>& lhs) {
-        return UnaryExp<op::Sin, LhsType>(lhs.ptr());
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::Less, operand_t<LhsType>, operand_t<RhsType>> operator<(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::Less, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
     }
 
-    template<typename LhsType>
-    [[nodiscard]] inline UnaryExp<op::Cos, LhsType> cos(const Exp<LhsType>& lhs) {
-        return UnaryExp<op::Cos, LhsType>(lhs.ptr());
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::LessEqual, operand_t<LhsType>, operand_t<RhsType>> operator<=(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::LessEqual, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
+    }
+
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::Greater, operand_t<LhsType>, operand_t<RhsType>> operator>(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::Greater, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
+    }
+
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::GreaterEqual, operand_t<LhsType>, operand_t<RhsType>> operator>=(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::GreaterEqual, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
+    }
+
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::Equal, operand_t<LhsType>, operand_t<RhsType>> operator==(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::Equal, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
+    }
+
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::NotEqual, operand_t<LhsType>, operand_t<RhsType>> operator!=(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::NotEqual, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
+    }
+
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::LogicalAnd, operand_t<LhsType>, operand_t<RhsType>> logical_and(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::LogicalAnd, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
+    }
+
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::LogicalOr, operand_t<LhsType>, operand_t<RhsType>> logical_or(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::LogicalOr, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
+    }
+
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::LogicalXor, operand_t<LhsType>, operand_t<RhsType>> logical_xor(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::LogicalXor, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
+    }
+
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::Maximum, operand_t<LhsType>, operand_t<RhsType>> maximum(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::Maximum, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
+    }
+
+    template<expression LhsType, expression RhsType>
+    [[nodiscard]] inline BinaryExp<op::Minimum, operand_t<LhsType>, operand_t<RhsType>> minimum(LhsType&& lhs, RhsType&& rhs) {
+        return BinaryExp<op::Minimum, operand_t<LhsType>, operand_t<RhsType>>(operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
+    }
+
+    template<expression LhsType>
+    [[nodiscard]] inline UnaryExp<op::LogicalNot, operand_t<LhsType>> logical_not(LhsType&& lhs) {
+        return UnaryExp<op::LogicalNot, operand_t<LhsType>>(operand(std::forward<LhsType>(lhs)));
+    }
+
+    template<expression LhsType>
+    [[nodiscard]] inline UnaryExp<op::Abs, operand_t<LhsType>> abs(LhsType&& lhs) {
+        return UnaryExp<op::Abs, operand_t<LhsType>>(operand(std::forward<LhsType>(lhs)));
+    }
+
+    template<expression LhsType>
+    [[nodiscard]] inline UnaryExp<op::Relu, operand_t<LhsType>> relu(LhsType&& lhs) {
+        return UnaryExp<op::Relu, operand_t<LhsType>>(operand(std::forward<LhsType>(lhs)));
+    }
+
+    // a data_t on either side of a binary op becomes a ScalarExp leaf, no storage is allocated for it
+    #define ST_SCALAR_BINARY_OP(func, Op)                                                          \
+    template<expression RhsType>                                                                     \
+    [[nodiscard]] inline BinaryExp<Op, ScalarExp, operand_t<RhsType>> func(data_t lhs, RhsType&& rhs) { \
+        return BinaryExp<Op, ScalarExp, operand_t<RhsType>>(ScalarExp(lhs), operand(std::forward<RhsType>(rhs)));     \
+    }                                                                                              \
+    template<expression LhsType>                                                                     \
+    [[nodiscard]] inline BinaryExp<Op, operand_t<LhsType>, ScalarExp> func(LhsType&& lhs, data_t rhs) { \
+        return BinaryExp<Op, operand_t<LhsType>, ScalarExp>(operand(std::forward<LhsType>(lhs)), ScalarExp(rhs));     \
+    }
+
+    ST_SCALAR_BINARY_OP(operator+, op::Add)
+    ST_SCALAR_BINARY_OP(operator-, op::Sub)
+    ST_SCALAR_BINARY_OP(operator*, op::Mul)
+    ST_SCALAR_BINARY_OP(operator/, op::Div)
+    ST_SCALAR_BINARY_OP(operator<, op::Less)
+    ST_SCALAR_BINARY_OP(operator<=, op::LessEqual)
+    ST_SCALAR_BINARY_OP(operator>, op::Greater)
+    ST_SCALAR_BINARY_OP(operator>=, op::GreaterEqual)
+    ST_SCALAR_BINARY_OP(operator==, op::Equal)
+    ST_SCALAR_BINARY_OP(operator!=, op::NotEqual)
+    ST_SCALAR_BINARY_OP(maximum, op::Maximum)
+    ST_SCALAR_BINARY_OP(minimum, op::Minimum)
+    #undef ST_SCALAR_BINARY_OP
+
+    // constants fold while the tree is built, 2 * (3 * x) becomes 6 * x and (x + 1) + 2 becomes x + 3.
+    // the node is taken by value so these are more specialised than the generic scalar ops
+    #define ST_SCALAR_FOLD_OP(func, Op)                                                            \
+    template<typename RhsType>                                                                     \
+    [[nodiscard]] inline BinaryExp<Op, ScalarExp, RhsType>                                        \
+    func(data_t lhs, BinaryExp<Op, ScalarExp, RhsType> rhs) {                               \
+        return BinaryExp<Op, ScalarExp, RhsType>(ScalarExp(Op::apply(lhs, rhs.lhs().item())), rhs.rhs()); \
+    }                                                                                              \
+    template<typename LhsType>                                                                     \
+    [[nodiscard]] inline BinaryExp<Op, LhsType, ScalarExp>                                        \
+    func(BinaryExp<Op, LhsType, ScalarExp> lhs, data_t rhs) {                               \
+        return BinaryExp<Op, LhsType, ScalarExp>(lhs.lhs(), ScalarExp(Op::apply(lhs.rhs().item(), rhs))); \
+    }                                                                                              \
+    template<typename LhsType>                                                                     \
+    [[nodiscard]] inline BinaryExp<Op, LhsType, ScalarExp>                                        \
+    func(data_t lhs, BinaryExp<Op, LhsType, ScalarExp> rhs) {                               \
+        return BinaryExp<Op, LhsType, ScalarExp>(rhs.lhs(), ScalarExp(Op::apply(lhs, rhs.rhs().item()))); \
+    }                                                                                              \
+    template<typename RhsType>                                                                     \
+    [[nodiscard]] inline BinaryExp<Op, ScalarExp, RhsType>                                        \
+    func(BinaryExp<Op, ScalarExp, RhsType> lhs, data_t rhs) {                               \
+        return BinaryExp<Op, ScalarExp, RhsType>(ScalarExp(Op::apply(lhs.lhs().item(), rhs)), lhs.rhs()); \
+    }
+
+    ST_SCALAR_FOLD_OP(operator+, op::Add)
+    ST_SCALAR_FOLD_OP(operator*, op::Mul)
+    #undef ST_SCALAR_FOLD_OP
+
+    template<expression CondType, expression LhsType, expression RhsType>
+    [[nodiscard]] inline TernaryExp<op::Where, operand_t<CondType>, operand_t<LhsType>, operand_t<RhsType>>
+    where(CondType&& cond, LhsType&& lhs, RhsType&& rhs) {
+        return TernaryExp<op::Where, operand_t<CondType>, operand_t<LhsType>, operand_t<RhsType>>(
+                operand(std::forward<CondType>(cond)), operand(std::forward<LhsType>(lhs)), operand(std::forward<RhsType>(rhs)));
     }
 
-    template<typename LhsType>
-    [[nodiscard]] inline UnaryExp<op::Tan, LhsType> tan(const Exp<LhsType>& lhs) {
-        return UnaryExp<op::Tan, LhsType>(lhs.ptr());
+    // fuses into a single pass as minimum(maximum(x, min_value), max_value)
+    template<expression LhsType>
+    [[nodiscard]] inline BinaryExp<op::Minimum, BinaryExp<op::Maximum, operand_t<LhsType>, ScalarExp>, ScalarExp>
+    clamp(LhsType&& lhs, data_t min_value, data_t max_value) {
+        CHECK_TRUE(min_value <= max_value, "clamp() expects min_value <= max_value");
+        return minimum(maximum(std::forward<LhsType>(lhs), min_value), max_value);
     }
 } // st
 
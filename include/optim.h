@@ -0,0 +1,109 @@
+#ifndef TENSOR_OPTIM_H
+#define TENSOR_OPTIM_H
+
+// optimisers for autograd parameters. step() updates every parameter that has a gradient
+// in place, with one fused kernel per algorithm that reads the value, the gradient and the
+// optimiser state once. all parameters go into a single parallel launch: each one is cut
+// into chunks and the chunk list is split across threads, so thousands of small tensors
+// cost one launch rather than one per tensor.
+
+#include "autograd.h"
+
+#include <vector>
+
+namespace st {
+    class Optimizer {
+    public:
+        // parameters must be contiguous leaves, their state is allocated on their first step
+        Optimizer(std::vector<Variable> params, index_t n_state);
+        virtual ~Optimizer() = default;
+        Optimizer(const Optimizer&) = delete;
+        Optimizer& operator=(const Optimizer&) = delete;
+
+        void step();
+        void zero_grad();
+        [[nodiscard]] const std::vector<Variable>& parameters() const { return params; }
+
+    protected:
+        static constexpr index_t max_state = 3;
+        struct Chunk {
+            index_t param;
+            index_t step;                  // of this parameter, 1 on its first update
+            data_t* value;
+            const data_t* grad;
+            data_t* state[max_state];      // per element buffers, zero before the first step
+            index_t len;
+        };
+        // runs on one chunk of one parameter, from any thread
+        virtual void update(const Chunk& chunk) const = 0;
+
+    private:
+        std::vector<Variable> params;
+        index_t n_state;
+        std::vector<std::vector<std::vector<data_t>>> state; // [param][slot][element]
+        std::vector<index_t> steps;
+    };
+
+    struct SGDOptions {
+        data_t lr = 1e-2;
+        data_t momentum = 0;
+        data_t dampening = 0;
+        data_t weight_decay = 0;
+        bool nesterov = false;
+    };
+
+    class SGD : public Optimizer {
+    public:
+        explicit SGD(std::vector<Variable> params, const SGDOptions& options = {});
+        // may be changed between steps, e.g. for a learning rate schedule, except for the
+        // fields that decide which state is kept: momentum being 0 or not here, and momentum
+        // and centered for RMSprop
+        SGDOptions options;
+    protected:
+        void update(const Chunk& chunk) const override;
+    };
+
+    struct AdamOptions {
+        data_t lr = 1e-3;
+        data_t beta1 = 0.9;
+        data_t beta2 = 0.999;
+        data_t eps = 1e-8;
+        data_t weight_decay = 0;
+    };
+
+    // weight decay is added to the gradient, AdamW applies it to the weights directly
+    class Adam : public Optimizer {
+    public:
+        explicit Adam(std::vector<Variable> params, const AdamOptions& options = {});
+        AdamOptions options;
+    protected:
+        Adam(std::vector<Variable> params, const AdamOptions& options, bool decoupled);
+        void update(const Chunk& chunk) const override;
+    private:
+        bool decoupled;
+    };
+
+    class AdamW : public Adam {
+    public:
+        explicit AdamW(std::vector<Variable> params, const AdamOptions& options = {.weight_decay = 1e-2});
+    };
+
+    struct RMSpropOptions {
+        data_t lr = 1e-2;
+        data_t alpha = 0.99;
+        data_t eps = 1e-8;
+        data_t weight_decay = 0;
+        data_t momentum = 0;
+        bool centered = false;
+    };
+
+    class RMSprop : public Optimizer {
+    public:
+        explicit RMSprop(std::vector<Variable> params, const RMSpropOptions& options = {});
+        RMSpropOptions options;
+    protected:
+        void update(const Chunk& chunk) const override;
+    };
+} // st
+
+#endif //TENSOR_OPTIM_H
@@ -0,0 +1,22 @@
+#ifndef TENSOR_PARALLEL_H
+#define TENSOR_PARALLEL_H
+
+// a small fixed thread pool for splitting loops across cores
+
+#include "allocator.h"
+
+#include <functional>
+
+namespace st {
+    // run fn(begin, end) on disjoint chunks covering [begin, end).
+    // ranges smaller than grain run inline on the calling thread, and nested
+    // calls from inside a worker also run inline. if fn throws, the other chunks
+    // still finish and the first exception is rethrown on the calling thread.
+    void parallel_for(index_t begin, index_t end, index_t grain,
+                      const std::function<void(index_t, index_t)>& fn);
+
+    [[nodiscard]] index_t get_num_threads();
+    void set_num_threads(index_t n);
+} // st
+
+#endif //TENSOR_PARALLEL_H
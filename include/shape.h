@@ -8,6 +8,7 @@
 
 namespace st {
     using IndexArray = Array<index_t>;
+    using StrideArray = Array<stride_t>;
     class Shape {
     public:
         Shape(std::initializer_list<index_t> dim);
@@ -32,6 +33,11 @@ namespace st {
     private:
         IndexArray _dim;
     };
+
+    // row-major strides of a freshly allocated tensor, size-1 dims get stride 0
+    [[nodiscard]] StrideArray contiguous_stride(const Shape& shape);
+    // strides that read a tensor of (shape, stride) broadcast to target, throws if not broadcastable
+    [[nodiscard]] StrideArray expand_stride(const Shape& shape, const StrideArray& stride, const Shape& target);
 } // SimpleTensor
 
 #endif //TENSOR_SHAPE_H
@@ -3,38 +3,49 @@
 
 #include "allocator.h"
 
+#include <cstdint>
+
 namespace st {
     typedef double data_t;
-    class Storage {
+    typedef std::uint8_t bool_t; // 1-byte element of boolean tensors
+
+    template<typename T>
+    class BasicStorage {
     public:
-        explicit Storage(index_t size);
-        Storage(const Storage& other, index_t offset);
-        Storage(index_t size, data_t value);
-        Storage(const data_t *data, index_t size);
-        Storage(const std::initializer_list<data_t>& list);
+        explicit BasicStorage(index_t size);
+        BasicStorage(const BasicStorage& other, stride_t offset); // offset is relative to other's first element
+        BasicStorage(index_t size, T value);
+        BasicStorage(const T *data, index_t size);
+        BasicStorage(const std::initializer_list<T>& list);
 
-        explicit Storage(const Storage& other) = default;
-        explicit Storage(Storage&& other) = default;
+        explicit BasicStorage(const BasicStorage& other) = default;
+        explicit BasicStorage(BasicStorage&& other) = default;
 
-        ~Storage() = default;
+        ~BasicStorage() = default;
 
-        Storage& operator=(const Storage& other) = delete;
+        BasicStorage& operator=(const BasicStorage& other) = delete;
 
-        data_t operator[](index_t idx) const { return f_ptr[idx]; }
-        data_t& operator[](index_t idx) { return f_ptr[idx]; }
+        T operator[](stride_t idx) const { return f_ptr[idx]; }
+        T& operator[](stride_t idx) { return f_ptr[idx]; }
         [[nodiscard]] index_t offset() const { return f_ptr - b_ptr->data_; }
+        [[nodiscard]] T* data() const { return f_ptr; }
+        [[nodiscard]] bool shares_with(const BasicStorage& other) const { return b_ptr == other.b_ptr; }
+        [[nodiscard]] bool unique() const { return b_ptr.use_count() == 1; } // no other storage shares the buffer
         // index_t version() const { return b_ptr->version; }
         // void increment_version() { ++b_ptr->version; }
         index_t size_;
     private:
         struct Data {
             // index_t version_; // what is its meaning?
-            data_t data_[1];
+            T data_[1];
         };
         std::shared_ptr<Data> b_ptr; // base pointer
-        data_t* f_ptr; // float pointer
+        T* f_ptr; // float pointer
     };
 
+    using Storage = BasicStorage<data_t>;
+    using BoolStorage = BasicStorage<bool_t>;
+
 } // SimpleTensor
 
 #endif //TENSOR_STORAGE_H
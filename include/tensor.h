@@ -8,16 +8,15 @@
 
 namespace st {
 
-    class Tensor : public Exp<TensorImpl>
+    class Tensor : public Exp<Tensor>
 	{
-        using Exp<TensorImpl>::impl_ptr;
 	 public:
 		//constructors
-		Tensor(const Storage& storage, const Shape& shape, const IndexArray& stride);
+		Tensor(const Storage& storage, const Shape& shape, const StrideArray& stride);
 		Tensor(const Storage& storage, const Shape& shape);
 		explicit Tensor(const Shape& shape);
 		Tensor(const data_t* data, const Shape& shape);
-		Tensor(Storage&& storage, Shape&& shape, IndexArray&& stride);
+		Tensor(Storage&& storage, Shape&& shape, StrideArray&& stride);
 		Tensor(const Tensor& other) = default;
 		Tensor(Tensor&& other) = default;
 		Tensor& operator=(const Tensor &other)
@@ -31,9 +30,9 @@ namespace st {
         ~Tensor() = default;
 		explicit Tensor(Alloc::NonTrivalUniquePtr<TensorImpl>&& ptr);
         template<typename ImplType>
-        Tensor(const Exp<ImplType>& impl) : Tensor(impl.ptr()->size())
+        Tensor(const Exp<ImplType>& impl) : Tensor(impl.self().size())
         {
-            impl_ptr->operator=(impl.ptr());
+            impl_ptr->operator=(impl.self().node());
         }
 
 		//inline function
@@ -42,22 +41,52 @@ namespace st {
 		[[nodiscard]] index_t size(index_t idx) const { return impl_ptr->size(idx); }
 		[[nodiscard]] const Shape& size() const { return impl_ptr->size(); }
 		[[nodiscard]] index_t offset() const { return impl_ptr->offset(); }
-		[[nodiscard]] const IndexArray& stride() const { return impl_ptr->stride(); }
+		[[nodiscard]] const StrideArray& stride() const { return impl_ptr->stride(); }
 
 		//methods
 		[[nodiscard]] bool is_contiguous();
+		[[nodiscard]] bool has_internal_overlap() const { return impl_ptr->has_internal_overlap(); }
+		[[nodiscard]] data_t* data() const { return impl_ptr->data(); }
 		[[nodiscard]] data_t item() const;
 		[[nodiscard]] data_t item(int idx) const;
+		using Exp<Tensor>::eval;
 		[[nodiscard]] data_t eval(IndexArray idx) const;
+		// expressions keep a non-owning handle to a named tensor, it must outlive them
+		[[nodiscard]] ImplRef<TensorImpl> node() const& { return ImplRef<TensorImpl>(*impl_ptr); }
+		// a temporary's handle owns the impl, so an expression over it can be kept
+		[[nodiscard]] ImplHold<TensorImpl> node() const&& { return ImplHold<TensorImpl>(impl_ptr); }
+		[[nodiscard]] const std::shared_ptr<TensorImpl>& ptr() const { return impl_ptr; }
 		data_t &operator[](std::initializer_list<index_t> dims);
 		data_t operator[](std::initializer_list<index_t> dims) const;
 
 		[[nodiscard]] Tensor slice(index_t idx, index_t dim = 0) const;
 		[[nodiscard]] Tensor slice(index_t start, index_t end, index_t dim) const;
+		[[nodiscard]] Tensor slice(const std::vector<Slice>& slices) const;
+		[[nodiscard]] Tensor narrow(index_t dim, index_t start, index_t length) const;
+		[[nodiscard]] Tensor select(index_t dim, index_t idx) const;
+		[[nodiscard]] Tensor unfold(index_t dim, index_t size, index_t step) const;
 		[[nodiscard]] Tensor transpose(index_t dim1, index_t dim2) const;
 		[[nodiscard]] Tensor view(const Shape& Shape) const;
 		[[nodiscard]] Tensor permute(std::initializer_list<index_t> dims) const;
         [[nodiscard]] Tensor sum(int idx) const;
+		[[nodiscard]] Tensor expand(const Shape& shape) const;
+		[[nodiscard]] Tensor broadcast_to(const Shape& shape) const;
+		[[nodiscard]] Tensor unsqueeze(index_t dim) const;
+		[[nodiscard]] Tensor squeeze() const;
+		[[nodiscard]] Tensor squeeze(index_t dim) const;
+		[[nodiscard]] Tensor flatten(index_t start_dim = 0) const;
+		[[nodiscard]] Tensor flatten(index_t start_dim, index_t end_dim) const;
+		[[nodiscard]] Tensor contiguous() const;
+		[[nodiscard]] std::vector<Tensor> split(index_t split_size, index_t dim = 0) const;
+		[[nodiscard]] std::vector<Tensor> chunk(index_t chunks, index_t dim = 0) const;
+		[[nodiscard]] Tensor index_select(index_t dim, const Tensor& index) const;
+		[[nodiscard]] Tensor gather(index_t dim, const Tensor& index) const;
+		[[nodiscard]] Tensor masked_select(const Tensor& mask) const;
+		[[nodiscard]] Tensor masked_select(const BoolTensor& mask) const;
+		Tensor& scatter(index_t dim, const Tensor& index, const Tensor& src);
+		Tensor& scatter_add(index_t dim, const Tensor& index, const Tensor& src);
+		Tensor& masked_fill(const Tensor& mask, data_t value);
+		Tensor& masked_fill(const BoolTensor& mask, data_t value);
 
 		//friend function
 		friend std::ostream& operator<<(std::ostream& out, const Tensor& tensor);
@@ -119,12 +148,42 @@ namespace st {
 		[[nodiscard]] iterator begin();
 		[[nodiscard]] iterator end();
 
+		// writes in place when the shapes match. otherwise a tensor that is the only
+		// owner of its storage is rebound to a new one, and a view throws like assign()
 		template<typename ImplType>
 		Tensor& operator=(const Exp<ImplType>& src_){
-            impl_ptr->operator=(src_.ptr());
+            if (!(src_.self().size() == size())) {
+                CHECK_TRUE(impl_ptr.use_count() == 1 && impl_ptr->owns_storage(),
+                    "assignment with a different shape to a tensor that shares its storage");
+                return *this = Tensor(src_);
+            }
+            impl_ptr->operator=(src_.self().node());
 			return *this;
 		}
 
+		// writes src into the existing storage, the shapes must match
+		template<typename ImplType>
+		Tensor& assign(const Exp<ImplType>& src_){
+            CHECK_TRUE(src_.self().size() == size(),
+                "assign() expects the source to have the same shape as the destination");
+            impl_ptr->operator=(src_.self().node());
+			return *this;
+		}
+
+		// compound assignment, evaluated in place without a full-size temporary
+		template<typename ImplType>
+		Tensor& operator+=(const Exp<ImplType>& src_) { return compound<op::Add>(src_); }
+		template<typename ImplType>
+		Tensor& operator-=(const Exp<ImplType>& src_) { return compound<op::Sub>(src_); }
+		template<typename ImplType>
+		Tensor& operator*=(const Exp<ImplType>& src_) { return compound<op::Mul>(src_); }
+		template<typename ImplType>
+		Tensor& operator/=(const Exp<ImplType>& src_) { return compound<op::Div>(src_); }
+		Tensor& operator+=(data_t value);
+		Tensor& operator-=(data_t value);
+		Tensor& operator*=(data_t value);
+		Tensor& operator/=(data_t value);
+
         static Tensor ones(const Shape& shape);
         static Tensor ones_like(const Tensor& tensor);
         static Tensor zeros(const Shape& shape);
@@ -134,8 +193,54 @@ namespace st {
         static Tensor randn(const Shape& shape);
         static Tensor randn_like(const Tensor& tensor);
         [[nodiscard]] data_t sum() const;
+
+	 private:
+		template<typename Op, typename ImplType>
+		Tensor& compound(const Exp<ImplType>& src_) {
+            return compound<Op>(src_.self().node());
+		}
+		template<typename Op, typename NodeType>
+		Tensor& compound(const NodeType& src) {
+            CHECK_TRUE(broadcast_shape(size(), src.size()) == size(),
+                "output with shape of %dD doesn't match the broadcast shape", n_dim());
+            impl_ptr->operator=(BinaryExp<Op, ImplRef<TensorImpl>, NodeType>(node(), src));
+            return *this;
+		}
+
+		std::shared_ptr<TensorImpl> impl_ptr;
     };
 
+    // out= variants, the result is written into the preallocated `out`
+    template<typename LhsType, typename RhsType>
+    inline Tensor& add(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs, Tensor& out) {
+        return out.assign(lhs + rhs);
+    }
+    template<typename LhsType, typename RhsType>
+    inline Tensor& sub(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs, Tensor& out) {
+        return out.assign(lhs - rhs);
+    }
+    template<typename LhsType, typename RhsType>
+    inline Tensor& mul(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs, Tensor& out) {
+        return out.assign(lhs * rhs);
+    }
+    template<typename LhsType, typename RhsType>
+    inline Tensor& div(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs, Tensor& out) {
+        return out.assign(lhs / rhs);
+    }
+    template<typename LhsType, typename RhsType>
+    inline Tensor& matmul(const Exp<LhsType>& lhs, const Exp<RhsType>& rhs, Tensor& out) {
+        return out.assign(matmul(lhs, rhs));
+    }
+
+    // the output is allocated once and each input is copied in parallel row runs
+    [[nodiscard]] Tensor cat(const std::vector<Tensor>& tensors, index_t dim = 0);
+    [[nodiscard]] Tensor stack(const std::vector<Tensor>& tensors, index_t dim = 0);
+
+    template<typename SubType>
+    inline Tensor Exp<SubType>::eval() const {
+        return Tensor(*this);
+    }
+
 } // st
 
 #endif //TENSOR_TENSOR_H
@@ -7,22 +7,35 @@
 #include "allocator.h"
 #include "exception.h"
 #include "exp.h"
+#include "bool_tensor.h"
+#include "fusion.h"
 
 #include <initializer_list>
+#include <climits>
+#include <vector>
 
 namespace st {
+    // python-style start:stop:step range on one dimension.
+    // negative start/stop count from the end, none means "to the boundary".
+    struct Slice {
+        static constexpr stride_t none = INT_MAX;
+        Slice() : start(none), stop(none), step(1) {}
+        Slice(stride_t start_, stride_t stop_, stride_t step_ = 1) : start(start_), stop(stop_), step(step_) {}
+        stride_t start, stop, step;
+    };
+
     class TensorImpl {
     public:
         // constructor
-        TensorImpl(const Storage& Storage, const Shape& Shape, const IndexArray& stride);
+        TensorImpl(const Storage& Storage, const Shape& Shape, const StrideArray& stride);
         TensorImpl(const Storage& Storage, const Shape& Shape);
         explicit TensorImpl(const Shape& Shape);
         TensorImpl(const data_t* data, const Shape& Shape);
-        TensorImpl(Storage&& Storage, Shape&& Shape, IndexArray&& stride);
+        TensorImpl(Storage&& Storage, Shape&& Shape, StrideArray&& stride);
         TensorImpl(const TensorImpl& other) = default;
         TensorImpl(TensorImpl&& other) = default;
         template<typename ImplType>
-        explicit TensorImpl(const ImplType& impl) : TensorImpl(impl->size()) {
+        explicit TensorImpl(const ImplType& impl) : TensorImpl(impl.size()) {
             this->operator=(impl);
         }
 
@@ -36,39 +49,105 @@ namespace st {
         }
         [[nodiscard]] const Shape& size() const { return _shape; }
         [[nodiscard]] index_t offset() const { return _storage.offset(); }
-        [[nodiscard]] const IndexArray& stride() const { return _stride; }
+        [[nodiscard]] const StrideArray& stride() const { return _stride; }
+        [[nodiscard]] data_t* data() const { return _storage.data(); }
 
         // methods
         bool is_contiguous() const;
+        bool has_internal_overlap() const; // whether two indices may share one memory location
+        // whether this is the only view of its buffer and covers all of it
+        [[nodiscard]] bool owns_storage() const {
+            return _storage.unique() && _storage.offset() == 0 && d_size() == _storage.size_ && is_contiguous();
+        }
 
         data_t& operator[](std::initializer_list<index_t> dims); // use initializer list to access/modify the data.
         data_t operator[](std::initializer_list<index_t> dims) const;
         [[nodiscard]] data_t item() const;
-        [[nodiscard]] data_t item(index_t idx) const;
-		[[nodiscard]] data_t& item(index_t idx);
+        [[nodiscard]] data_t item(stride_t idx) const;
+		[[nodiscard]] data_t& item(stride_t idx);
         [[nodiscard]] data_t eval(IndexArray idx) const;
         [[nodiscard]] data_t sum() const;
 
         [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> slice(index_t idx, index_t dim = 0) const;
         [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> slice(index_t start_idx, index_t end_idx, index_t dim) const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> slice(const std::vector<Slice>& slices) const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> narrow(index_t dim, index_t start, index_t length) const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> select(index_t dim, index_t idx) const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> unfold(index_t dim, index_t size, index_t step) const;
         [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> transpose(index_t dim1, index_t dim2) const;
         [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> view(const Shape& Shape) const;
         [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> permute(std::initializer_list<index_t> dims) const;
         [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> sum(int idx) const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> expand(const Shape& shape) const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> unsqueeze(index_t dim) const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> squeeze() const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> squeeze(index_t dim) const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> flatten(index_t start_dim, index_t end_dim) const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> contiguous() const;
+        [[nodiscard]] std::vector<Alloc::NonTrivalUniquePtr<TensorImpl>> split(index_t split_size, index_t dim) const;
+        [[nodiscard]] std::vector<Alloc::NonTrivalUniquePtr<TensorImpl>> chunk(index_t chunks, index_t dim) const;
+
+        // indexing kernels, index tensors hold integral values and masks treat non-zero as true
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> index_select(index_t dim, const TensorImpl& index) const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> gather(index_t dim, const TensorImpl& index) const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> masked_select(const TensorImpl& mask) const;
+        [[nodiscard]] Alloc::NonTrivalUniquePtr<TensorImpl> masked_select(const BoolTensorImpl& mask) const;
+        TensorImpl& scatter(index_t dim, const TensorImpl& index, const TensorImpl& src);
+        TensorImpl& scatter_add(index_t dim, const TensorImpl& index, const TensorImpl& src);
+        TensorImpl& masked_fill(const TensorImpl& mask, data_t value);
+        TensorImpl& masked_fill(const BoolTensorImpl& mask, data_t value);
 
         // friend function
         friend std::ostream& operator<<(std::ostream& out, const TensorImpl& tensor);
 
+        // whether writing this tensor while evaluating src element by element could
+        // clobber an element src still has to read. reading the very same view at the
+        // same index through elementwise ops only is safe.
+        template<typename Op, typename LhsType, typename RhsType>
+        [[nodiscard]] bool overlaps(const BinaryExp<Op, LhsType, RhsType>& src, bool pointwise = true) const {
+            pointwise = pointwise && Op::elementwise;
+            return overlaps(src.lhs(), pointwise) || overlaps(src.rhs(), pointwise);
+        }
+        template<typename Op, typename LhsType>
+        [[nodiscard]] bool overlaps(const UnaryExp<Op, LhsType>& src, bool pointwise = true) const {
+            return overlaps(src.lhs(), pointwise);
+        }
+        template<typename Op, typename CondType, typename LhsType, typename RhsType>
+        [[nodiscard]] bool overlaps(const TernaryExp<Op, CondType, LhsType, RhsType>& src, bool pointwise = true) const {
+            return overlaps(src.cond(), pointwise) || overlaps(src.lhs(), pointwise) || overlaps(src.rhs(), pointwise);
+        }
+        [[nodiscard]] bool overlaps(const TensorImpl& src, bool pointwise = true) const;
+        [[nodiscard]] bool overlaps(const ImplRef<TensorImpl>& src, bool pointwise = true) const {
+            return overlaps(src.get(), pointwise);
+        }
+        [[nodiscard]] bool overlaps(const ImplRef<BoolTensorImpl>&, bool = true) const { return false; }
+        [[nodiscard]] bool overlaps(const ScalarExp&, bool = true) const { return false; }
+
         template<typename ImplType>
         TensorImpl& operator=(const ImplType& src) {
+            CHECK_TRUE(!has_internal_overlap(),
+                "unsupported operation: more than one element of the written-to tensor "
+                "refers to a single memory location, call contiguous() before writing");
+            if (overlaps(src)) {
+                // evaluate into a fresh buffer first, then copy it over
+                TensorImpl tmp(src);
+                return this->operator=(ImplRef<TensorImpl>(tmp));
+            }
+            if constexpr (fusion::fusable<ImplType>) {
+                if (fusion::assign(*this, src)) return *this;
+            }
+            if constexpr (fusion::gemm_root<ImplType>) {
+                fusion::assign_matmul(*this, src);
+                return *this;
+            }
             std::vector<index_t> dim_cnt(n_dim(), 0);
             int cnt = 0;
             while (cnt < d_size()) {
-                int idx = 0;
+                stride_t idx = 0;
                 for (int i = 0; i < n_dim(); ++i) {
-                    idx += dim_cnt[i] * _stride[i];
+                    idx += (stride_t)dim_cnt[i] * _stride[i];
                 }
-                item(idx) = src->eval(dim_cnt);
+                item(idx) = src.eval(dim_cnt);
                 for (int i = n_dim()-1; i >= 0; --i) {
                     if (dim_cnt[i]+1 < _shape[i]) {
                         dim_cnt[i]++;
@@ -85,7 +164,7 @@ namespace st {
     protected:
         Storage _storage;
         Shape _shape;
-        IndexArray _stride;
+        StrideArray _stride;
     };
 
     struct TensorMaker {
@@ -97,6 +176,8 @@ namespace st {
         static TensorImpl rand_like(const TensorImpl& tensor);
         static TensorImpl randn(const Shape& shape);
         static TensorImpl randn_like(const TensorImpl& tensor);
+        static TensorImpl cat(const std::vector<const TensorImpl*>& tensors, index_t dim);
+        static TensorImpl stack(const std::vector<const TensorImpl*>& tensors, index_t dim);
     };
 } // st
 
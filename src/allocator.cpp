@@ -1,6 +1,7 @@
 #include "allocator.h"
 #include <memory>
 #include <cstdlib>
+#include <mutex>
 
 namespace st {
     index_t Alloc::allocate_memory_size = 0;
@@ -10,7 +11,12 @@ namespace st {
         return alloc;
     }
 
+    namespace {
+        std::mutex cache_mutex; // tensors are also created from pool workers
+    }
+
     void* Alloc::allocate(index_t size) {
+        std::lock_guard<std::mutex> lock(cache_mutex);
         auto iter = self().cache_.find(size);
         void* res;
         if (iter != self().cache_.end()) {
@@ -27,6 +33,7 @@ namespace st {
     }
 
     void Alloc::deallocate(void* ptr, index_t size) {
+        std::lock_guard<std::mutex> lock(cache_mutex);
         deallocate_memory_size -= size;
         self().cache_.emplace(size, ptr);
     }
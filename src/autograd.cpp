@@ -0,0 +1,384 @@
+#include "autograd.h"
+#include "exception.h"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace st {
+    namespace autograd {
+        namespace {
+            thread_local bool enabled = true;
+
+            Tensor copy_of(const Tensor& t) {
+                Tensor out(t.size());
+                out.assign(t);
+                return out;
+            }
+
+            void accumulate(VariableImpl& leaf, const Tensor& grad) {
+                CHECK_TRUE(grad.size() == leaf.value.size(), "the gradient of a leaf must have the leaf's shape");
+                // the first gradient may still be shared with the graph, so the leaf keeps a copy
+                if (!leaf.grad) leaf.grad = copy_of(grad);
+                else *leaf.grad += grad;
+            }
+
+            // nodes reachable from root, each one before every node it feeds
+            std::vector<Node*> reverse_topological(Node* root) {
+                std::vector<Node*> post;
+                std::unordered_set<Node*> seen{root};
+                std::vector<std::pair<Node*, index_t>> stack{{root, 0}};
+                while (!stack.empty()) {
+                    Node* node = stack.back().first;
+                    index_t next = stack.back().second++;
+                    if (next == node->next.size()) {
+                        post.push_back(node);
+                        stack.pop_back();
+                        continue;
+                    }
+                    Node* child = node->next[next].fn.get();
+                    if (child && seen.insert(child).second) stack.emplace_back(child, 0);
+                }
+                return {post.rbegin(), post.rend()};
+            }
+        }
+
+        bool grad_enabled() { return enabled; }
+
+        Tensor reduce_to(const Tensor& grad, const Shape& shape) {
+            if (grad.size() == shape) return grad;
+            index_t nd = grad.n_dim();
+            CHECK_TRUE(shape.n_dim() <= nd, "a gradient of %dD can't be reduced to %dD", nd, shape.n_dim());
+            index_t lead = nd - shape.n_dim();
+            // dense strides of the output against the dims of grad, 0 where they are summed over
+            std::vector<stride_t> out_stride(nd, 0);
+            stride_t step = 1;
+            for (index_t d = shape.n_dim(); d-- > 0;) {
+                CHECK_TRUE(shape[d] == grad.size(d + lead) || shape[d] == 1,
+                           "a gradient of size %d can't be reduced to size %d at dim %d", grad.size(d + lead), shape[d], d);
+                if (shape[d] != 1) out_stride[d + lead] = step;
+                step *= (stride_t)shape[d];
+            }
+            Tensor out(shape);
+            data_t* dst = out.data();
+            const data_t* src = grad.data();
+            const StrideArray& in_stride = grad.stride();
+            index_t last = grad.size(nd - 1);
+            stride_t in_last = in_stride[nd - 1], out_last = out_stride[nd - 1];
+            std::vector<index_t> idx(nd, 0);
+            stride_t in = 0, o = 0;
+            for (index_t rows = grad.d_size() / last; rows-- > 0;) {
+                for (index_t i = 0; i < last; ++i) dst[o + (stride_t)i * out_last] += src[in + (stride_t)i * in_last];
+                for (index_t d = nd - 1; d-- > 0;) {
+                    if (++idx[d] < grad.size(d)) {
+                        in += in_stride[d];
+                        o += out_stride[d];
+                        break;
+                    }
+                    in -= (stride_t)(idx[d] - 1) * in_stride[d];
+                    o -= (stride_t)(idx[d] - 1) * out_stride[d];
+                    idx[d] = 0;
+                }
+            }
+            return out;
+        }
+    } // autograd
+
+    using autograd::Node;
+    using Grads = std::vector<std::optional<Tensor>>;
+
+    NoGradGuard::NoGradGuard() : previous(autograd::enabled) { autograd::enabled = false; }
+    NoGradGuard::~NoGradGuard() { autograd::enabled = previous; }
+
+    namespace {
+        class EnableGradGuard { // backward may be called from inside a NoGradGuard
+        public:
+            EnableGradGuard() : previous(autograd::enabled) { autograd::enabled = true; }
+            ~EnableGradGuard() { autograd::enabled = previous; }
+        private:
+            bool previous;
+        };
+    }
+
+    Variable::Variable(const Tensor& value, bool requires_grad)
+        : impl(std::make_shared<autograd::VariableImpl>(autograd::VariableImpl{value, requires_grad, std::nullopt, nullptr})) {}
+
+    Variable Variable::record(Tensor value, const std::vector<const Variable*>& inputs, Node::Backward backward) {
+        bool any = false;
+        if (autograd::grad_enabled())
+            for (const Variable* input : inputs) any = any || input->requires_grad();
+        Variable out(std::move(value));
+        if (!any) return out;
+        auto node = std::make_shared<Node>();
+        for (const Variable* input : inputs) {
+            autograd::Edge edge;
+            if (input->requires_grad()) {
+                if (input->is_leaf()) edge.leaf = input->impl;
+                else edge.fn = input->impl->grad_fn;
+            }
+            node->next.push_back(std::move(edge));
+        }
+        node->backward = std::move(backward);
+        out.impl->requires_grad = true;
+        out.impl->grad_fn = std::move(node);
+        return out;
+    }
+
+    void Variable::backward(bool retain_graph) const {
+        CHECK_EQUAL(impl->value.d_size(), 1,
+                    "backward() without a gradient expects a single-element output, but got %d elements", impl->value.d_size());
+        Tensor seed(impl->value.size());
+        *seed.data() = 1;
+        backward(seed, retain_graph);
+    }
+
+    void Variable::backward(const Tensor& grad, bool retain_graph) const {
+        CHECK_TRUE(impl->requires_grad, "backward() on a variable that doesn't require grad");
+        CHECK_TRUE(grad.size() == size(), "backward() expects a gradient with the shape of the output");
+        if (is_leaf()) {
+            autograd::accumulate(*impl, grad);
+            return;
+        }
+        // gradients wait here until every consumer of their node has run, then are freed
+        std::unordered_map<Node*, Tensor> pending;
+        pending.emplace(impl->grad_fn.get(), grad);
+        for (Node* node : autograd::reverse_topological(impl->grad_fn.get())) {
+            auto it = pending.find(node);
+            if (it == pending.end()) continue;
+            Tensor g = std::move(it->second);
+            pending.erase(it);
+            CHECK_TRUE(bool(node->backward),
+                       "backward() through a graph that was already released, pass retain_graph to the first call");
+            Grads grads = node->backward(g, *node);
+            if (!retain_graph) node->backward = nullptr;
+            for (index_t i = 0; i < node->next.size(); ++i) {
+                const autograd::Edge& edge = node->next[i];
+                if (!grads[i] || !edge.needed()) continue;
+                if (edge.leaf) {
+                    autograd::accumulate(*edge.leaf, *grads[i]);
+                    continue;
+                }
+                auto at = pending.find(edge.fn.get());
+                if (at == pending.end()) pending.emplace(edge.fn.get(), std::move(*grads[i]));
+                else at->second = Tensor(at->second + *grads[i]);
+            }
+        }
+    }
+
+    Variable Variable::transpose(index_t dim0, index_t dim1) const {
+        return record(impl->value.transpose(dim0, dim1), {this}, [dim0, dim1](const Tensor& g, const Node&) -> Grads {
+            return {g.transpose(dim0, dim1)};
+        });
+    }
+
+    Variable Variable::view(const Shape& shape) const {
+        return record(impl->value.view(shape), {this}, [shape = size()](const Tensor& g, const Node&) -> Grads {
+            return {g.contiguous().view(shape)};
+        });
+    }
+
+    Variable Variable::unsqueeze(index_t dim) const {
+        return record(impl->value.unsqueeze(dim), {this}, [dim](const Tensor& g, const Node&) -> Grads {
+            return {g.squeeze(dim)};
+        });
+    }
+
+    Variable Variable::squeeze(index_t dim) const {
+        return record(impl->value.squeeze(dim), {this}, [shape = size()](const Tensor& g, const Node&) -> Grads {
+            return {g.contiguous().view(shape)};
+        });
+    }
+
+    Variable Variable::slice(index_t start, index_t end, index_t dim) const {
+        return record(impl->value.slice(start, end, dim), {this},
+                      [shape = size(), start, end, dim](const Tensor& g, const Node&) -> Grads {
+            Tensor res(shape);
+            Tensor part = res.slice(start, end, dim);
+            part.assign(g);
+            return {res};
+        });
+    }
+
+    Variable Variable::select(index_t dim, index_t idx) const {
+        return record(impl->value.select(dim, idx), {this}, [shape = size(), dim, idx](const Tensor& g, const Node&) -> Grads {
+            Tensor res(shape);
+            Tensor part = res.select(dim, idx);
+            part.assign(g);
+            return {res};
+        });
+    }
+
+    Variable Variable::expand(const Shape& shape) const {
+        return record(impl->value.expand(shape), {this}, [shape = size()](const Tensor& g, const Node&) -> Grads {
+            return {autograd::reduce_to(g, shape)};
+        });
+    }
+
+    Variable Variable::sum() const {
+        Tensor res(Shape({1}));
+        *res.data() = impl->value.sum();
+        return record(res, {this}, [shape = size()](const Tensor& g, const Node&) -> Grads {
+            return {g.expand(shape)};
+        });
+    }
+
+    Variable Variable::sum(int dim) const {
+        if (n_dim() == 1) {
+            CHECK_IN_RANGE(dim, 0, 1, "Dimension out of range (expected to be in range of [0, 1), but got %d)", dim);
+            return sum();
+        }
+        return record(impl->value.sum(dim), {this}, [shape = size(), dim](const Tensor& g, const Node&) -> Grads {
+            return {g.unsqueeze(dim).expand(shape)};
+        });
+    }
+
+    Variable operator+(const Variable& lhs, const Variable& rhs) {
+        const Tensor &a = lhs.value(), &b = rhs.value();
+        return Variable::record(Tensor(a + b), {&lhs, &rhs},
+                                [sa = a.size(), sb = b.size()](const Tensor& g, const Node& node) -> Grads {
+            Grads res(2);
+            if (node.needs(0)) res[0] = autograd::reduce_to(g, sa);
+            if (node.needs(1)) res[1] = autograd::reduce_to(g, sb);
+            return res;
+        });
+    }
+
+    Variable operator-(const Variable& lhs, const Variable& rhs) {
+        const Tensor &a = lhs.value(), &b = rhs.value();
+        return Variable::record(Tensor(a - b), {&lhs, &rhs},
+                                [sa = a.size(), sb = b.size()](const Tensor& g, const Node& node) -> Grads {
+            Grads res(2);
+            if (node.needs(0)) res[0] = autograd::reduce_to(g, sa);
+            if (node.needs(1)) res[1] = autograd::reduce_to(Tensor(-g), sb);
+            return res;
+        });
+    }
+
+    Variable operator*(const Variable& lhs, const Variable& rhs) {
+        const Tensor &a = lhs.value(), &b = rhs.value();
+        return Variable::record(Tensor(a * b), {&lhs, &rhs}, [a, b](const Tensor& g, const Node& node) -> Grads {
+            Grads res(2);
+            if (node.needs(0)) res[0] = autograd::reduce_to(Tensor(g * b), a.size());
+            if (node.needs(1)) res[1] = autograd::reduce_to(Tensor(g * a), b.size());
+            return res;
+        });
+    }
+
+    Variable operator/(const Variable& lhs, const Variable& rhs) {
+        const Tensor &a = lhs.value(), &b = rhs.value();
+        Tensor out(a / b);
+        // d(a / b)/db = -out / b, so a itself isn't kept
+        return Variable::record(out, {&lhs, &rhs}, [sa = a.size(), b, out](const Tensor& g, const Node& node) -> Grads {
+            Grads res(2);
+            if (node.needs(0)) res[0] = autograd::reduce_to(Tensor(g / b), sa);
+            if (node.needs(1)) res[1] = autograd::reduce_to(Tensor(-(g * out) / b), b.size());
+            return res;
+        });
+    }
+
+    Variable operator+(const Variable& lhs, data_t rhs) {
+        return Variable::record(Tensor(lhs.value() + rhs), {&lhs}, [](const Tensor& g, const Node&) -> Grads {
+            return {g};
+        });
+    }
+    Variable operator-(const Variable& lhs, data_t rhs) { return lhs + -rhs; }
+    Variable operator*(const Variable& lhs, data_t rhs) {
+        return Variable::record(Tensor(lhs.value() * rhs), {&lhs}, [rhs](const Tensor& g, const Node&) -> Grads {
+            return {Tensor(g * rhs)};
+        });
+    }
+    Variable operator/(const Variable& lhs, data_t rhs) { return lhs * (1 / rhs); }
+    Variable operator+(data_t lhs, const Variable& rhs) { return rhs + lhs; }
+    Variable operator-(data_t lhs, const Variable& rhs) { return -rhs + lhs; }
+    Variable operator*(data_t lhs, const Variable& rhs) { return rhs * lhs; }
+    Variable operator/(data_t lhs, const Variable& rhs) {
+        const Tensor& x = rhs.value();
+        Tensor out(lhs / x);
+        return Variable::record(out, {&rhs}, [x, out](const Tensor& g, const Node&) -> Grads {
+            return {Tensor(-(g * out) / x)};
+        });
+    }
+
+    Variable operator-(const Variable& x) {
+        return Variable::record(Tensor(-x.value()), {&x}, [](const Tensor& g, const Node&) -> Grads {
+            return {Tensor(-g)};
+        });
+    }
+
+    Variable sin(const Variable& x) {
+        const Tensor& v = x.value();
+        return Variable::record(Tensor(sin(v)), {&x}, [v](const Tensor& g, const Node&) -> Grads {
+            return {Tensor(g * cos(v))};
+        });
+    }
+
+    Variable cos(const Variable& x) {
+        const Tensor& v = x.value();
+        return Variable::record(Tensor(cos(v)), {&x}, [v](const Tensor& g, const Node&) -> Grads {
+            return {Tensor(-(g * sin(v)))};
+        });
+    }
+
+    Variable tan(const Variable& x) {
+        Tensor out(tan(x.value()));
+        return Variable::record(out, {&x}, [out](const Tensor& g, const Node&) -> Grads {
+            return {Tensor(g * (out * out + 1))};
+        });
+    }
+
+    Variable abs(const Variable& x) {
+        const Tensor& v = x.value();
+        return Variable::record(Tensor(abs(v)), {&x}, [v](const Tensor& g, const Node&) -> Grads {
+            return {Tensor(g * ((v > 0) - (v < 0)))};
+        });
+    }
+
+    Variable relu(const Variable& x) {
+        Tensor out(relu(x.value()));
+        return Variable::record(out, {&x}, [out](const Tensor& g, const Node&) -> Grads {
+            return {Tensor(g * (out > 0))};
+        });
+    }
+
+    Variable matmul(const Variable& lhs, const Variable& rhs) {
+        const Tensor &a = lhs.value(), &b = rhs.value();
+        CHECK_TRUE(a.n_dim() >= 2 && b.n_dim() >= 2,
+                   "matmul() on variables expects operands of at least 2 dims, but got %dD and %dD", a.n_dim(), b.n_dim());
+        // the transposes are views, the GEMM reads them through their strides
+        return Variable::record(Tensor(matmul(a, b)), {&lhs, &rhs}, [a, b](const Tensor& g, const Node& node) -> Grads {
+            Grads res(2);
+            if (node.needs(0))
+                res[0] = autograd::reduce_to(Tensor(matmul(g, b.transpose(b.n_dim() - 2, b.n_dim() - 1))), a.size());
+            if (node.needs(1))
+                res[1] = autograd::reduce_to(Tensor(matmul(a.transpose(a.n_dim() - 2, a.n_dim() - 1), g)), b.size());
+            return res;
+        });
+    }
+
+    Variable checkpoint(const CheckpointFn& fn, const std::vector<Variable>& inputs) {
+        Tensor out = [&] {
+            NoGradGuard guard;
+            return fn(inputs).value();
+        }();
+        std::vector<const Variable*> ptrs;
+        std::vector<Tensor> values;
+        for (const Variable& input : inputs) {
+            ptrs.push_back(&input);
+            values.push_back(input.value());
+        }
+        return Variable::record(out, ptrs, [fn, values](const Tensor& g, const Node& node) -> Grads {
+            // the recomputed graph is cut off at the inputs, their gradients are collected here
+            std::vector<Variable> cut;
+            for (index_t i = 0; i < values.size(); ++i) cut.emplace_back(values[i], node.needs(i));
+            {
+                EnableGradGuard guard;
+                Variable redo = fn(cut);
+                if (redo.requires_grad()) redo.backward(g);
+            }
+            Grads res(values.size());
+            for (index_t i = 0; i < values.size(); ++i)
+                if (node.needs(i)) res[i] = cut[i].grad();
+            return res;
+        });
+    }
+} // st
@@ -0,0 +1,63 @@
+#include "bool_tensor.h"
+
+namespace st {
+    // constructor
+    BoolTensorImpl::BoolTensorImpl(const Shape& shape) :
+        _storage(shape.d_size(), 0), _shape(shape), _stride(contiguous_stride(shape)) {}
+    BoolTensorImpl::BoolTensorImpl(const BoolStorage& storage, const Shape& shape, const StrideArray& stride) :
+        _storage(storage), _shape(shape), _stride(stride) {}
+
+    // method
+    bool_t& BoolTensorImpl::operator[](std::initializer_list<index_t> dims) {
+        CHECK_EQUAL(n_dim(), dims.size(),
+            "Invalid %zuD indices for %dD tensor", dims.size(), n_dim());
+        stride_t index = 0;
+        index_t dim = 0;
+        for (auto v : dims) {
+            CHECK_IN_RANGE(v, 0, size(dim),
+                           "Index out of range (expected to be in range of [0, %d), but got %d)",
+                           size(dim), v);
+            index += (stride_t)v*_stride[dim];
+            ++dim;
+        }
+        return _storage[index];
+    }
+
+    bool_t BoolTensorImpl::operator[](std::initializer_list<index_t> dims) const {
+        return const_cast<BoolTensorImpl&>(*this)[dims];
+    }
+
+    data_t BoolTensorImpl::eval(IndexArray idx) const {
+        stride_t index = 0;
+        if (idx.size() >= _shape.n_dim()) {
+            for (int i = idx.size() - n_dim(); i < idx.size(); ++i)
+                index += (stride_t)idx[i]*_stride[i-(idx.size()-n_dim())];
+        } else {
+            for (int i = 0; i < idx.size(); ++i)
+                index += (stride_t)idx[i]*_stride[i+(n_dim()-idx.size())];
+        }
+        return item(index);
+    }
+
+    index_t BoolTensorImpl::count() const {
+        index_t res = 0;
+        std::vector<index_t> idx(n_dim(), 0);
+        for (index_t cnt = 0; cnt < d_size(); ++cnt) {
+            stride_t offset = 0;
+            for (index_t i = 0; i < n_dim(); ++i)
+                offset += (stride_t)idx[i] * _stride[i];
+            res += item(offset) != 0;
+            for (int i = (int)n_dim()-1; i >= 0; --i) {
+                if (idx[i]+1 < _shape[i]) { ++idx[i]; break; }
+                idx[i] = 0;
+            }
+        }
+        return res;
+    }
+
+    // BoolTensor
+    BoolTensor::BoolTensor(const Shape& shape) :
+        impl_ptr(Alloc::unique_construct<BoolTensorImpl>(shape)) {}
+    BoolTensor::BoolTensor(Alloc::NonTrivalUniquePtr<BoolTensorImpl>&& ptr) :
+        impl_ptr(std::move(ptr)) {}
+} // st
@@ -0,0 +1,143 @@
+#include "nn.h"
+#include "gemm.h"
+#include "parallel.h"
+#include "exception.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace st {
+    namespace {
+        // below this many multiply-adds per output element the GEMM's packing doesn't pay off
+        constexpr index_t direct_reduction = 32;
+
+        struct Conv {
+            index_t n, c, h, w;       // input
+            index_t o, kh, kw;        // weight
+            index_t oh, ow;           // output
+            index_t sh, sw, ph, pw, dh, dw, groups;
+            index_t cg, og;           // channels per group, in and out
+        };
+
+        // out[n][o] += w[o] (*) in[n][group of o], one task per output plane
+        void conv_direct(const Conv& p, const data_t* in, const data_t* wt, data_t* out) {
+            parallel_for(0, p.n * p.o, 1, [&](index_t begin, index_t end) {
+                for (index_t task = begin; task < end; ++task) {
+                    index_t n = task / p.o, o = task % p.o, g = o / p.og;
+                    data_t* plane = out + (size_t)task * p.oh * p.ow;
+                    for (index_t c = 0; c < p.cg; ++c) {
+                        const data_t* src = in + ((size_t)n * p.c + g * p.cg + c) * p.h * p.w;
+                        for (index_t kh = 0; kh < p.kh; ++kh)
+                            for (index_t kw = 0; kw < p.kw; ++kw) {
+                                data_t v = wt[(((size_t)o * p.cg + c) * p.kh + kh) * p.kw + kw];
+                                // output columns whose input column falls inside the row
+                                stride_t off = (stride_t)(kw * p.dw) - (stride_t)p.pw;
+                                stride_t lo = off >= 0 ? 0 : (-off + (stride_t)p.sw - 1) / (stride_t)p.sw;
+                                stride_t hi = (stride_t)p.w - off <= 0 ? 0
+                                            : std::min<stride_t>(p.ow, ((stride_t)p.w - 1 - off) / (stride_t)p.sw + 1);
+                                for (index_t oh = 0; oh < p.oh; ++oh) {
+                                    stride_t ih = (stride_t)(oh * p.sh + kh * p.dh) - (stride_t)p.ph;
+                                    if (ih < 0 || ih >= (stride_t)p.h) continue;
+                                    const data_t* row = src + ih * (stride_t)p.w + off;
+                                    data_t* dst = plane + (size_t)oh * p.ow;
+                                    if (p.sw == 1) {
+                                        for (stride_t ow = lo; ow < hi; ++ow) dst[ow] += v * row[ow];
+                                    } else {
+                                        for (stride_t ow = lo; ow < hi; ++ow) dst[ow] += v * row[ow * (stride_t)p.sw];
+                                    }
+                                }
+                            }
+                    }
+                }
+            });
+        }
+
+        // unfolds the receptive fields of one group of one sample into a (cg*kh*kw) x (oh*ow) matrix
+        void im2col(const Conv& p, const data_t* in, data_t* col) {
+            index_t plane = p.oh * p.ow;
+            for (index_t c = 0; c < p.cg; ++c)
+                for (index_t kh = 0; kh < p.kh; ++kh)
+                    for (index_t kw = 0; kw < p.kw; ++kw) {
+                        data_t* dst = col + (((size_t)c * p.kh + kh) * p.kw + kw) * plane;
+                        const data_t* src = in + (size_t)c * p.h * p.w;
+                        for (index_t oh = 0; oh < p.oh; ++oh) {
+                            stride_t ih = (stride_t)(oh * p.sh + kh * p.dh) - (stride_t)p.ph;
+                            for (index_t ow = 0; ow < p.ow; ++ow) {
+                                stride_t iw = (stride_t)(ow * p.sw + kw * p.dw) - (stride_t)p.pw;
+                                bool inside = ih >= 0 && ih < (stride_t)p.h && iw >= 0 && iw < (stride_t)p.w;
+                                dst[(size_t)oh * p.ow + ow] = inside ? src[ih * (stride_t)p.w + iw] : 0;
+                            }
+                        }
+                    }
+        }
+
+        // out[n][group] = w[group] * im2col(in[n][group]), a 1x1 unit-stride convolution reads the input as is
+        void conv_gemm(const Conv& p, const data_t* in, const data_t* wt, data_t* out) {
+            index_t plane = p.oh * p.ow, red = p.cg * p.kh * p.kw;
+            bool pointwise = p.kh == 1 && p.kw == 1 && p.sh == 1 && p.sw == 1 && p.ph == 0 && p.pw == 0;
+            parallel_for(0, p.n * p.groups, 1, [&](index_t begin, index_t end) {
+                std::vector<data_t> col(pointwise ? 0 : (size_t)red * plane);
+                for (index_t task = begin; task < end; ++task) {
+                    index_t n = task / p.groups, g = task % p.groups;
+                    const data_t* src = in + ((size_t)n * p.c + g * p.cg) * p.h * p.w;
+                    if (!pointwise) {
+                        im2col(p, src, col.data());
+                        src = col.data();
+                    }
+                    gemm(p.og, plane, red, 1, wt + (size_t)g * p.og * red, red, 1, src, plane, 1,
+                         1, out + ((size_t)n * p.o + g * p.og) * plane, plane, 1);
+                }
+            });
+        }
+
+        Tensor convolve(const Tensor& input, const Tensor& weight, const std::optional<Tensor>& bias,
+                        Conv p, const char* name) {
+            CHECK_TRUE(p.groups > 0 && p.c % p.groups == 0 && p.o % p.groups == 0,
+                       "%s() expects groups to divide %d input and %d output channels, but got %d",
+                       name, p.c, p.o, p.groups);
+            p.cg = p.c / p.groups;
+            p.og = p.o / p.groups;
+            CHECK_EQUAL(weight.size(1), p.cg, "%s() expects the weight to have %d input channels, but got %d",
+                        name, p.cg, weight.size(1));
+            CHECK_TRUE(p.sh > 0 && p.sw > 0 && p.dh > 0 && p.dw > 0, "%s() expects a positive stride and dilation", name);
+            stride_t eh = (stride_t)(p.h + 2 * p.ph) - (stride_t)(p.dh * (p.kh - 1) + 1);
+            stride_t ew = (stride_t)(p.w + 2 * p.pw) - (stride_t)(p.dw * (p.kw - 1) + 1);
+            CHECK_TRUE(eh >= 0 && ew >= 0, "%s(): the kernel is larger than the padded input", name);
+            p.oh = eh / (stride_t)p.sh + 1;
+            p.ow = ew / (stride_t)p.sw + 1;
+
+            Tensor in = input.contiguous(), wt = weight.contiguous();
+            Tensor out(input.n_dim() == 3 ? Shape({p.n, p.o, p.ow}) : Shape({p.n, p.o, p.oh, p.ow}));
+            index_t plane = p.oh * p.ow;
+            if (bias) {
+                CHECK_TRUE(bias->n_dim() == 1 && bias->size(0) == p.o, "%s() expects a bias of size %d", name, p.o);
+                data_t* dst = out.data();
+                for (index_t i = 0; i < p.n * p.o; ++i)
+                    std::fill_n(dst + (size_t)i * plane, plane, (*bias)[{i % p.o}]);
+            }
+            if (p.cg * p.kh * p.kw < direct_reduction)
+                conv_direct(p, in.data(), wt.data(), out.data());
+            else
+                conv_gemm(p, in.data(), wt.data(), out.data());
+            return out;
+        }
+    }
+
+    Tensor conv1d(const Tensor& input, const Tensor& weight, const std::optional<Tensor>& bias, const ConvOptions& options) {
+        CHECK_TRUE(input.n_dim() == 3 && weight.n_dim() == 3,
+                   "conv1d() expects a 3D input and weight, but got %dD and %dD", input.n_dim(), weight.n_dim());
+        // a convolution over rows of height 1
+        Conv p{input.size(0), input.size(1), 1, input.size(2), weight.size(0), 1, weight.size(2), 0, 0,
+               1, options.stride, 0, options.padding, 1, options.dilation, options.groups, 0, 0};
+        return convolve(input, weight, bias, p, "conv1d");
+    }
+
+    Tensor conv2d(const Tensor& input, const Tensor& weight, const std::optional<Tensor>& bias, const ConvOptions& options) {
+        CHECK_TRUE(input.n_dim() == 4 && weight.n_dim() == 4,
+                   "conv2d() expects a 4D input and weight, but got %dD and %dD", input.n_dim(), weight.n_dim());
+        Conv p{input.size(0), input.size(1), input.size(2), input.size(3), weight.size(0), weight.size(2), weight.size(3),
+               0, 0, options.stride, options.stride, options.padding, options.padding,
+               options.dilation, options.dilation, options.groups, 0, 0};
+        return convolve(input, weight, bias, p, "conv2d");
+    }
+} // st
@@ -0,0 +1,269 @@
+#include "linalg.h"
+#include "gemm.h"
+#include "parallel.h"
+#include "exception.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+
+namespace st {
+    namespace {
+        // an operand as a set of labelled, strided dims. `holder` keeps the data alive
+        struct Operand {
+            Tensor holder;
+            const data_t* data;
+            std::string labels;
+            std::vector<index_t> sizes;
+            std::vector<stride_t> strides;
+            bool owned = false; // a dense buffer made here rather than a caller's tensor
+
+            [[nodiscard]] index_t find(char label) const { return labels.find(label); }
+            [[nodiscard]] bool has(char label) const { return labels.find(label) != std::string::npos; }
+        };
+
+        bool is_label(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+
+        Shape shape_of(const std::vector<index_t>& sizes) {
+            if (sizes.empty()) return Shape({1});
+            IndexArray dims(sizes.size());
+            for (index_t i = 0; i < sizes.size(); ++i) dims[i] = sizes[i];
+            return Shape(std::move(dims));
+        }
+
+        // a fresh row-major operand
+        Operand dense(const std::string& labels, const std::vector<index_t>& sizes) {
+            Tensor tensor(shape_of(sizes));
+            Operand op{tensor, tensor.data(), labels, sizes, std::vector<stride_t>(sizes.size()), true};
+            stride_t s = 1;
+            for (index_t i = sizes.size(); i-- > 0; s *= sizes[i])
+                op.strides[i] = s;
+            return op;
+        }
+
+        // a repeated label walks the diagonal, which is one dim whose stride is the sum of both
+        Operand make_operand(const Tensor& tensor, const std::string& term, index_t idx) {
+            CHECK_EQUAL(term.size(), tensor.n_dim(),
+                        "einsum(): operand %d has %d dims but its subscripts name %d", idx, tensor.n_dim(), (index_t)term.size());
+            Operand op{tensor, tensor.data(), "", {}, {}, false};
+            for (index_t i = 0; i < term.size(); ++i) {
+                if (!op.has(term[i])) {
+                    op.labels.push_back(term[i]);
+                    op.sizes.push_back(tensor.size(i));
+                    op.strides.push_back(tensor.stride()[i]);
+                } else {
+                    index_t at = op.find(term[i]);
+                    CHECK_EQUAL(op.sizes[at], tensor.size(i),
+                                "einsum(): subscript %c repeated in operand %d with sizes %d and %d",
+                                term[i], idx, op.sizes[at], tensor.size(i));
+                    op.strides[at] += tensor.stride()[i];
+                }
+            }
+            return op;
+        }
+
+        // writes op into a dense tensor with dims in `labels` order, summing over the labels left out
+        Operand reduce_to(const Operand& op, const std::string& labels) {
+            std::vector<index_t> sizes, red_sizes;
+            std::vector<stride_t> keep_strides, red_strides;
+            for (char c : labels) {
+                sizes.push_back(op.sizes[op.find(c)]);
+                keep_strides.push_back(op.strides[op.find(c)]);
+            }
+            for (index_t i = 0; i < op.labels.size(); ++i)
+                if (labels.find(op.labels[i]) == std::string::npos) {
+                    red_sizes.push_back(op.sizes[i]);
+                    red_strides.push_back(op.strides[i]);
+                }
+            Operand res = dense(labels, sizes);
+            data_t* dst = res.holder.data();
+            index_t total = res.holder.d_size();
+            index_t red_total = 1;
+            for (index_t s : red_sizes) red_total *= s;
+
+            parallel_for(0, total, std::max<index_t>(1, (1 << 14) / std::max<index_t>(red_total, 1)),
+                         [&](index_t begin, index_t end) {
+                std::vector<index_t> idx(red_sizes.size());
+                for (index_t flat = begin; flat < end; ++flat) {
+                    stride_t base = 0;
+                    for (index_t i = sizes.size(), rest = flat; i-- > 0; rest /= sizes[i])
+                        base += (stride_t)(rest % sizes[i]) * keep_strides[i];
+                    data_t sum = 0;
+                    std::fill(idx.begin(), idx.end(), 0);
+                    stride_t offset = 0;
+                    for (index_t r = 0; r < red_total; ++r) {
+                        sum += op.data[base + offset];
+                        for (index_t i = red_sizes.size(); i-- > 0;) {
+                            offset += red_strides[i];
+                            if (++idx[i] < red_sizes[i]) break;
+                            offset -= (stride_t)red_sizes[i] * red_strides[i];
+                            idx[i] = 0;
+                        }
+                    }
+                    dst[flat] = sum;
+                }
+            });
+            return res;
+        }
+
+        // the labels of `group` as one dim, if op's strides allow it. size-1 dims never get in the way
+        bool merge(const Operand& op, const std::string& group, index_t& size, stride_t& stride) {
+            size = 1;
+            stride = 0;
+            for (index_t i = group.size(); i-- > 0;) {
+                index_t at = op.find(group[i]);
+                if (op.sizes[at] == 1) continue;
+                if (size == 1) stride = op.strides[at];
+                else if (op.strides[at] != stride * (stride_t)size) return false;
+                size *= op.sizes[at];
+            }
+            return true;
+        }
+
+        // labels of op from the set `group`, outermost (largest stride) first
+        std::string order_by_stride(const Operand& op, std::string group) {
+            std::stable_sort(group.begin(), group.end(), [&](char a, char b) {
+                return std::abs(op.strides[op.find(a)]) > std::abs(op.strides[op.find(b)]);
+            });
+            return group;
+        }
+
+        // C[batch, m, n] = sum_k A[batch, m, k] * B[batch, k, n], keeping only the labels in `keep`
+        Operand contract(Operand a, Operand b, const std::string& keep) {
+            std::string batch, m, n, k;
+            for (char c : a.labels) {
+                bool in_b = b.has(c), kept = keep.find(c) != std::string::npos;
+                if (in_b && kept) batch.push_back(c);
+                else if (in_b) k.push_back(c);
+                else m.push_back(c);
+            }
+            for (char c : b.labels)
+                if (!a.has(c)) n.push_back(c);
+            m = order_by_stride(a, m);
+            k = order_by_stride(a, k);
+            n = order_by_stride(b, n);
+
+            index_t M, N, K, K2;
+            stride_t a_rs, a_cs, b_rs, b_cs;
+            if (!merge(a, m, M, a_rs) || !merge(a, k, K, a_cs)) {
+                a = reduce_to(a, batch + m + k);
+                merge(a, m, M, a_rs);
+                merge(a, k, K, a_cs);
+            }
+            if (!merge(b, k, K2, b_rs) || !merge(b, n, N, b_cs)) {
+                b = reduce_to(b, batch + k + n);
+                merge(b, k, K2, b_rs);
+                merge(b, n, N, b_cs);
+            }
+
+            BatchLayout layout;
+            for (char c : batch) {
+                layout.size.push_back(a.sizes[a.find(c)]);
+                layout.a.push_back(a.strides[a.find(c)]);
+                layout.b.push_back(b.strides[b.find(c)]);
+            }
+            std::vector<index_t> sizes = layout.size;
+            for (char c : m) sizes.push_back(a.sizes[a.find(c)]);
+            for (char c : n) sizes.push_back(b.sizes[b.find(c)]);
+            Operand c_op = dense(batch + m + n, sizes);
+            for (index_t i = 0; i < batch.size(); ++i)
+                layout.c.push_back(c_op.strides[i]);
+            gemm_batched(layout, M, N, K, 1, a.data, a_rs, a_cs, b.data, b_rs, b_cs,
+                         0, c_op.holder.data(), (stride_t)N, 1);
+            return c_op;
+        }
+    }
+
+    Tensor einsum(const std::string& equation, const std::vector<Tensor>& operands) {
+        std::string eq;
+        std::vector<index_t> pos; // where each character of eq is in the equation, for errors
+        for (index_t i = 0; i < equation.size(); ++i)
+            if (equation[i] != ' ') {
+                eq.push_back(equation[i]);
+                pos.push_back(i);
+            }
+        size_t arrow = eq.find("->");
+        size_t lhs_end = std::min(arrow, eq.size());
+        std::vector<std::string> terms(1);
+        for (index_t i = 0; i < lhs_end; ++i) {
+            char c = eq[i];
+            if (c == ',') terms.emplace_back();
+            else {
+                CHECK_TRUE(is_label(c), "einsum(): invalid subscript '%c' at position %d of the equation", c, pos[i]);
+                terms.back().push_back(c);
+            }
+        }
+        CHECK_EQUAL(terms.size(), operands.size(),
+                    "einsum(): the equation names %d operands but %d were given", (index_t)terms.size(), (index_t)operands.size());
+
+        std::map<char, index_t> count, size;
+        std::vector<Operand> ops;
+        for (index_t i = 0; i < operands.size(); ++i) {
+            ops.push_back(make_operand(operands[i], terms[i], i));
+            for (index_t d = 0; d < ops[i].labels.size(); ++d) {
+                char c = ops[i].labels[d];
+                auto iter = size.find(c);
+                CHECK_TRUE(iter == size.end() || iter->second == ops[i].sizes[d],
+                           "einsum(): subscript %c has size %d in operand %d but %d before",
+                           c, ops[i].sizes[d], i, iter == size.end() ? 0 : iter->second);
+                size[c] = ops[i].sizes[d];
+            }
+            for (char c : terms[i]) ++count[c];
+        }
+
+        std::string out;
+        if (arrow == std::string::npos) {
+            for (auto& [c, n] : count)
+                if (n == 1) out.push_back(c);
+        } else {
+            out = eq.substr(arrow + 2);
+            for (index_t i = 0; i < out.size(); ++i) {
+                CHECK_TRUE(is_label(out[i]), "einsum(): invalid subscript '%c' at position %d of the equation",
+                           out[i], pos[arrow + 2 + i]);
+                CHECK_TRUE(count.count(out[i]), "einsum(): output subscript %c doesn't appear in any input", out[i]);
+                CHECK_TRUE(out.find(out[i]) == i, "einsum(): output subscript %c appears more than once", out[i]);
+            }
+        }
+
+        // labels needed by anything other than the operands in `skip`
+        auto needed = [&](index_t skip0, index_t skip1) {
+            std::string keep = out;
+            for (index_t i = 0; i < ops.size(); ++i)
+                if (i != skip0 && i != skip1) keep += ops[i].labels;
+            return keep;
+        };
+        // a label only one operand has and nobody needs is summed out up front
+        for (index_t i = 0; i < ops.size(); ++i) {
+            std::string keep = needed(i, i), own;
+            for (char c : ops[i].labels)
+                if (keep.find(c) != std::string::npos) own.push_back(c);
+            if (own.size() < ops[i].labels.size())
+                ops[i] = reduce_to(ops[i], order_by_stride(ops[i], own));
+        }
+
+        // greedy path: contract the pair whose product touches the fewest index combinations
+        while (ops.size() > 1) {
+            index_t best_i = 0, best_j = 1;
+            uint64_t best = UINT64_MAX;
+            for (index_t i = 0; i < ops.size(); ++i)
+                for (index_t j = i + 1; j < ops.size(); ++j) {
+                    uint64_t flops = 1;
+                    std::string all = ops[i].labels;
+                    for (char c : ops[j].labels)
+                        if (!ops[i].has(c)) all.push_back(c);
+                    for (char c : all) flops *= size[c];
+                    if (flops < best) {
+                        best = flops;
+                        best_i = i;
+                        best_j = j;
+                    }
+                }
+            Operand res = contract(ops[best_i], ops[best_j], needed(best_i, best_j));
+            ops.erase(ops.begin() + best_j);
+            ops[best_i] = std::move(res);
+        }
+
+        if (ops[0].owned && ops[0].labels == out) return ops[0].holder;
+        return reduce_to(ops[0], out).holder;
+    }
+} // st
@@ -0,0 +1,30 @@
+#include "fusion.h"
+
+namespace st {
+    namespace fusion {
+        index_t coalesce(index_t* size, index_t n_dim, const std::vector<stride_t*>& strides) {
+            index_t m = 0;
+            for (index_t i = 0; i < n_dim; ++i) {
+                if (size[i] == 1) continue;
+                // dim i folds into the previous kept dim when every operand steps over it contiguously
+                bool merge = m > 0;
+                for (auto s : strides)
+                    merge = merge && s[m-1] == s[i] * (stride_t)size[i];
+                if (merge) {
+                    size[m-1] *= size[i];
+                    for (auto s : strides) s[m-1] = s[i];
+                    continue;
+                }
+                size[m] = size[i];
+                for (auto s : strides) s[m] = s[i];
+                ++m;
+            }
+            if (m == 0) {
+                size[0] = 1;
+                for (auto s : strides) s[0] = 0;
+                m = 1;
+            }
+            return m;
+        }
+    } // fusion
+} // st
@@ -0,0 +1,247 @@
+#include "gemm.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace st {
+    namespace {
+        constexpr index_t MR = 4, NR = 8;                 // register block of the micro-kernel
+        constexpr index_t MC = 96, KC = 256, NC = 2048;   // A block stays in L2, B panel in L3
+        constexpr index_t small_gemm = 32 * 32 * 32;      // below this many multiply-adds packing doesn't pay
+
+        constexpr index_t batch_work = 1 << 16;         // multiply-adds a batched task should get at least
+        constexpr index_t gemv_work = 1 << 15;          // elements of A a gemv task should get at least
+
+        using SmallKernel = void (*)(data_t, const data_t*, stride_t, stride_t, const data_t*, stride_t, stride_t,
+                                     data_t, data_t*, stride_t, stride_t);
+
+        // S x S times S x S with every loop bound known at compile time, so the compiler unrolls
+        // it fully and keeps the accumulator out of memory. no packing and no blocking.
+        template<index_t S>
+        void small_kernel(data_t alpha, const data_t* a, stride_t a_rs, stride_t a_cs,
+                          const data_t* b, stride_t b_rs, stride_t b_cs,
+                          data_t beta, data_t* c, stride_t c_rs, stride_t c_cs) {
+            data_t acc[S][S] = {};
+            for (index_t p = 0; p < S; ++p)
+                for (index_t i = 0; i < S; ++i) {
+                    data_t a_ip = a[(stride_t)i * a_rs + (stride_t)p * a_cs];
+                    for (index_t j = 0; j < S; ++j)
+                        acc[i][j] += a_ip * b[(stride_t)p * b_rs + (stride_t)j * b_cs];
+                }
+            for (index_t i = 0; i < S; ++i)
+                for (index_t j = 0; j < S; ++j) {
+                    data_t& v = c[(stride_t)i * c_rs + (stride_t)j * c_cs];
+                    v = beta == 0 ? alpha * acc[i][j] : alpha * acc[i][j] + beta * v;
+                }
+        }
+
+        SmallKernel small_kernel_for(index_t m, index_t n, index_t k) {
+            if (m != n || n != k) return nullptr;
+            switch (m) {
+                case 2: return small_kernel<2>;
+                case 3: return small_kernel<3>;
+                case 4: return small_kernel<4>;
+                case 8: return small_kernel<8>;
+                case 16: return small_kernel<16>;
+                default: return nullptr;
+            }
+        }
+
+        // copies an mc x kc block of A into MR-row panels, the last panel is zero padded
+        void pack_a(index_t mc, index_t kc, const data_t* a, stride_t rs, stride_t cs, data_t* buf) {
+            for (index_t i = 0; i < mc; i += MR) {
+                index_t mr = std::min(MR, mc - i);
+                for (index_t p = 0; p < kc; ++p) {
+                    for (index_t r = 0; r < mr; ++r)
+                        buf[r] = a[(stride_t)(i + r) * rs + (stride_t)p * cs];
+                    for (index_t r = mr; r < MR; ++r)
+                        buf[r] = 0;
+                    buf += MR;
+                }
+            }
+        }
+
+        // copies a kc x nc panel of B into NR-column slivers, the last sliver is zero padded
+        void pack_b(index_t kc, index_t nc, const data_t* b, stride_t rs, stride_t cs, data_t* buf) {
+            for (index_t j = 0; j < nc; j += NR) {
+                index_t nr = std::min(NR, nc - j);
+                for (index_t p = 0; p < kc; ++p) {
+                    for (index_t c = 0; c < nr; ++c)
+                        buf[c] = b[(stride_t)p * rs + (stride_t)(j + c) * cs];
+                    for (index_t c = nr; c < NR; ++c)
+                        buf[c] = 0;
+                    buf += NR;
+                }
+            }
+        }
+
+        // C[mr x nr] += alpha * (A panel * B sliver), the MR x NR accumulator lives in registers
+        void micro_kernel(index_t kc, const data_t* a, const data_t* b, data_t alpha,
+                          data_t* c, stride_t rs, stride_t cs, index_t mr, index_t nr) {
+            data_t acc[MR][NR] = {};
+            for (index_t p = 0; p < kc; ++p) {
+                for (index_t r = 0; r < MR; ++r)
+                    for (index_t j = 0; j < NR; ++j)
+                        acc[r][j] += a[r] * b[j];
+                a += MR;
+                b += NR;
+            }
+            for (index_t r = 0; r < mr; ++r)
+                for (index_t j = 0; j < nr; ++j)
+                    c[(stride_t)r * rs + (stride_t)j * cs] += alpha * acc[r][j];
+        }
+    }
+
+    data_t dot(index_t n, const data_t* x, stride_t x_s, const data_t* y, stride_t y_s) {
+        // independent partial sums let the compiler vectorise without reassociating
+        data_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        index_t i = 0;
+        if (x_s == 1 && y_s == 1) {
+            for (; i + 4 <= n; i += 4) {
+                s0 += x[i] * y[i];
+                s1 += x[i + 1] * y[i + 1];
+                s2 += x[i + 2] * y[i + 2];
+                s3 += x[i + 3] * y[i + 3];
+            }
+        }
+        for (; i < n; ++i)
+            s0 += x[(stride_t)i * x_s] * y[(stride_t)i * y_s];
+        return (s0 + s1) + (s2 + s3);
+    }
+
+    void axpy(index_t n, data_t alpha, const data_t* x, stride_t x_s, data_t* y, stride_t y_s) {
+        if (x_s == 1 && y_s == 1) {
+            for (index_t i = 0; i < n; ++i)
+                y[i] += alpha * x[i];
+            return;
+        }
+        for (index_t i = 0; i < n; ++i)
+            y[(stride_t)i * y_s] += alpha * x[(stride_t)i * x_s];
+    }
+
+    void gemv(index_t m, index_t n, data_t alpha, const data_t* a, stride_t a_rs, stride_t a_cs,
+              const data_t* x, stride_t x_s, data_t beta, data_t* y, stride_t y_s) {
+        index_t grain = std::max<index_t>(1, gemv_work / std::max<index_t>(n, 1));
+        parallel_for(0, m, grain, [&](index_t begin, index_t end) {
+            if (a_rs == 1 && a_cs != 1) {
+                // columns are contiguous: sweep them into this chunk's slice of y
+                for (index_t i = begin; i < end; ++i) {
+                    data_t& v = y[(stride_t)i * y_s];
+                    v = beta == 0 ? 0 : beta * v;
+                }
+                for (index_t j = 0; j < n; ++j)
+                    axpy(end - begin, alpha * x[(stride_t)j * x_s], a + begin + (stride_t)j * a_cs, 1,
+                         y + (stride_t)begin * y_s, y_s);
+                return;
+            }
+            for (index_t i = begin; i < end; ++i) {
+                data_t t = alpha * dot(n, a + (stride_t)i * a_rs, a_cs, x, x_s);
+                data_t& v = y[(stride_t)i * y_s];
+                v = beta == 0 ? t : t + beta * v;
+            }
+        });
+    }
+
+    void gemm(index_t m, index_t n, index_t k, data_t alpha,
+              const data_t* a, stride_t a_rs, stride_t a_cs,
+              const data_t* b, stride_t b_rs, stride_t b_cs,
+              data_t beta, data_t* c, stride_t c_rs, stride_t c_cs) {
+        if (m == 0 || n == 0) return;
+        if (SmallKernel kernel = small_kernel_for(m, n, k)) {
+            kernel(alpha, a, a_rs, a_cs, b, b_rs, b_cs, beta, c, c_rs, c_cs);
+            return;
+        }
+        // a single column or row of C is a matrix-vector product, C^T = B^T A^T for the row
+        if (n == 1) {
+            gemv(m, k, alpha, a, a_rs, a_cs, b, b_rs, beta, c, c_rs);
+            return;
+        }
+        if (m == 1) {
+            gemv(n, k, alpha, b, b_cs, b_rs, a, a_cs, beta, c, c_cs);
+            return;
+        }
+        // scale C up front, the loops below only accumulate into it
+        for (index_t i = 0; i < m; ++i)
+            for (index_t j = 0; j < n; ++j) {
+                data_t& v = c[(stride_t)i * c_rs + (stride_t)j * c_cs];
+                v = beta == 0 ? 0 : beta * v;
+            }
+        if (k == 0 || alpha == 0) return;
+
+        if ((size_t)m * n * k <= small_gemm) {
+            for (index_t i = 0; i < m; ++i)
+                for (index_t p = 0; p < k; ++p) {
+                    data_t a_ip = alpha * a[(stride_t)i * a_rs + (stride_t)p * a_cs];
+                    for (index_t j = 0; j < n; ++j)
+                        c[(stride_t)i * c_rs + (stride_t)j * c_cs] += a_ip * b[(stride_t)p * b_rs + (stride_t)j * b_cs];
+                }
+            return;
+        }
+
+        std::vector<data_t> b_buf((size_t)KC * ((std::min(NC, n) + NR - 1) / NR * NR));
+        index_t blocks = (m + MC - 1) / MC;
+        for (index_t jc = 0; jc < n; jc += NC) {
+            index_t nc = std::min(NC, n - jc);
+            for (index_t pc = 0; pc < k; pc += KC) {
+                index_t kc = std::min(KC, k - pc);
+                pack_b(kc, nc, b + (stride_t)pc * b_rs + (stride_t)jc * b_cs, b_rs, b_cs, b_buf.data());
+                // each M block packs its own slice of A, the B panel is shared read-only
+                parallel_for(0, blocks, 1, [&](index_t begin, index_t end) {
+                    std::vector<data_t> a_buf((size_t)kc * ((MC + MR - 1) / MR * MR));
+                    for (index_t blk = begin; blk < end; ++blk) {
+                        index_t ic = blk * MC;
+                        index_t mc = std::min(MC, m - ic);
+                        pack_a(mc, kc, a + (stride_t)ic * a_rs + (stride_t)pc * a_cs, a_rs, a_cs, a_buf.data());
+                        for (index_t jr = 0; jr < nc; jr += NR)
+                            for (index_t ir = 0; ir < mc; ir += MR)
+                                micro_kernel(kc, a_buf.data() + (size_t)ir * kc, b_buf.data() + (size_t)jr * kc, alpha,
+                                             c + (stride_t)(ic + ir) * c_rs + (stride_t)(jc + jr) * c_cs, c_rs, c_cs,
+                                             std::min(MR, mc - ir), std::min(NR, nc - jr));
+                    }
+                });
+            }
+        }
+    }
+
+    void gemm_batched(const BatchLayout& batch, index_t m, index_t n, index_t k, data_t alpha,
+                      const data_t* a, stride_t a_rs, stride_t a_cs,
+                      const data_t* b, stride_t b_rs, stride_t b_cs,
+                      data_t beta, data_t* c, stride_t c_rs, stride_t c_cs) {
+        index_t n_dim = batch.size.size();
+        index_t n_batch = 1;
+        for (index_t s : batch.size) n_batch *= s;
+        if (n_batch == 0) return;
+        // the kernel is picked once for the whole batch rather than once per product
+        SmallKernel kernel = small_kernel_for(m, n, k);
+        size_t work = std::max<size_t>((size_t)m * n * k, 1);
+        index_t grain = (index_t)std::max<size_t>(1, batch_work / work);
+        parallel_for(0, n_batch, grain, [&](index_t begin, index_t end) {
+            // offsets of the first batch index in the chunk, then stepped like an odometer
+            std::vector<index_t> idx(n_dim);
+            stride_t a_off = 0, b_off = 0, c_off = 0;
+            for (index_t i = n_dim, rest = begin; i-- > 0; rest /= batch.size[i]) {
+                idx[i] = rest % batch.size[i];
+                a_off += (stride_t)idx[i] * batch.a[i];
+                b_off += (stride_t)idx[i] * batch.b[i];
+                c_off += (stride_t)idx[i] * batch.c[i];
+            }
+            for (index_t bi = begin; bi < end; ++bi) {
+                if (kernel)
+                    kernel(alpha, a + a_off, a_rs, a_cs, b + b_off, b_rs, b_cs, beta, c + c_off, c_rs, c_cs);
+                else
+                    gemm(m, n, k, alpha, a + a_off, a_rs, a_cs, b + b_off, b_rs, b_cs, beta, c + c_off, c_rs, c_cs);
+                for (index_t i = n_dim; i-- > 0;) {
+                    a_off += batch.a[i];
+                    b_off += batch.b[i];
+                    c_off += batch.c[i];
+                    if (++idx[i] < batch.size[i]) break;
+                    a_off -= (stride_t)batch.size[i] * batch.a[i];
+                    b_off -= (stride_t)batch.size[i] * batch.b[i];
+                    c_off -= (stride_t)batch.size[i] * batch.c[i];
+                    idx[i] = 0;
+                }
+            }
+        });
+    }
+} // st
@@ -0,0 +1,530 @@
+#include "graph.h"
+#include "parallel.h"
+#include "exception.h"
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+
+namespace st {
+    namespace {
+        using OpKind = Graph::OpKind;
+
+        constexpr index_t block = 256; // elements each kernel step handles at a time
+
+        bool is_unary(OpKind kind) {
+            return kind >= OpKind::Neg && kind <= OpKind::Relu;
+        }
+        bool is_binary(OpKind kind) {
+            return kind >= OpKind::Add && kind <= OpKind::MatMul;
+        }
+        bool is_commutative(OpKind kind) {
+            return kind == OpKind::Add || kind == OpKind::Mul || kind == OpKind::Maximum || kind == OpKind::Minimum;
+        }
+        // rough per-element cost in units of one add
+        index_t op_cost(OpKind kind) {
+            switch (kind) {
+                case OpKind::Sin: case OpKind::Cos: case OpKind::Tan: return 8;
+                case OpKind::Div: return 4;
+                default: return 1;
+            }
+        }
+
+        data_t fold(OpKind kind, data_t a, data_t b = 0) {
+            switch (kind) {
+                case OpKind::Neg: return op::Neg::apply(a);
+                case OpKind::Sin: return op::Sin::apply(a);
+                case OpKind::Cos: return op::Cos::apply(a);
+                case OpKind::Tan: return op::Tan::apply(a);
+                case OpKind::Abs: return op::Abs::apply(a);
+                case OpKind::Relu: return op::Relu::apply(a);
+                case OpKind::Add: return op::Add::apply(a, b);
+                case OpKind::Sub: return op::Sub::apply(a, b);
+                case OpKind::Mul: return op::Mul::apply(a, b);
+                case OpKind::Div: return op::Div::apply(a, b);
+                case OpKind::Maximum: return op::Maximum::apply(a, b);
+                case OpKind::Minimum: return op::Minimum::apply(a, b);
+                default: return a;
+            }
+        }
+
+        // multiply-adds of a 2-d (m x k) by (k x n) product
+        uint64_t matmul_flops(const Shape& lhs, const Shape& rhs) {
+            return (uint64_t)lhs[0] * lhs[1] * rhs[1];
+        }
+
+        struct ShapeOf { // lets the op structs compute a result shape from shapes alone
+            const Shape& shape;
+            [[nodiscard]] const Shape& size() const { return shape; }
+            [[nodiscard]] index_t size(index_t idx) const { return shape[idx]; }
+            [[nodiscard]] index_t n_dim() const { return shape.n_dim(); }
+        };
+
+        // one step of a fused kernel, writes a block of values into scratch slot `slot`
+        struct Step {
+            OpKind kind; // Input loads a materialised node, Scalar fills a constant
+            index_t id;
+            index_t slot;
+            index_t a;
+            index_t b;
+        };
+
+        struct Kernel {
+            index_t id;
+            std::vector<Step> steps;
+            std::vector<index_t> deps; // materialised nodes read by this kernel
+            index_t n_slots = 0;
+            index_t level = 0;
+        };
+
+        struct Leaf {
+            const data_t* base;
+            std::vector<stride_t> stride;
+            bool contiguous;
+        };
+
+        // copies len elements of a broadcast, possibly strided leaf starting at flat output index start
+        void gather(const Leaf& leaf, const Shape& shape, index_t start, index_t len,
+                    std::vector<index_t>& idx, data_t* out) {
+            if (leaf.contiguous) {
+                std::copy(leaf.base + start, leaf.base + start + len, out);
+                return;
+            }
+            int n = shape.n_dim();
+            stride_t offset = 0;
+            index_t rest = start;
+            for (int i = n - 1; i >= 0; --i) {
+                idx[i] = rest % shape[i];
+                rest /= shape[i];
+                offset += (stride_t)idx[i] * leaf.stride[i];
+            }
+            for (index_t k = 0; k < len; ++k) {
+                out[k] = leaf.base[offset];
+                int i = n - 1;
+                ++idx[i];
+                offset += leaf.stride[i];
+                while (i > 0 && idx[i] == shape[i]) {
+                    offset -= (stride_t)shape[i] * leaf.stride[i];
+                    idx[i] = 0;
+                    --i;
+                    ++idx[i];
+                    offset += leaf.stride[i];
+                }
+            }
+        }
+
+        template<typename Op>
+        void apply_unary(const data_t* a, data_t* out, index_t len) {
+            for (index_t k = 0; k < len; ++k)
+                out[k] = Op::apply(a[k]);
+        }
+        template<typename Op>
+        void apply_binary(const data_t* a, const data_t* b, data_t* out, index_t len) {
+            for (index_t k = 0; k < len; ++k)
+                out[k] = Op::apply(a[k], b[k]);
+        }
+
+        // dst is the kernel's planned place in the arena, if it has one
+        void run_kernel(const Kernel& kernel, const std::vector<Graph::Node>& nodes,
+                        std::vector<std::optional<Tensor>>& values, const std::optional<Tensor>& dst) {
+            const Graph::Node& node = nodes[kernel.id];
+            if (node.kind == OpKind::MatMul) {
+                if (!dst) {
+                    values[kernel.id].emplace(st::matmul(*values[node.lhs], *values[node.rhs]));
+                    return;
+                }
+                Tensor out = *dst;
+                st::matmul(*values[node.lhs], *values[node.rhs], out);
+                values[kernel.id].emplace(std::move(out));
+                return;
+            }
+            if (node.kind == OpKind::Transpose) {
+                values[kernel.id].emplace(values[node.lhs]->transpose(node.dim0, node.dim1));
+                return;
+            }
+            const Shape& shape = node.shape;
+            Tensor out = dst ? *dst : Tensor(shape);
+            StrideArray dense = contiguous_stride(shape);
+            std::vector<Leaf> leaves(kernel.steps.size());
+            for (index_t s = 0; s < kernel.steps.size(); ++s) {
+                if (kernel.steps[s].kind != OpKind::Input) continue;
+                const Tensor& value = *values[kernel.steps[s].id];
+                StrideArray stride = expand_stride(value.size(), value.stride(), shape);
+                Leaf& leaf = leaves[s];
+                leaf.base = value.data();
+                leaf.contiguous = true;
+                for (index_t i = 0; i < shape.n_dim(); ++i) {
+                    leaf.stride.push_back(stride[i]);
+                    leaf.contiguous = leaf.contiguous && (shape[i] == 1 || stride[i] == dense[i]);
+                }
+            }
+
+            data_t* res = out.data();
+            index_t root = kernel.steps.back().slot;
+            parallel_for(0, shape.d_size(), 1 << 14, [&](index_t begin, index_t end) {
+                std::vector<data_t> scratch(kernel.n_slots * block);
+                std::vector<index_t> idx(shape.n_dim());
+                for (index_t start = begin; start < end; start += block) {
+                    index_t len = std::min(block, end - start);
+                    for (index_t s = 0; s < kernel.steps.size(); ++s) {
+                        const Step& step = kernel.steps[s];
+                        data_t* o = scratch.data() + step.slot * block;
+                        const data_t* a = scratch.data() + step.a * block;
+                        const data_t* b = scratch.data() + step.b * block;
+                        switch (step.kind) {
+                            case OpKind::Input: gather(leaves[s], shape, start, len, idx, o); break;
+                            case OpKind::Scalar: std::fill_n(o, len, nodes[step.id].value); break;
+                            case OpKind::Neg: apply_unary<op::Neg>(a, o, len); break;
+                            case OpKind::Sin: apply_unary<op::Sin>(a, o, len); break;
+                            case OpKind::Cos: apply_unary<op::Cos>(a, o, len); break;
+                            case OpKind::Tan: apply_unary<op::Tan>(a, o, len); break;
+                            case OpKind::Abs: apply_unary<op::Abs>(a, o, len); break;
+                            case OpKind::Relu: apply_unary<op::Relu>(a, o, len); break;
+                            case OpKind::Add: apply_binary<op::Add>(a, b, o, len); break;
+                            case OpKind::Sub: apply_binary<op::Sub>(a, b, o, len); break;
+                            case OpKind::Mul: apply_binary<op::Mul>(a, b, o, len); break;
+                            case OpKind::Div: apply_binary<op::Div>(a, b, o, len); break;
+                            case OpKind::Maximum: apply_binary<op::Maximum>(a, b, o, len); break;
+                            case OpKind::Minimum: apply_binary<op::Minimum>(a, b, o, len); break;
+                            case OpKind::MatMul: case OpKind::Transpose: break;
+                        }
+                    }
+                    std::copy_n(scratch.data() + root * block, len, res + start);
+                }
+            });
+            values[kernel.id].emplace(std::move(out));
+        }
+    }
+
+    // LazyTensor
+    const Shape& LazyTensor::size() const { return graph->node(id).shape; }
+    Tensor LazyTensor::eval() const { return graph->eval(*this); }
+
+    // Graph
+    size_t Graph::KeyHash::operator()(const Key& key) const {
+        size_t h = std::hash<uint64_t>()(key.bits);
+        h = h * 31 + (size_t)key.kind;
+        h = h * 1000003 + key.lhs;
+        h = h * 1000003 + key.rhs;
+        return h;
+    }
+
+    index_t Graph::record(const Key& key, Node&& node) {
+        auto iter = cache.find(key);
+        if (iter != cache.end()) return iter->second;
+        index_t id = nodes.size();
+        nodes.push_back(std::move(node));
+        cache.emplace(key, id);
+        return id;
+    }
+
+    LazyTensor Graph::input(const Tensor& tensor) {
+        Key key{OpKind::Input, none, none, (uint64_t)(uintptr_t)tensor.ptr().get()};
+        return {this, record(key, Node{OpKind::Input, none, none, 0, tensor.size(), tensor})};
+    }
+
+    LazyTensor Graph::scalar(data_t value) {
+        Key key{OpKind::Scalar, none, none, std::bit_cast<uint64_t>(value)};
+        return {this, record(key, Node{OpKind::Scalar, none, none, value, Shape({1}), std::nullopt})};
+    }
+
+    LazyTensor Graph::unary(OpKind kind, const LazyTensor& x) {
+        CHECK_TRUE(is_unary(kind), "Graph::unary() expects a unary op kind");
+        CHECK_TRUE(&x.owner() == this, "operand belongs to another graph");
+        const Node& operand = nodes[x.node()];
+        if (operand.kind == OpKind::Scalar) return scalar(fold(kind, operand.value));
+        if (kind == OpKind::Neg && operand.kind == OpKind::Neg) return {this, operand.lhs};
+        Key key{kind, x.node(), none, 0};
+        return {this, record(key, Node{kind, x.node(), none, 0, nodes[x.node()].shape, std::nullopt})};
+    }
+
+    LazyTensor Graph::binary(OpKind kind, const LazyTensor& lhs, const LazyTensor& rhs) {
+        CHECK_TRUE(is_binary(kind), "Graph::binary() expects a binary op kind");
+        CHECK_TRUE(&lhs.owner() == this && &rhs.owner() == this, "operand belongs to another graph");
+        index_t l = lhs.node(), r = rhs.node();
+        if (is_commutative(kind) && l > r) std::swap(l, r);
+        const Shape& ls = nodes[l].shape;
+        const Shape& rs = nodes[r].shape;
+        if (kind == OpKind::MatMul) {
+            CHECK_TRUE(ls.n_dim() >= 2 && rs.n_dim() >= 2, "matmul() expects operands with at least 2 dims");
+            CHECK_EQUAL(ls[ls.n_dim()-1], rs[rs.n_dim()-2],
+                        "mat1 and mat2 shapes cannot be multiplied (%dx%d and %dx%d)",
+                        ls[ls.n_dim()-2], ls[ls.n_dim()-1], rs[rs.n_dim()-2], rs[rs.n_dim()-1]);
+        } else {
+            for (int i = (int)ls.n_dim() - 1, j = (int)rs.n_dim() - 1; i >= 0 && j >= 0; --i, --j)
+                CHECK_TRUE(ls[i] == rs[j] || ls[i] == 1 || rs[j] == 1,
+                           "Broadcast error with %d in tensor a but %d in tensor b.", ls[i], rs[j]);
+        }
+        Shape shape = kind == OpKind::MatMul ? op::MatrixMul::size(ShapeOf{ls}, ShapeOf{rs})
+                                             : broadcast_shape(ls, rs);
+        if (auto res = rewrite(kind, l, r, shape)) return *res;
+        Key key{kind, l, r, 0};
+        return {this, record(key, Node{kind, l, r, 0, std::move(shape), std::nullopt})};
+    }
+
+    LazyTensor Graph::transpose(const LazyTensor& x, index_t dim0, index_t dim1) {
+        CHECK_TRUE(&x.owner() == this, "operand belongs to another graph");
+        const Node& operand = nodes[x.node()];
+        index_t n_dim = operand.shape.n_dim();
+        CHECK_IN_RANGE(dim0, 0, n_dim,
+                       "Dimension out of range (expected to be in range of [0, %d), but got %d)", n_dim, dim0);
+        CHECK_IN_RANGE(dim1, 0, n_dim,
+                       "Dimension out of range (expected to be in range of [0, %d), but got %d)", n_dim, dim1);
+        if (dim0 == dim1) return x;
+        if (dim0 > dim1) std::swap(dim0, dim1);
+        if (operand.kind == OpKind::Transpose && operand.dim0 == dim0 && operand.dim1 == dim1)
+            return {this, operand.lhs};
+        Shape shape = operand.shape;
+        std::swap(shape[dim0], shape[dim1]);
+        Key key{OpKind::Transpose, x.node(), none, (uint64_t)dim0 << 32 | dim1};
+        return {this, record(key, Node{OpKind::Transpose, x.node(), none, 0, std::move(shape), std::nullopt, dim0, dim1})};
+    }
+
+    bool Graph::is_scalar(index_t id, data_t value) const {
+        return nodes[id].kind == OpKind::Scalar && nodes[id].value == value;
+    }
+
+    std::optional<LazyTensor> Graph::rewrite(OpKind kind, index_t l, index_t r, const Shape& shape) {
+        const Node& ln = nodes[l];
+        const Node& rn = nodes[r];
+        if (kind == OpKind::MatMul) {
+            // re-associate a chain of 2-d products when the other order is cheaper, e.g. (A*B)*v into A*(B*v)
+            if (ln.shape.n_dim() != 2 || rn.shape.n_dim() != 2) return std::nullopt;
+            if (ln.kind == OpKind::MatMul && nodes[ln.lhs].shape.n_dim() == 2 && nodes[ln.rhs].shape.n_dim() == 2) {
+                const Shape& a = nodes[ln.lhs].shape;
+                const Shape& b = nodes[ln.rhs].shape;
+                uint64_t now = matmul_flops(a, b) + matmul_flops(ln.shape, rn.shape);
+                uint64_t alt = matmul_flops(b, rn.shape) + matmul_flops(a, Shape({b[0], rn.shape[1]}));
+                if (alt < now) {
+                    LazyTensor a_id(this, ln.lhs);
+                    LazyTensor bc = binary(kind, LazyTensor(this, ln.rhs), LazyTensor(this, r));
+                    return binary(kind, a_id, bc);
+                }
+            }
+            if (rn.kind == OpKind::MatMul && nodes[rn.lhs].shape.n_dim() == 2 && nodes[rn.rhs].shape.n_dim() == 2) {
+                const Shape& b = nodes[rn.lhs].shape;
+                const Shape& c = nodes[rn.rhs].shape;
+                uint64_t now = matmul_flops(b, c) + matmul_flops(ln.shape, rn.shape);
+                uint64_t alt = matmul_flops(ln.shape, b) + matmul_flops(Shape({ln.shape[0], b[1]}), c);
+                if (alt < now) {
+                    LazyTensor c_id(this, rn.rhs);
+                    LazyTensor ab = binary(kind, LazyTensor(this, l), LazyTensor(this, rn.lhs));
+                    return binary(kind, ab, c_id);
+                }
+            }
+            return std::nullopt;
+        }
+
+        if (ln.kind == OpKind::Scalar && rn.kind == OpKind::Scalar)
+            return scalar(fold(kind, ln.value, rn.value));
+        // identities only apply when the kept operand already has the result shape,
+        // x + 0 with a {1} shaped x still broadcasts against a bigger zero
+        if (rn.shape == shape && ((kind == OpKind::Mul && is_scalar(l, 1)) || (kind == OpKind::Add && is_scalar(l, 0))))
+            return LazyTensor(this, r);
+        if (ln.shape == shape &&
+            (((kind == OpKind::Mul || kind == OpKind::Div) && is_scalar(r, 1)) ||
+             ((kind == OpKind::Add || kind == OpKind::Sub) && is_scalar(r, 0))))
+            return LazyTensor(this, l);
+        // scalar chains: c * (d * x) becomes (c*d) * x, likewise for +
+        if (kind == OpKind::Add || kind == OpKind::Mul) {
+            index_t s = ln.kind == OpKind::Scalar ? l : r;
+            const Node& other = nodes[s == l ? r : l];
+            if (nodes[s].kind == OpKind::Scalar && other.kind == kind) {
+                index_t inner_s = nodes[other.lhs].kind == OpKind::Scalar ? other.lhs : other.rhs;
+                index_t x = inner_s == other.lhs ? other.rhs : other.lhs;
+                if (nodes[inner_s].kind == OpKind::Scalar) {
+                    LazyTensor c = scalar(fold(kind, nodes[s].value, nodes[inner_s].value));
+                    return binary(kind, c, LazyTensor(this, x));
+                }
+            }
+        }
+        return std::nullopt;
+    }
+
+    Tensor Graph::eval(const LazyTensor& output) {
+        return std::move(eval(std::vector<LazyTensor>{output})[0]);
+    }
+
+    std::vector<Tensor> Graph::eval(const std::vector<LazyTensor>& outputs) {
+        index_t n = nodes.size();
+        std::vector<index_t> uses(n, 0);
+        std::vector<bool> needed(n, false), is_output(n, false), must(n, false);
+        for (auto& out : outputs) {
+            CHECK_TRUE(&out.owner() == this, "output belongs to another graph");
+            needed[out.node()] = is_output[out.node()] = true;
+        }
+        // operands always have smaller ids than their users, so one backward sweep
+        // visits every needed node after all of its consumers
+        for (index_t id = n; id-- > 0;) {
+            if (!needed[id]) continue;
+            const Node& node = nodes[id];
+            // x*x reads its operand once
+            for (index_t c : {node.lhs, node.rhs == node.lhs ? none : node.rhs}) {
+                if (c == none) continue;
+                needed[c] = true;
+                ++uses[c];
+                // matmul reads whole operands and a transpose is a view, so their operands are written out
+                must[c] = must[c] || node.kind == OpKind::MatMul || node.kind == OpKind::Transpose;
+            }
+        }
+
+        // forward sweep: cost of the fused subtree ending at each node, and whether to write it out
+        std::vector<index_t> cost(n, 0);
+        std::vector<bool> materialised(n, false);
+        for (index_t id = 0; id < n; ++id) {
+            if (!needed[id]) continue;
+            const Node& node = nodes[id];
+            switch (node.kind) {
+                case OpKind::Input: materialised[id] = true; break;
+                case OpKind::Scalar: materialised[id] = is_output[id]; break;
+                case OpKind::MatMul: case OpKind::Transpose: materialised[id] = true; break;
+                default:
+                    cost[id] = op_cost(node.kind);
+                    for (index_t c : {node.lhs, node.rhs})
+                        if (c != none && !materialised[c]) cost[id] += cost[c];
+                    materialised[id] = is_output[id] || must[id] ||
+                                       (uses[id] > 1 && (uses[id] - 1) * cost[id] >= materialise_cost);
+            }
+        }
+
+        // one kernel per materialised node, its inlined operands become steps
+        std::vector<Kernel> kernels;
+        std::vector<index_t> level(n, 0);
+        for (index_t id = 0; id < n; ++id) {
+            if (!needed[id] || !materialised[id] || nodes[id].kind == OpKind::Input) continue;
+            Kernel kernel{id, {}, {}, 0, 0};
+            if (nodes[id].kind == OpKind::MatMul) {
+                kernel.deps = {nodes[id].lhs, nodes[id].rhs};
+            } else if (nodes[id].kind == OpKind::Transpose) {
+                kernel.deps = {nodes[id].lhs};
+            } else {
+                std::unordered_map<index_t, index_t> slot_of;
+                std::function<index_t(index_t)> emit = [&](index_t c) -> index_t {
+                    auto iter = slot_of.find(c);
+                    if (iter != slot_of.end()) return iter->second;
+                    const Node& node = nodes[c];
+                    Step step{node.kind, c, 0, 0, 0};
+                    if (c != id && materialised[c]) {
+                        step.kind = OpKind::Input;
+                        kernel.deps.push_back(c);
+                    } else if (node.kind != OpKind::Scalar) {
+                        step.a = emit(node.lhs);
+                        if (node.rhs != none) step.b = emit(node.rhs);
+                    }
+                    step.slot = kernel.n_slots++;
+                    kernel.steps.push_back(step);
+                    return slot_of[c] = step.slot;
+                };
+                emit(id);
+            }
+            // inputs are level 0, so a kernel that reads only constants still runs at level 1
+            kernel.level = 1;
+            for (index_t dep : kernel.deps)
+                kernel.level = std::max(kernel.level, level[dep] + 1);
+            level[id] = kernel.level;
+            kernels.push_back(std::move(kernel));
+        }
+        last_materialised = kernels.size();
+
+        // intermediates are placed in one arena by their lifetimes in levels. a transpose is a
+        // view, so its operand is read for as long as the transpose is, and outputs (or what
+        // they view) leave the eval and get memory of their own.
+        std::vector<index_t> last_read(n, 0);
+        std::vector<bool> escapes(n, false);
+        for (auto& kernel : kernels)
+            for (index_t dep : kernel.deps) last_read[dep] = std::max(last_read[dep], kernel.level);
+        for (index_t id = n; id-- > 0;) {
+            if (!needed[id] || nodes[id].kind != OpKind::Transpose) continue;
+            index_t src = nodes[id].lhs;
+            last_read[src] = std::max(last_read[src], last_read[id]);
+            escapes[src] = escapes[src] || escapes[id] || is_output[id];
+        }
+        std::vector<index_t> planned;
+        std::vector<Lifetime> lifetimes;
+        for (auto& kernel : kernels) {
+            index_t id = kernel.id;
+            if (is_output[id] || escapes[id] || nodes[id].kind == OpKind::Transpose) continue;
+            planned.push_back(id);
+            lifetimes.push_back({nodes[id].shape.d_size(), kernel.level, std::max(kernel.level, last_read[id])});
+        }
+        MemoryPlan plan = plan_memory(lifetimes);
+        last_arena = plan.arena_size;
+        last_intermediates = 0;
+        for (auto& lifetime : lifetimes) last_intermediates += lifetime.size;
+        std::vector<std::optional<Tensor>> dst(n);
+        if (!planned.empty()) {
+            Storage arena(plan.arena_size);
+            for (index_t i = 0; i < planned.size(); ++i)
+                dst[planned[i]].emplace(Storage(arena, plan.offset[i]), nodes[planned[i]].shape);
+        }
+
+        std::vector<std::optional<Tensor>> values(n);
+        std::vector<index_t> readers(n, 0);
+        for (index_t id = 0; id < n; ++id)
+            if (needed[id] && nodes[id].kind == OpKind::Input) values[id] = nodes[id].tensor;
+        for (auto& kernel : kernels)
+            for (index_t dep : kernel.deps) ++readers[dep];
+
+        // kernels of one level only read earlier levels, so they can run side by side
+        index_t max_level = 0;
+        for (auto& kernel : kernels) max_level = std::max(max_level, kernel.level);
+        for (index_t lv = 1; lv <= max_level; ++lv) {
+            std::vector<const Kernel*> batch;
+            for (auto& kernel : kernels)
+                if (kernel.level == lv) batch.push_back(&kernel);
+            if (batch.size() == 1) {
+                run_kernel(*batch[0], nodes, values, dst[batch[0]->id]);
+            } else {
+                parallel_for(0, batch.size(), 1, [&](index_t begin, index_t end) {
+                    for (index_t k = begin; k < end; ++k)
+                        run_kernel(*batch[k], nodes, values, dst[batch[k]->id]);
+                });
+            }
+            // drop intermediates nobody reads any more
+            for (auto kernel : batch)
+                for (index_t dep : kernel->deps)
+                    if (--readers[dep] == 0 && !is_output[dep] && nodes[dep].kind != OpKind::Input)
+                        values[dep].reset();
+        }
+
+        // rewrites can reduce an output to an input or a transposed view of one, which
+        // is copied so the result never aliases the caller's tensor
+        std::vector<Tensor> res;
+        for (auto& out : outputs) {
+            index_t root = out.node();
+            while (nodes[root].kind == OpKind::Transpose) root = nodes[root].lhs;
+            const Tensor& value = *values[out.node()];
+            if (nodes[root].kind == OpKind::Input) {
+                Tensor copy(value.size());
+                copy.assign(value);
+                res.push_back(std::move(copy));
+            } else {
+                res.push_back(value);
+            }
+        }
+        return res;
+    }
+
+    LazyTensor operator+(const LazyTensor& lhs, const LazyTensor& rhs) { return lhs.owner().binary(Graph::OpKind::Add, lhs, rhs); }
+    LazyTensor operator-(const LazyTensor& lhs, const LazyTensor& rhs) { return lhs.owner().binary(Graph::OpKind::Sub, lhs, rhs); }
+    LazyTensor operator*(const LazyTensor& lhs, const LazyTensor& rhs) { return lhs.owner().binary(Graph::OpKind::Mul, lhs, rhs); }
+    LazyTensor operator/(const LazyTensor& lhs, const LazyTensor& rhs) { return lhs.owner().binary(Graph::OpKind::Div, lhs, rhs); }
+    LazyTensor operator+(const LazyTensor& lhs, data_t rhs) { return lhs + lhs.owner().scalar(rhs); }
+    LazyTensor operator-(const LazyTensor& lhs, data_t rhs) { return lhs - lhs.owner().scalar(rhs); }
+    LazyTensor operator*(const LazyTensor& lhs, data_t rhs) { return lhs * lhs.owner().scalar(rhs); }
+    LazyTensor operator/(const LazyTensor& lhs, data_t rhs) { return lhs / lhs.owner().scalar(rhs); }
+    LazyTensor operator+(data_t lhs, const LazyTensor& rhs) { return rhs.owner().scalar(lhs) + rhs; }
+    LazyTensor operator-(data_t lhs, const LazyTensor& rhs) { return rhs.owner().scalar(lhs) - rhs; }
+    LazyTensor operator*(data_t lhs, const LazyTensor& rhs) { return rhs.owner().scalar(lhs) * rhs; }
+    LazyTensor operator/(data_t lhs, const LazyTensor& rhs) { return rhs.owner().scalar(lhs) / rhs; }
+    LazyTensor operator-(const LazyTensor& x) { return x.owner().unary(Graph::OpKind::Neg, x); }
+    LazyTensor sin(const LazyTensor& x) { return x.owner().unary(Graph::OpKind::Sin, x); }
+    LazyTensor cos(const LazyTensor& x) { return x.owner().unary(Graph::OpKind::Cos, x); }
+    LazyTensor tan(const LazyTensor& x) { return x.owner().unary(Graph::OpKind::Tan, x); }
+    LazyTensor abs(const LazyTensor& x) { return x.owner().unary(Graph::OpKind::Abs, x); }
+    LazyTensor relu(const LazyTensor& x) { return x.owner().unary(Graph::OpKind::Relu, x); }
+    LazyTensor maximum(const LazyTensor& lhs, const LazyTensor& rhs) { return lhs.owner().binary(Graph::OpKind::Maximum, lhs, rhs); }
+    LazyTensor minimum(const LazyTensor& lhs, const LazyTensor& rhs) { return lhs.owner().binary(Graph::OpKind::Minimum, lhs, rhs); }
+    LazyTensor matmul(const LazyTensor& lhs, const LazyTensor& rhs) { return lhs.owner().binary(Graph::OpKind::MatMul, lhs, rhs); }
+    LazyTensor transpose(const LazyTensor& x, index_t dim0, index_t dim1) { return x.owner().transpose(x, dim0, dim1); }
+} // st
@@ -0,0 +1,170 @@
+#include "linalg.h"
+#include "gemm.h"
+#include "parallel.h"
+#include "exception.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+
+namespace st {
+    namespace {
+        // a strided m x n matrix, as the GEMM addresses it
+        struct MatView {
+            data_t* data;
+            stride_t rs;
+            stride_t cs;
+        };
+
+        // intermediate buffers of one call. a released buffer is handed to the next request it fits,
+        // so a chain of n matrices allocates at most a handful of them
+        class Workspace {
+        public:
+            index_t acquire(size_t size) {
+                index_t best = buffers.size();
+                for (index_t i = 0; i < buffers.size(); ++i)
+                    if (!in_use[i] && buffers[i].size() >= size &&
+                        (best == buffers.size() || buffers[i].size() < buffers[best].size()))
+                        best = i;
+                if (best == buffers.size()) {
+                    buffers.emplace_back(size);
+                    in_use.push_back(false);
+                }
+                in_use[best] = true;
+                return best;
+            }
+            void release(index_t idx) { in_use[idx] = false; }
+            data_t* data(index_t idx) { return buffers[idx].data(); }
+        private:
+            std::vector<std::vector<data_t>> buffers;
+            std::vector<bool> in_use;
+        };
+    }
+
+    Tensor mv(const Tensor& mat, const Tensor& vec) {
+        CHECK_TRUE(mat.n_dim() == 2 && vec.n_dim() == 1,
+                   "mv() expects a 2D matrix and a 1D vector, but got %dD and %dD", mat.n_dim(), vec.n_dim());
+        index_t m = mat.size(0), n = mat.size(1);
+        CHECK_EQUAL(n, vec.size(0), "size mismatch, got %dx%d and %d", m, n, vec.size(0));
+        Tensor res(Shape({m}));
+        gemv(m, n, 1, mat.data(), mat.stride()[0], mat.stride()[1], vec.data(), vec.stride()[0],
+             0, res.data(), 1);
+        return res;
+    }
+
+    data_t dot(const Tensor& x, const Tensor& y) {
+        CHECK_TRUE(x.n_dim() == 1 && y.n_dim() == 1,
+                   "dot() expects 1D tensors, but got %dD and %dD", x.n_dim(), y.n_dim());
+        CHECK_EQUAL(x.size(0), y.size(0),
+                    "dot() expects tensors of the same size, but got %d and %d", x.size(0), y.size(0));
+        return st::dot(x.size(0), x.data(), x.stride()[0], y.data(), y.stride()[0]);
+    }
+
+    Tensor outer(const Tensor& x, const Tensor& y) {
+        CHECK_TRUE(x.n_dim() == 1 && y.n_dim() == 1,
+                   "outer() expects 1D tensors, but got %dD and %dD", x.n_dim(), y.n_dim());
+        index_t m = x.size(0), n = y.size(0);
+        Tensor res(Shape({m, n}));
+        data_t* out = res.data();
+        parallel_for(0, m, std::max<index_t>(1, (1 << 15) / std::max<index_t>(n, 1)), [&](index_t begin, index_t end) {
+            for (index_t i = begin; i < end; ++i)
+                axpy(n, x.data()[(stride_t)i * x.stride()[0]], y.data(), y.stride()[0], out + (size_t)i * n, 1);
+        });
+        return res;
+    }
+
+    Tensor& axpy(data_t alpha, const Tensor& x, Tensor& y) {
+        CHECK_TRUE(x.n_dim() == 1 && y.n_dim() == 1,
+                   "axpy() expects 1D tensors, but got %dD and %dD", x.n_dim(), y.n_dim());
+        CHECK_EQUAL(x.size(0), y.size(0),
+                    "axpy() expects tensors of the same size, but got %d and %d", x.size(0), y.size(0));
+        CHECK_TRUE(y.size(0) <= 1 || y.stride()[0] != 0, "axpy() can't write into a broadcast view");
+        st::axpy(x.size(0), alpha, x.data(), x.stride()[0], y.data(), y.stride()[0]);
+        return y;
+    }
+
+    Tensor multi_dot(const std::vector<Tensor>& tensors) {
+        index_t n = tensors.size();
+        CHECK_TRUE(n >= 2, "multi_dot() expects at least 2 tensors, but got %d", n);
+        bool row_vec = tensors.front().n_dim() == 1;
+        bool col_vec = tensors.back().n_dim() == 1;
+        for (index_t i = 0; i < n; ++i) {
+            bool vec_ok = (i == 0 && row_vec) || (i == n - 1 && col_vec);
+            CHECK_TRUE(tensors[i].n_dim() == 2 || vec_ok,
+                       "multi_dot() expects tensor %d to be 2D, but got %dD", i, tensors[i].n_dim());
+        }
+
+        // matrix i is dims[i] x dims[i+1], vectors become a 1 x k row or a k x 1 column
+        std::vector<index_t> dims(n + 1);
+        std::vector<MatView> views(n);
+        for (index_t i = 0; i < n; ++i) {
+            const Tensor& t = tensors[i];
+            if (t.n_dim() == 1) {
+                index_t len = t.size(0);
+                stride_t s = t.stride()[0];
+                if (i == 0) {
+                    dims[0] = 1;
+                    dims[1] = len;
+                    views[i] = {t.data(), 0, s};
+                } else {
+                    dims[n] = 1;
+                    CHECK_EQUAL(dims[n - 1], len,
+                                "multi_dot() got mismatched shapes at tensor %d (%d and %d)", i, dims[n - 1], len);
+                    views[i] = {t.data(), s, 0};
+                }
+                continue;
+            }
+            if (i == 0) dims[0] = t.size(0);
+            CHECK_EQUAL(dims[i], t.size(0),
+                        "multi_dot() got mismatched shapes at tensor %d (%d and %d)", i, dims[i], t.size(0));
+            dims[i + 1] = t.size(1);
+            views[i] = {t.data(), t.stride()[0], t.stride()[1]};
+        }
+
+        // cost[i][j]: fewest multiply-adds for the product of matrices i..j, split[i][j]: where it splits
+        std::vector<std::vector<uint64_t>> cost(n, std::vector<uint64_t>(n, 0));
+        std::vector<std::vector<index_t>> split(n, std::vector<index_t>(n, 0));
+        for (index_t len = 1; len < n; ++len)
+            for (index_t i = 0; i + len < n; ++i) {
+                index_t j = i + len;
+                cost[i][j] = UINT64_MAX;
+                for (index_t k = i; k < j; ++k) {
+                    uint64_t c = cost[i][k] + cost[k + 1][j] + (uint64_t)dims[i] * dims[k + 1] * dims[j + 1];
+                    if (c < cost[i][j]) {
+                        cost[i][j] = c;
+                        split[i][j] = k;
+                    }
+                }
+            }
+
+        Shape shape = row_vec && col_vec ? Shape({1})
+                    : row_vec ? Shape({dims[n]})
+                    : col_vec ? Shape({dims[0]})
+                    : Shape({dims[0], dims[n]});
+        Tensor res(shape);
+        // the result is written densely, row major, whatever its 1-sized dims' strides say
+        MatView out{res.data(), (stride_t)dims[n], 1};
+
+        Workspace workspace;
+        std::function<void(index_t, index_t, const MatView&)> product =
+            [&](index_t i, index_t j, const MatView& dst) {
+            index_t k = split[i][j];
+            auto operand = [&](index_t lo, index_t hi, index_t& buf) -> MatView {
+                if (lo == hi) return views[lo];
+                buf = workspace.acquire((size_t)dims[lo] * dims[hi + 1]);
+                MatView view{workspace.data(buf), (stride_t)dims[hi + 1], 1};
+                product(lo, hi, view);
+                return view;
+            };
+            index_t lbuf = UINT32_MAX, rbuf = UINT32_MAX;
+            MatView a = operand(i, k, lbuf);
+            MatView b = operand(k + 1, j, rbuf);
+            gemm(dims[i], dims[j + 1], dims[k + 1], 1, a.data, a.rs, a.cs, b.data, b.rs, b.cs,
+                 0, dst.data, dst.rs, dst.cs);
+            if (lbuf != UINT32_MAX) workspace.release(lbuf);
+            if (rbuf != UINT32_MAX) workspace.release(rbuf);
+        };
+        product(0, n - 1, out);
+        return res;
+    }
+} // st
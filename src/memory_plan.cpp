@@ -0,0 +1,41 @@
+#include "memory_plan.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace st {
+    MemoryPlan plan_memory(const std::vector<Lifetime>& buffers) {
+        MemoryPlan plan;
+        plan.offset.assign(buffers.size(), 0);
+        std::vector<index_t> order(buffers.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](index_t a, index_t b) {
+            return buffers[a].size > buffers[b].size;
+        });
+
+        std::vector<index_t> placed;
+        std::vector<index_t> live; // placed buffers alive together with the current one, by offset
+        for (index_t id : order) {
+            const Lifetime& buf = buffers[id];
+            live.clear();
+            for (index_t other : placed)
+                if (buffers[other].first <= buf.last && buf.first <= buffers[other].last) live.push_back(other);
+            std::sort(live.begin(), live.end(), [&](index_t a, index_t b) { return plan.offset[a] < plan.offset[b]; });
+
+            size_t best = std::numeric_limits<size_t>::max(), best_gap = best, end = 0;
+            for (index_t other : live) {
+                size_t gap = plan.offset[other] > end ? plan.offset[other] - end : 0;
+                if (gap >= buf.size && gap < best_gap) {
+                    best = end;
+                    best_gap = gap;
+                }
+                end = std::max(end, plan.offset[other] + buffers[other].size);
+            }
+            plan.offset[id] = best == std::numeric_limits<size_t>::max() ? end : best;
+            plan.arena_size = std::max(plan.arena_size, plan.offset[id] + buf.size);
+            placed.push_back(id);
+        }
+        return plan;
+    }
+} // st
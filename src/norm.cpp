@@ -0,0 +1,174 @@
+#include "nn.h"
+#include "parallel.h"
+#include "exception.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace st {
+    namespace {
+        // a parameter as a dense array, or nullptr when it's absent
+        const data_t* param(const std::optional<Tensor>& t, Tensor& hold) {
+            if (!t) return nullptr;
+            hold = t->contiguous();
+            return hold.data();
+        }
+
+        struct Norm {
+            index_t rows, len;
+            Tensor weight, bias;         // dense copies, when given
+            const data_t* w = nullptr;
+            const data_t* b = nullptr;
+        };
+
+        Norm norm_of(const Tensor& input, const Shape& normalized_shape, const std::optional<Tensor>& weight,
+                     const std::optional<Tensor>& bias, const char* name) {
+            index_t nd = normalized_shape.n_dim(), offset = input.n_dim() - nd;
+            CHECK_TRUE(nd > 0 && nd <= input.n_dim(),
+                       "%s() expects normalized_shape to have between 1 and %d dims, but got %d", name, input.n_dim(), nd);
+            Norm norm{1, 1, Tensor(Shape({1})), Tensor(Shape({1}))};
+            for (index_t d = 0; d < input.n_dim(); ++d) {
+                if (d < offset) {
+                    norm.rows *= input.size(d);
+                    continue;
+                }
+                CHECK_EQUAL(input.size(d), normalized_shape[d - offset],
+                            "%s() expects the input to end in normalized_shape, but dim %d is %d and not %d",
+                            name, d, input.size(d), normalized_shape[d - offset]);
+                norm.len *= input.size(d);
+            }
+            CHECK_TRUE(!weight || weight->size() == normalized_shape, "%s() expects weight to have normalized_shape", name);
+            CHECK_TRUE(!bias || bias->size() == normalized_shape, "%s() expects bias to have normalized_shape", name);
+            norm.w = param(weight, norm.weight);
+            norm.b = param(bias, norm.bias);
+            return norm;
+        }
+
+        template<typename Fn>
+        void for_each_row(index_t rows, index_t len, Fn fn) {
+            index_t grain = std::max<index_t>(1, (1 << 12) / std::max<index_t>(len, 1));
+            parallel_for(0, rows, grain, [&](index_t begin, index_t end) {
+                for (index_t r = begin; r < end; ++r) fn(r);
+            });
+        }
+
+        // y = (x - shift) * scale * w + b for one row, src and dst may alias
+        void affine(const data_t* x, data_t* y, index_t len, data_t shift, data_t scale, const data_t* w, const data_t* b) {
+            if (w && b) for (index_t i = 0; i < len; ++i) y[i] = (x[i] - shift) * scale * w[i] + b[i];
+            else if (w) for (index_t i = 0; i < len; ++i) y[i] = (x[i] - shift) * scale * w[i];
+            else if (b) for (index_t i = 0; i < len; ++i) y[i] = (x[i] - shift) * scale + b[i];
+            else for (index_t i = 0; i < len; ++i) y[i] = (x[i] - shift) * scale;
+        }
+
+        void layer_norm_kernel(const data_t* src, data_t* dst, const Norm& norm, data_t eps) {
+            for_each_row(norm.rows, norm.len, [&](index_t r) {
+                const data_t* x = src + (size_t)r * norm.len;
+                data_t mean = 0, m2 = 0;
+                for (index_t i = 0; i < norm.len; ++i) {
+                    data_t delta = x[i] - mean;
+                    mean += delta / (data_t)(i + 1);
+                    m2 += delta * (x[i] - mean);
+                }
+                data_t rstd = 1 / std::sqrt(m2 / (data_t)norm.len + eps);
+                affine(x, dst + (size_t)r * norm.len, norm.len, mean, rstd, norm.w, norm.b);
+            });
+        }
+
+        void rms_norm_kernel(const data_t* src, data_t* dst, const Norm& norm, data_t eps) {
+            for_each_row(norm.rows, norm.len, [&](index_t r) {
+                const data_t* x = src + (size_t)r * norm.len;
+                data_t squares = 0;
+                for (index_t i = 0; i < norm.len; ++i) squares += x[i] * x[i];
+                data_t rrms = 1 / std::sqrt(squares / (data_t)norm.len + eps);
+                affine(x, dst + (size_t)r * norm.len, norm.len, 0, rrms, norm.w, nullptr);
+            });
+        }
+
+        struct BatchNorm {
+            index_t n, c, plane;
+            std::vector<data_t> scale, shift; // per channel, y = x * scale + shift
+        };
+
+        BatchNorm batch_norm_of(const Tensor& input, const Tensor& running_mean, const Tensor& running_var,
+                                const std::optional<Tensor>& weight, const std::optional<Tensor>& bias, data_t eps) {
+            CHECK_TRUE(input.n_dim() >= 2, "batch_norm() expects an input of at least 2 dims, but got %d", input.n_dim());
+            index_t c = input.size(1);
+            auto check = [c](const Tensor& t, const char* what) {
+                CHECK_TRUE(t.n_dim() == 1 && t.size(0) == c,
+                           "batch_norm() expects %s to be (C) with C = %d", what, c);
+            };
+            check(running_mean, "running_mean");
+            check(running_var, "running_var");
+            if (weight) check(*weight, "weight");
+            if (bias) check(*bias, "bias");
+            BatchNorm bn{input.size(0), c, input.d_size() / (input.size(0) * c), std::vector<data_t>(c), std::vector<data_t>(c)};
+            for (index_t i = 0; i < c; ++i) {
+                data_t scale = 1 / std::sqrt(running_var[{i}] + eps);
+                if (weight) scale *= (*weight)[{i}];
+                bn.scale[i] = scale;
+                bn.shift[i] = (bias ? (*bias)[{i}] : 0) - running_mean[{i}] * scale;
+            }
+            return bn;
+        }
+
+        void batch_norm_kernel(const data_t* src, data_t* dst, const BatchNorm& bn) {
+            for_each_row(bn.n * bn.c, bn.plane, [&](index_t r) {
+                const data_t* x = src + (size_t)r * bn.plane;
+                data_t* y = dst + (size_t)r * bn.plane;
+                data_t scale = bn.scale[r % bn.c], shift = bn.shift[r % bn.c];
+                for (index_t i = 0; i < bn.plane; ++i) y[i] = x[i] * scale + shift;
+            });
+        }
+
+        // runs kernel(src, dst) on a dense copy of input, then writes it back unless the
+        // copy was the input's own storage
+        template<typename Kernel>
+        Tensor& in_place(Tensor& input, Kernel kernel) {
+            Tensor x = input.contiguous();
+            kernel(x.data(), x.data());
+            if (x.data() != input.data()) input.assign(x);
+            return input;
+        }
+    }
+
+    Tensor layer_norm(const Tensor& input, const Shape& normalized_shape, const std::optional<Tensor>& weight,
+                      const std::optional<Tensor>& bias, data_t eps) {
+        Norm norm = norm_of(input, normalized_shape, weight, bias, "layer_norm");
+        Tensor x = input.contiguous(), out(input.size());
+        layer_norm_kernel(x.data(), out.data(), norm, eps);
+        return out;
+    }
+
+    Tensor rms_norm(const Tensor& input, const Shape& normalized_shape, const std::optional<Tensor>& weight, data_t eps) {
+        Norm norm = norm_of(input, normalized_shape, weight, std::nullopt, "rms_norm");
+        Tensor x = input.contiguous(), out(input.size());
+        rms_norm_kernel(x.data(), out.data(), norm, eps);
+        return out;
+    }
+
+    Tensor batch_norm(const Tensor& input, const Tensor& running_mean, const Tensor& running_var,
+                      const std::optional<Tensor>& weight, const std::optional<Tensor>& bias, data_t eps) {
+        BatchNorm bn = batch_norm_of(input, running_mean, running_var, weight, bias, eps);
+        Tensor x = input.contiguous(), out(input.size());
+        batch_norm_kernel(x.data(), out.data(), bn);
+        return out;
+    }
+
+    Tensor& layer_norm_(Tensor& input, const Shape& normalized_shape, const std::optional<Tensor>& weight,
+                        const std::optional<Tensor>& bias, data_t eps) {
+        Norm norm = norm_of(input, normalized_shape, weight, bias, "layer_norm_");
+        return in_place(input, [&](const data_t* src, data_t* dst) { layer_norm_kernel(src, dst, norm, eps); });
+    }
+
+    Tensor& rms_norm_(Tensor& input, const Shape& normalized_shape, const std::optional<Tensor>& weight, data_t eps) {
+        Norm norm = norm_of(input, normalized_shape, weight, std::nullopt, "rms_norm_");
+        return in_place(input, [&](const data_t* src, data_t* dst) { rms_norm_kernel(src, dst, norm, eps); });
+    }
+
+    Tensor& batch_norm_(Tensor& input, const Tensor& running_mean, const Tensor& running_var,
+                        const std::optional<Tensor>& weight, const std::optional<Tensor>& bias, data_t eps) {
+        BatchNorm bn = batch_norm_of(input, running_mean, running_var, weight, bias, eps);
+        return in_place(input, [&](const data_t* src, data_t* dst) { batch_norm_kernel(src, dst, bn); });
+    }
+} // st
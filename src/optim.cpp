@@ -0,0 +1,115 @@
+#include "optim.h"
+#include "parallel.h"
+#include "exception.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace st {
+    namespace {
+        // elements per chunk, small enough to balance a few large tensors across threads
+        constexpr index_t chunk_size = 1 << 14;
+    }
+
+    Optimizer::Optimizer(std::vector<Variable> params, index_t n_state)
+        : params(std::move(params)), n_state(n_state), state(this->params.size()), steps(this->params.size(), 0) {
+        for (auto& param : this->params)
+            CHECK_TRUE(param.is_leaf() && param.value().is_contiguous(),
+                       "an optimiser expects its parameters to be contiguous leaves");
+    }
+
+    void Optimizer::zero_grad() {
+        for (auto& param : params) param.zero_grad();
+    }
+
+    void Optimizer::step() {
+        std::vector<Tensor> grads;
+        std::vector<Chunk> chunks;
+        grads.reserve(params.size());
+        for (index_t i = 0; i < params.size(); ++i) {
+            if (!params[i].grad()) continue;
+            Tensor& value = params[i].value();
+            CHECK_TRUE(value.is_contiguous(), "an optimiser expects its parameters to be contiguous leaves");
+            index_t len = value.d_size();
+            if (state[i].empty()) state[i].assign(n_state, std::vector<data_t>(len, 0));
+            grads.push_back(params[i].grad()->contiguous());
+            ++steps[i];
+            for (index_t start = 0; start < len; start += chunk_size) {
+                Chunk chunk{i, steps[i], value.data() + start, grads.back().data() + start, {}, std::min(chunk_size, len - start)};
+                for (index_t s = 0; s < n_state; ++s) chunk.state[s] = state[i][s].data() + start;
+                chunks.push_back(chunk);
+            }
+        }
+        parallel_for(0, chunks.size(), 1, [&](index_t begin, index_t end) {
+            for (index_t c = begin; c < end; ++c) update(chunks[c]);
+        });
+    }
+
+    SGD::SGD(std::vector<Variable> params, const SGDOptions& options)
+        : Optimizer(std::move(params), options.momentum != 0), options(options) {
+        CHECK_TRUE(!options.nesterov || (options.momentum > 0 && options.dampening == 0),
+                   "Nesterov momentum requires a momentum and zero dampening");
+    }
+
+    void SGD::update(const Chunk& chunk) const {
+        const SGDOptions& o = options;
+        data_t* p = chunk.value;
+        data_t* buf = chunk.state[0];
+        for (index_t i = 0; i < chunk.len; ++i) {
+            data_t g = chunk.grad[i] + o.weight_decay * p[i];
+            if (o.momentum != 0) {
+                // the buffer starts out as the first gradient
+                buf[i] = chunk.step == 1 ? g : o.momentum * buf[i] + (1 - o.dampening) * g;
+                g = o.nesterov ? g + o.momentum * buf[i] : buf[i];
+            }
+            p[i] -= o.lr * g;
+        }
+    }
+
+    Adam::Adam(std::vector<Variable> params, const AdamOptions& options) : Adam(std::move(params), options, false) {}
+
+    Adam::Adam(std::vector<Variable> params, const AdamOptions& options, bool decoupled)
+        : Optimizer(std::move(params), 2), options(options), decoupled(decoupled) {}
+
+    void Adam::update(const Chunk& chunk) const {
+        const AdamOptions& o = options;
+        data_t* p = chunk.value;
+        data_t *m = chunk.state[0], *v = chunk.state[1];
+        data_t correction1 = 1 - std::pow(o.beta1, (data_t)chunk.step);
+        data_t correction2 = 1 - std::pow(o.beta2, (data_t)chunk.step);
+        data_t step_size = o.lr / correction1, sqrt_correction2 = std::sqrt(correction2);
+        data_t decay = decoupled ? 1 - o.lr * o.weight_decay : 1, coupled = decoupled ? 0 : o.weight_decay;
+        for (index_t i = 0; i < chunk.len; ++i) {
+            data_t g = chunk.grad[i] + coupled * p[i];
+            m[i] = o.beta1 * m[i] + (1 - o.beta1) * g;
+            v[i] = o.beta2 * v[i] + (1 - o.beta2) * g * g;
+            p[i] = p[i] * decay - step_size * m[i] / (std::sqrt(v[i]) / sqrt_correction2 + o.eps);
+        }
+    }
+
+    AdamW::AdamW(std::vector<Variable> params, const AdamOptions& options) : Adam(std::move(params), options, true) {}
+
+    RMSprop::RMSprop(std::vector<Variable> params, const RMSpropOptions& options)
+        : Optimizer(std::move(params), 1 + options.centered + (options.momentum != 0)), options(options) {}
+
+    void RMSprop::update(const Chunk& chunk) const {
+        const RMSpropOptions& o = options;
+        data_t* p = chunk.value;
+        data_t *sq = chunk.state[0], *avg = chunk.state[1], *buf = chunk.state[1 + o.centered];
+        for (index_t i = 0; i < chunk.len; ++i) {
+            data_t g = chunk.grad[i] + o.weight_decay * p[i];
+            sq[i] = o.alpha * sq[i] + (1 - o.alpha) * g * g;
+            data_t var = sq[i];
+            if (o.centered) {
+                avg[i] = o.alpha * avg[i] + (1 - o.alpha) * g;
+                var -= avg[i] * avg[i];
+            }
+            data_t scaled = g / (std::sqrt(var) + o.eps);
+            if (o.momentum != 0) {
+                buf[i] = o.momentum * buf[i] + scaled;
+                scaled = buf[i];
+            }
+            p[i] -= o.lr * scaled;
+        }
+    }
+} // st
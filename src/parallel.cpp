@@ -0,0 +1,132 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace st {
+    namespace {
+        thread_local bool in_worker = false;
+
+        struct WorkerScope { // marks the caller as a worker while it runs its own chunk
+            bool previous = in_worker;
+            WorkerScope() { in_worker = true; }
+            ~WorkerScope() { in_worker = previous; }
+        };
+
+        class ThreadPool {
+        public:
+            explicit ThreadPool(index_t n) { resize(n); }
+            ~ThreadPool() { stop(); }
+
+            index_t size() const { return workers.size() + 1; } // the caller works too
+
+            void resize(index_t n) {
+                stop();
+                done = false;
+                for (index_t i = 1; i < n; ++i)
+                    workers.emplace_back([this] { loop(); });
+            }
+
+            // every task runs to completion before this returns, even when some throw.
+            // the first exception thrown by a task is rethrown on the caller.
+            void run(std::vector<std::function<void()>>& tasks) {
+                std::mutex wait_mutex;
+                std::condition_variable wait_cv;
+                index_t remain = tasks.size();
+                std::exception_ptr error;
+                auto execute = [&](index_t i) {
+                    try {
+                        tasks[i]();
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(wait_mutex);
+                        if (!error) error = std::current_exception();
+                    }
+                    std::lock_guard<std::mutex> lock(wait_mutex);
+                    if (--remain == 0) wait_cv.notify_one();
+                };
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for (index_t i = 1; i < tasks.size(); ++i)
+                        jobs.push([&execute, i] { execute(i); });
+                }
+                cv.notify_all();
+                {
+                    WorkerScope scope;
+                    execute(0);
+                }
+                std::unique_lock<std::mutex> lock(wait_mutex);
+                wait_cv.wait(lock, [&] { return remain == 0; });
+                if (error) std::rethrow_exception(error);
+            }
+
+        private:
+            void loop() {
+                in_worker = true;
+                while (true) {
+                    std::function<void()> job;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        cv.wait(lock, [this] { return done || !jobs.empty(); });
+                        if (done && jobs.empty()) return;
+                        job = std::move(jobs.front());
+                        jobs.pop();
+                    }
+                    job();
+                }
+            }
+
+            void stop() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    done = true;
+                }
+                cv.notify_all();
+                for (auto& t : workers) t.join();
+                workers.clear();
+            }
+
+            std::vector<std::thread> workers;
+            std::queue<std::function<void()>> jobs;
+            std::mutex mutex;
+            std::condition_variable cv;
+            bool done = false;
+        };
+
+        ThreadPool& pool() {
+            static ThreadPool p(std::max(1u, std::thread::hardware_concurrency()));
+            return p;
+        }
+    }
+
+    void parallel_for(index_t begin, index_t end, index_t grain,
+                      const std::function<void(index_t, index_t)>& fn) {
+        if (begin >= end) return;
+        index_t n = end - begin;
+        grain = std::max(grain, 1u);
+        index_t n_chunk = std::min((n + grain - 1) / grain, pool().size());
+        if (n_chunk <= 1 || in_worker) {
+            fn(begin, end);
+            return;
+        }
+        index_t step = (n + n_chunk - 1) / n_chunk;
+        std::vector<std::function<void()>> tasks;
+        for (index_t b = begin; b < end; b += step) {
+            index_t e = std::min(end, b + step);
+            tasks.emplace_back([&fn, b, e] { fn(b, e); });
+        }
+        pool().run(tasks);
+    }
+
+    index_t get_num_threads() {
+        return pool().size();
+    }
+
+    void set_num_threads(index_t n) {
+        pool().resize(std::max(n, 1u));
+    }
+} // st
@@ -0,0 +1,226 @@
+#include "nn.h"
+#include "parallel.h"
+#include "exception.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace st {
+    namespace {
+        // the (N, C) planes of an input as strided 2d arrays, a 1d input has a single row
+        struct Planes {
+            const data_t* data;
+            index_t n, c, h, w;
+            stride_t sn, sc, sh, sw;
+
+            [[nodiscard]] const data_t* plane(index_t idx) const {
+                return data + (stride_t)(idx / c) * sn + (stride_t)(idx % c) * sc;
+            }
+        };
+
+        Planes planes_of(const Tensor& t, bool one_d, const char* name) {
+            index_t nd = one_d ? 3 : 4;
+            CHECK_EQUAL(t.n_dim(), nd, "%s() expects a %dD input, but got %dD", name, nd, t.n_dim());
+            const StrideArray& s = t.stride();
+            if (one_d) return {t.data(), t.size(0), t.size(1), 1, t.size(2), s[0], s[1], 0, s[2]};
+            return {t.data(), t.size(0), t.size(1), t.size(2), t.size(3), s[0], s[1], s[2], s[3]};
+        }
+
+        Tensor output_for(const Planes& p, bool one_d, index_t oh, index_t ow) {
+            return Tensor(one_d ? Shape({p.n, p.c, ow}) : Shape({p.n, p.c, oh, ow}));
+        }
+
+        // runs fn(plane index, input plane, output plane) for every (N, C) plane in parallel
+        template<typename Fn>
+        void for_each_plane(const Planes& p, index_t out_plane, data_t* out, Fn fn) {
+            index_t grain = std::max<index_t>(1, (1 << 12) / std::max<index_t>(out_plane, 1));
+            parallel_for(0, p.n * p.c, grain, [&](index_t begin, index_t end) {
+                for (index_t i = begin; i < end; ++i)
+                    fn(i, p.plane(i), out + (size_t)i * out_plane);
+            });
+        }
+
+        struct Window {
+            index_t k, s, pad;
+            index_t out(index_t size) const { return ((stride_t)size + 2 * (stride_t)pad - (stride_t)k) / (stride_t)s + 1; }
+        };
+
+        Window window(index_t size, index_t kernel_size, index_t stride, index_t padding, const char* name) {
+            Window win{kernel_size, stride == 0 ? kernel_size : stride, padding};
+            CHECK_TRUE(kernel_size > 0, "%s() expects a positive kernel size", name);
+            CHECK_TRUE(2 * padding <= kernel_size,
+                       "%s() expects padding to be at most half the kernel size, but got %d and %d", name, padding, kernel_size);
+            CHECK_TRUE(size + 2 * padding >= kernel_size, "%s(): the kernel is larger than the padded input", name);
+            return win;
+        }
+
+        std::pair<Tensor, Tensor> max_pool(const Tensor& input, bool one_d, index_t kernel_size, index_t stride,
+                                           index_t padding, bool with_indices, const char* name) {
+            Planes p = planes_of(input, one_d, name);
+            Window wh = one_d ? Window{1, 1, 0} : window(p.h, kernel_size, stride, padding, name);
+            Window ww = window(p.w, kernel_size, stride, padding, name);
+            index_t oh = wh.out(p.h), ow = ww.out(p.w);
+            Tensor out = output_for(p, one_d, oh, ow);
+            Tensor idx = with_indices ? output_for(p, one_d, oh, ow) : Tensor(Shape({1}));
+            data_t* idx_data = idx.data();
+            for_each_plane(p, oh * ow, out.data(), [&](index_t plane, const data_t* src, data_t* dst) {
+                for (index_t i = 0; i < oh; ++i) {
+                    stride_t h0 = (stride_t)(i * wh.s) - (stride_t)wh.pad;
+                    stride_t h1 = std::min<stride_t>(h0 + wh.k, p.h);
+                    h0 = std::max<stride_t>(h0, 0);
+                    for (index_t j = 0; j < ow; ++j) {
+                        stride_t w0 = (stride_t)(j * ww.s) - (stride_t)ww.pad;
+                        stride_t w1 = std::min<stride_t>(w0 + ww.k, p.w);
+                        w0 = std::max<stride_t>(w0, 0);
+                        data_t best = -std::numeric_limits<data_t>::infinity();
+                        index_t arg = h0 * p.w + w0;
+                        for (stride_t y = h0; y < h1; ++y)
+                            for (stride_t x = w0; x < w1; ++x) {
+                                data_t v = src[y * p.sh + x * p.sw];
+                                // NaN propagates, like the comparison ops
+                                if (v > best || std::isnan(v)) {
+                                    best = v;
+                                    arg = y * p.w + x;
+                                    if (std::isnan(v)) y = h1, x = w1;
+                                }
+                            }
+                        dst[(size_t)i * ow + j] = best;
+                        if (with_indices) idx_data[(size_t)plane * oh * ow + (size_t)i * ow + j] = arg;
+                    }
+                }
+            });
+            return {out, idx};
+        }
+
+        Tensor avg_pool(const Tensor& input, bool one_d, index_t kernel_size, index_t stride, index_t padding,
+                        const char* name) {
+            Planes p = planes_of(input, one_d, name);
+            Window wh = one_d ? Window{1, 1, 0} : window(p.h, kernel_size, stride, padding, name);
+            Window ww = window(p.w, kernel_size, stride, padding, name);
+            index_t oh = wh.out(p.h), ow = ww.out(p.w);
+            Tensor out = output_for(p, one_d, oh, ow);
+            for_each_plane(p, oh * ow, out.data(), [&](index_t, const data_t* src, data_t* dst) {
+                for (index_t i = 0; i < oh; ++i) {
+                    stride_t h0 = (stride_t)(i * wh.s) - (stride_t)wh.pad;
+                    stride_t h1 = std::min<stride_t>(h0 + wh.k, p.h + wh.pad);
+                    for (index_t j = 0; j < ow; ++j) {
+                        stride_t w0 = (stride_t)(j * ww.s) - (stride_t)ww.pad;
+                        stride_t w1 = std::min<stride_t>(w0 + ww.k, p.w + ww.pad);
+                        // the divisor counts padding but not positions past it
+                        data_t count = (data_t)((h1 - h0) * (w1 - w0));
+                        data_t sum = 0;
+                        for (stride_t y = std::max<stride_t>(h0, 0); y < std::min<stride_t>(h1, p.h); ++y)
+                            for (stride_t x = std::max<stride_t>(w0, 0); x < std::min<stride_t>(w1, p.w); ++x)
+                                sum += src[y * p.sh + x * p.sw];
+                        dst[(size_t)i * ow + j] = sum / count;
+                    }
+                }
+            });
+            return out;
+        }
+
+        Tensor adaptive_avg_pool(const Tensor& input, bool one_d, index_t oh, index_t ow, const char* name) {
+            Planes p = planes_of(input, one_d, name);
+            CHECK_TRUE(oh > 0 && ow > 0, "%s() expects a positive output size", name);
+            Tensor out = output_for(p, one_d, oh, ow);
+            // window i covers [floor(i * in / out), ceil((i + 1) * in / out))
+            auto start = [](index_t i, index_t in, index_t out) { return (index_t)((size_t)i * in / out); };
+            auto stop = [](index_t i, index_t in, index_t out) { return (index_t)(((size_t)(i + 1) * in + out - 1) / out); };
+            for_each_plane(p, oh * ow, out.data(), [&](index_t, const data_t* src, data_t* dst) {
+                for (index_t i = 0; i < oh; ++i) {
+                    index_t h0 = start(i, p.h, oh), h1 = stop(i, p.h, oh);
+                    for (index_t j = 0; j < ow; ++j) {
+                        index_t w0 = start(j, p.w, ow), w1 = stop(j, p.w, ow);
+                        data_t sum = 0;
+                        for (index_t y = h0; y < h1; ++y)
+                            for (index_t x = w0; x < w1; ++x)
+                                sum += src[(stride_t)y * p.sh + (stride_t)x * p.sw];
+                        dst[(size_t)i * ow + j] = sum / (data_t)((h1 - h0) * (w1 - w0));
+                    }
+                }
+            });
+            return out;
+        }
+
+        // source coordinate of output position i for linear interpolation
+        data_t source_coord(index_t i, index_t in, index_t out, bool align_corners) {
+            if (align_corners) return out > 1 ? (data_t)i * (in - 1) / (out - 1) : 0;
+            data_t src = ((data_t)i + 0.5) * in / out - 0.5;
+            return std::max<data_t>(src, 0);
+        }
+    }
+
+    Tensor max_pool1d(const Tensor& input, index_t kernel_size, index_t stride, index_t padding) {
+        return max_pool(input, true, kernel_size, stride, padding, false, "max_pool1d").first;
+    }
+    Tensor max_pool2d(const Tensor& input, index_t kernel_size, index_t stride, index_t padding) {
+        return max_pool(input, false, kernel_size, stride, padding, false, "max_pool2d").first;
+    }
+    std::pair<Tensor, Tensor> max_pool1d_with_indices(const Tensor& input, index_t kernel_size, index_t stride, index_t padding) {
+        return max_pool(input, true, kernel_size, stride, padding, true, "max_pool1d");
+    }
+    std::pair<Tensor, Tensor> max_pool2d_with_indices(const Tensor& input, index_t kernel_size, index_t stride, index_t padding) {
+        return max_pool(input, false, kernel_size, stride, padding, true, "max_pool2d");
+    }
+    Tensor avg_pool1d(const Tensor& input, index_t kernel_size, index_t stride, index_t padding) {
+        return avg_pool(input, true, kernel_size, stride, padding, "avg_pool1d");
+    }
+    Tensor avg_pool2d(const Tensor& input, index_t kernel_size, index_t stride, index_t padding) {
+        return avg_pool(input, false, kernel_size, stride, padding, "avg_pool2d");
+    }
+    Tensor adaptive_avg_pool1d(const Tensor& input, index_t output_size) {
+        return adaptive_avg_pool(input, true, 1, output_size, "adaptive_avg_pool1d");
+    }
+    Tensor adaptive_avg_pool2d(const Tensor& input, index_t output_h, index_t output_w) {
+        return adaptive_avg_pool(input, false, output_h, output_w, "adaptive_avg_pool2d");
+    }
+
+    Tensor upsample_nearest2d(const Tensor& input, index_t output_h, index_t output_w) {
+        Planes p = planes_of(input, false, "upsample_nearest2d");
+        CHECK_TRUE(output_h > 0 && output_w > 0, "upsample_nearest2d() expects a positive output size");
+        Tensor out = output_for(p, false, output_h, output_w);
+        std::vector<stride_t> col(output_w);
+        for (index_t j = 0; j < output_w; ++j)
+            col[j] = (stride_t)std::min<index_t>((size_t)j * p.w / output_w, p.w - 1) * p.sw;
+        for_each_plane(p, output_h * output_w, out.data(), [&](index_t, const data_t* src, data_t* dst) {
+            for (index_t i = 0; i < output_h; ++i) {
+                const data_t* row = src + (stride_t)std::min<index_t>((size_t)i * p.h / output_h, p.h - 1) * p.sh;
+                for (index_t j = 0; j < output_w; ++j)
+                    dst[(size_t)i * output_w + j] = row[col[j]];
+            }
+        });
+        return out;
+    }
+
+    Tensor upsample_bilinear2d(const Tensor& input, index_t output_h, index_t output_w, bool align_corners) {
+        Planes p = planes_of(input, false, "upsample_bilinear2d");
+        CHECK_TRUE(output_h > 0 && output_w > 0, "upsample_bilinear2d() expects a positive output size");
+        Tensor out = output_for(p, false, output_h, output_w);
+        // the horizontal taps are the same for every row and plane
+        std::vector<index_t> x0(output_w), x1(output_w);
+        std::vector<data_t> fx(output_w);
+        for (index_t j = 0; j < output_w; ++j) {
+            data_t src = source_coord(j, p.w, output_w, align_corners);
+            x0[j] = std::min<index_t>((index_t)src, p.w - 1);
+            x1[j] = std::min<index_t>(x0[j] + 1, p.w - 1);
+            fx[j] = src - x0[j];
+        }
+        for_each_plane(p, output_h * output_w, out.data(), [&](index_t, const data_t* src, data_t* dst) {
+            for (index_t i = 0; i < output_h; ++i) {
+                data_t sy = source_coord(i, p.h, output_h, align_corners);
+                index_t y0 = std::min<index_t>((index_t)sy, p.h - 1), y1 = std::min<index_t>(y0 + 1, p.h - 1);
+                data_t fy = sy - y0;
+                const data_t* r0 = src + (stride_t)y0 * p.sh;
+                const data_t* r1 = src + (stride_t)y1 * p.sh;
+                for (index_t j = 0; j < output_w; ++j) {
+                    data_t top = r0[(stride_t)x0[j] * p.sw] * (1 - fx[j]) + r0[(stride_t)x1[j] * p.sw] * fx[j];
+                    data_t bottom = r1[(stride_t)x0[j] * p.sw] * (1 - fx[j]) + r1[(stride_t)x1[j] * p.sw] * fx[j];
+                    dst[(size_t)i * output_w + j] = top * (1 - fy) + bottom * fy;
+                }
+            }
+        });
+        return out;
+    }
+} // st
@@ -1,4 +1,5 @@
 #include "shape.h"
+#include "exception.h"
 
 #include <initializer_list>
 
@@ -48,6 +49,36 @@ namespace st {
         return true;
     }
 
+    StrideArray contiguous_stride(const Shape& shape) {
+        StrideArray stride(shape.n_dim());
+        for (int i = 0; i < shape.n_dim(); ++i) {
+            if (i == shape.n_dim()-1) stride[i] = 1;
+            else stride[i] = shape.sub_size(i+1);
+            if (shape[i] == 1) stride[i] = 0;
+        }
+        return stride;
+    }
+
+    StrideArray expand_stride(const Shape& shape, const StrideArray& stride, const Shape& target) {
+        CHECK_TRUE(target.n_dim() >= shape.n_dim(),
+            "The number of sizes provided (%d) must be greater or equal to the number of dimensions in the tensor (%d)",
+            target.n_dim(), shape.n_dim());
+        index_t lead = target.n_dim() - shape.n_dim();
+        StrideArray res(target.n_dim());
+        for (index_t i = 0; i < target.n_dim(); ++i) {
+            if (i < lead) {
+                res[i] = 0;
+                continue;
+            }
+            index_t size = shape[i-lead];
+            CHECK_TRUE(size == target[i] || size == 1,
+                "The expanded size of the tensor (%d) must match the existing size (%d) at non-singleton dimension %d",
+                target[i], size, i);
+            res[i] = size == 1 ? 0 : stride[i-lead];
+        }
+        return res;
+    }
+
     std::ostream& operator<<(std::ostream &out, const Shape &sh) {
         out << "(" << sh[0];
         for (int i = 1; i < sh.n_dim(); ++i)
@@ -0,0 +1,120 @@
+#include "nn.h"
+#include "parallel.h"
+#include "exception.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace st {
+    namespace {
+        constexpr data_t neg_inf = -std::numeric_limits<data_t>::infinity();
+
+        // the 1d rows of a tensor along dim. rows are numbered in row-major order of the
+        // other dims, which is also where they go in a dense output of the same shape.
+        struct Rows {
+            const data_t* data;
+            index_t n, len, inner;          // rows, elements per row, dense stride along dim
+            stride_t step;                  // input stride along dim
+            std::vector<index_t> size;      // the other dims
+            std::vector<stride_t> stride;
+
+            [[nodiscard]] const data_t* input(index_t r) const {
+                stride_t offset = 0;
+                for (index_t d = size.size(); d-- > 0;) {
+                    offset += (stride_t)(r % size[d]) * stride[d];
+                    r /= size[d];
+                }
+                return data + offset;
+            }
+            [[nodiscard]] size_t output(index_t r) const {
+                return (size_t)(r / inner) * len * inner + r % inner;
+            }
+        };
+
+        Rows rows_of(const Tensor& t, int dim, const char* name) {
+            CHECK_IN_RANGE(dim, 0, t.n_dim(),
+                "%s(): dimension out of range (expected to be in range of [0, %d), but got %d)", name, t.n_dim(), dim);
+            Rows rows{t.data(), 1, t.size(dim), 1, t.stride()[dim], {}, {}};
+            for (index_t d = 0; d < t.n_dim(); ++d) {
+                if (d == (index_t)dim) continue;
+                rows.size.push_back(t.size(d));
+                rows.stride.push_back(t.stride()[d]);
+                rows.n *= t.size(d);
+                if (d > (index_t)dim) rows.inner *= t.size(d);
+            }
+            return rows;
+        }
+
+        struct MaxSum {
+            data_t max;
+            data_t sum; // of exp(x - max)
+        };
+
+        // the online normaliser: when a new max arrives the sum so far is rescaled to it
+        MaxSum max_sum(const data_t* x, index_t len, stride_t step) {
+            data_t m = neg_inf, s = 0;
+            for (index_t i = 0; i < len; ++i) {
+                data_t v = x[(stride_t)i * step];
+                if (v > m) {
+                    s = s * std::exp(m - v) + 1;
+                    m = v;
+                } else if (v != neg_inf) { // exp(-inf - -inf) would poison a masked row
+                    s += std::exp(v - m);
+                }
+            }
+            return {m, s};
+        }
+
+        template<typename Fn>
+        void for_each_row(const Rows& rows, Fn fn) {
+            index_t grain = std::max<index_t>(1, (1 << 12) / std::max<index_t>(rows.len, 1));
+            parallel_for(0, rows.n, grain, [&](index_t begin, index_t end) {
+                for (index_t r = begin; r < end; ++r) fn(r);
+            });
+        }
+
+        // fn(x, max, sum) gives each output element
+        template<typename Fn>
+        Tensor normalise(const Tensor& input, int dim, const char* name, Fn fn) {
+            Rows rows = rows_of(input, dim, name);
+            Tensor out(input.size());
+            data_t* dst = out.data();
+            for_each_row(rows, [&](index_t r) {
+                const data_t* x = rows.input(r);
+                data_t* y = dst + rows.output(r);
+                MaxSum ms = max_sum(x, rows.len, rows.step);
+                for (index_t i = 0; i < rows.len; ++i)
+                    y[(size_t)i * rows.inner] = fn(x[(stride_t)i * rows.step], ms);
+            });
+            return out;
+        }
+    }
+
+    Tensor softmax(const Tensor& input, int dim) {
+        return normalise(input, dim, "softmax", [](data_t x, const MaxSum& ms) {
+            return std::exp(x - ms.max) / ms.sum;
+        });
+    }
+
+    Tensor log_softmax(const Tensor& input, int dim) {
+        return normalise(input, dim, "log_softmax", [](data_t x, const MaxSum& ms) {
+            return x - ms.max - std::log(ms.sum);
+        });
+    }
+
+    Tensor logsumexp(const Tensor& input, int dim, bool keepdim) {
+        Rows rows = rows_of(input, dim, "logsumexp");
+        Shape shape = keepdim ? input.size() : input.n_dim() > 1 ? Shape(input.size(), dim) : Shape({1});
+        if (keepdim) shape[dim] = 1;
+        Tensor out(shape);
+        data_t* dst = out.data();
+        for_each_row(rows, [&](index_t r) {
+            MaxSum ms = max_sum(rows.input(r), rows.len, rows.step);
+            // an infinite max is the answer itself, the sum would be nan or 0
+            dst[r] = std::isinf(ms.max) ? ms.max : ms.max + std::log(ms.sum);
+        });
+        return out;
+    }
+} // st
@@ -0,0 +1,606 @@
+#include "linalg.h"
+#include "gemm.h"
+#include "parallel.h"
+#include "exception.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace st {
+    namespace {
+        constexpr index_t NB = 64; // block size, updates outside the current block go through the GEMM
+
+        Shape make_shape(const std::vector<index_t>& dims) {
+            if (dims.empty()) return Shape({1});
+            IndexArray res(dims.size());
+            for (index_t i = 0; i < dims.size(); ++i) res[i] = dims[i];
+            return Shape(std::move(res));
+        }
+
+        // leading dims of t that aren't part of the `core` trailing ones
+        std::vector<index_t> batch_dims(const Tensor& t, index_t core) {
+            std::vector<index_t> dims;
+            for (index_t i = 0; i + core < t.n_dim(); ++i) dims.push_back(t.size(i));
+            return dims;
+        }
+        index_t count(const std::vector<index_t>& dims) {
+            index_t n = 1;
+            for (index_t d : dims) n *= d;
+            return n;
+        }
+
+        // a row-major copy the factorisations can overwrite
+        Tensor dense_copy(const Tensor& t) {
+            Tensor res(t.size());
+            res.assign(t);
+            return res;
+        }
+
+        void check_square(const Tensor& a, const char* name) {
+            CHECK_TRUE(a.n_dim() >= 2, "%s() expects a tensor with at least 2 dims, but got %dD", name, a.n_dim());
+            CHECK_EQUAL(a.size(a.n_dim()-2), a.size(a.n_dim()-1),
+                        "%s() expects square matrices, but got %dx%d", name, a.size(a.n_dim()-2), a.size(a.n_dim()-1));
+        }
+
+        // how a right-hand side lines up with the matrices: its batch dims and whether it holds vectors
+        struct Rhs {
+            bool vector;
+            index_t rows;
+            index_t cols;
+        };
+        Rhs check_rhs(const Tensor& a, const Tensor& b, const char* name) {
+            bool vector = b.n_dim() + 1 == a.n_dim();
+            CHECK_TRUE(vector || b.n_dim() == a.n_dim(),
+                       "%s() expects the right-hand side to have %d or %d dims, but got %d",
+                       name, a.n_dim() - 1, a.n_dim(), b.n_dim());
+            index_t core = vector ? 1 : 2;
+            CHECK_TRUE(batch_dims(a, 2) == batch_dims(b, core), "%s() expects matching batch dims", name);
+            Rhs rhs{vector, b.size(b.n_dim() - core), vector ? 1 : b.size(b.n_dim() - 1)};
+            CHECK_EQUAL(rhs.rows, a.size(a.n_dim()-2),
+                        "%s() expects the right-hand side to have %d rows, but got %d", name, a.size(a.n_dim()-2), rhs.rows);
+            return rhs;
+        }
+
+        // runs fn(b) for every batch index in parallel
+        void for_each_batch(index_t n, const std::function<void(index_t)>& fn) {
+            parallel_for(0, n, 1, [&](index_t begin, index_t end) {
+                for (index_t b = begin; b < end; ++b) fn(b);
+            });
+        }
+
+        // x = T^{-1} x for the n x n triangle T of a and an n x k, row-major x
+        void trsm(bool upper, bool unit, index_t n, index_t k, const data_t* a, stride_t a_rs, stride_t a_cs,
+                  data_t* x, stride_t ldx) {
+            auto at = [&](index_t i, index_t j) { return a[(stride_t)i * a_rs + (stride_t)j * a_cs]; };
+            auto finish = [&](index_t i, index_t lo, index_t hi) {
+                data_t* xi = x + (stride_t)i * ldx;
+                for (index_t r = lo; r < hi; ++r)
+                    if (r != i) axpy(k, -at(i, r), x + (stride_t)r * ldx, 1, xi, 1);
+                if (!unit) {
+                    data_t d = at(i, i);
+                    for (index_t j = 0; j < k; ++j) xi[j] /= d;
+                }
+            };
+            if (!upper) {
+                for (index_t i0 = 0; i0 < n; i0 += NB) {
+                    index_t ib = std::min(NB, n - i0);
+                    if (i0 > 0)
+                        gemm(ib, k, i0, -1, a + (stride_t)i0 * a_rs, a_rs, a_cs, x, ldx, 1,
+                             1, x + (stride_t)i0 * ldx, ldx, 1);
+                    for (index_t i = i0; i < i0 + ib; ++i) finish(i, i0, i);
+                }
+                return;
+            }
+            for (index_t end = n; end > 0;) {
+                index_t ib = std::min(NB, end), i0 = end - ib;
+                if (end < n)
+                    gemm(ib, k, n - end, -1, a + (stride_t)i0 * a_rs + (stride_t)end * a_cs, a_rs, a_cs,
+                         x + (stride_t)end * ldx, ldx, 1, 1, x + (stride_t)i0 * ldx, ldx, 1);
+                for (index_t i = end; i-- > i0;) finish(i, i + 1, end);
+                end = i0;
+            }
+        }
+
+        // right-looking blocked LU: factor a panel of NB columns, solve for the block row of U,
+        // then update the trailing matrix with one GEMM. returns the sign of the permutation
+        int lu_inplace(index_t n, data_t* a, index_t* piv) {
+            auto row = [&](index_t i) { return a + (size_t)i * n; };
+            int sign = 1;
+            for (index_t j0 = 0; j0 < n; j0 += NB) {
+                index_t jb = std::min(NB, n - j0), j1 = j0 + jb;
+                for (index_t j = j0; j < j1; ++j) {
+                    index_t p = j;
+                    for (index_t i = j + 1; i < n; ++i)
+                        if (std::abs(row(i)[j]) > std::abs(row(p)[j])) p = i;
+                    piv[j] = p;
+                    if (p != j) {
+                        std::swap_ranges(row(j), row(j) + n, row(p));
+                        sign = -sign;
+                    }
+                    data_t d = row(j)[j];
+                    if (d == 0) continue;
+                    for (index_t i = j + 1; i < n; ++i) {
+                        data_t l = row(i)[j] /= d;
+                        axpy(j1 - j - 1, -l, row(j) + j + 1, 1, row(i) + j + 1, 1);
+                    }
+                }
+                if (j1 == n) break;
+                trsm(false, true, jb, n - j1, row(j0) + j0, n, 1, row(j0) + j1, n);
+                gemm(n - j1, n - j1, jb, -1, row(j1) + j0, n, 1, row(j0) + j1, n, 1, 1, row(j1) + j1, n, 1);
+            }
+            return sign;
+        }
+
+        // rows and columns of the Householder reflector H = I - tau v v^T applied to the rows x cols
+        // block c from the left. v has an implicit 1 on top and its other entries at v[i * v_s]
+        void reflect(index_t rows, index_t cols, const data_t* v, stride_t v_s, data_t tau,
+                     data_t* c, index_t ldc, std::vector<data_t>& w) {
+            if (cols == 0 || tau == 0) return;
+            std::copy(c, c + cols, w.begin());
+            for (index_t i = 1; i < rows; ++i)
+                axpy(cols, v[(stride_t)i * v_s], c + (size_t)i * ldc, 1, w.data(), 1);
+            axpy(cols, -tau, w.data(), 1, c, 1);
+            for (index_t i = 1; i < rows; ++i)
+                axpy(cols, -tau * v[(stride_t)i * v_s], w.data(), 1, c + (size_t)i * ldc, 1);
+        }
+
+        // Householder QR of an m x n row-major matrix into q (m x k) and r (k x n)
+        void qr_inplace(index_t m, index_t n, data_t* a, data_t* q, data_t* r) {
+            index_t k = std::min(m, n);
+            std::vector<data_t> tau(k), w(std::max(m, n));
+            for (index_t j = 0; j < k; ++j) {
+                data_t* col = a + (size_t)j * n + j;
+                data_t norm = std::sqrt(dot(m - j, col, n, col, n));
+                data_t alpha = col[0];
+                if (norm == 0) continue;
+                data_t beta = alpha >= 0 ? -norm : norm;
+                tau[j] = (beta - alpha) / beta;
+                data_t scale = 1 / (alpha - beta);
+                for (index_t i = 1; i < m - j; ++i) col[(size_t)i * n] *= scale;
+                col[0] = beta;
+                reflect(m - j, n - j - 1, col, n, tau[j], col + 1, n, w);
+            }
+            for (index_t i = 0; i < k; ++i)
+                for (index_t c = 0; c < n; ++c)
+                    r[(size_t)i * n + c] = c >= i ? a[(size_t)i * n + c] : 0;
+            std::fill(q, q + (size_t)m * k, 0);
+            for (index_t i = 0; i < k; ++i) q[(size_t)i * k + i] = 1;
+            for (index_t j = k; j-- > 0;)
+                reflect(m - j, k - j, a + (size_t)j * n + j, n, tau[j], q + (size_t)j * k + j, k, w);
+        }
+
+        // symmetric Householder reduction of v (n x n, row-major) to tridiagonal form, d gets
+        // the diagonal and e the off-diagonal, v the accumulated transformations
+        void tridiagonalise(index_t n, data_t* v, data_t* d, data_t* e) {
+            auto V = [&](index_t i, index_t j) -> data_t& { return v[(size_t)i * n + j]; };
+            for (index_t j = 0; j < n; ++j) d[j] = V(n-1, j);
+            for (index_t i = n - 1; i > 0; --i) {
+                data_t scale = 0, h = 0;
+                for (index_t k = 0; k < i; ++k) scale += std::abs(d[k]);
+                if (scale == 0) {
+                    e[i] = d[i-1];
+                    for (index_t j = 0; j < i; ++j) {
+                        d[j] = V(i-1, j);
+                        V(i, j) = 0;
+                        V(j, i) = 0;
+                    }
+                } else {
+                    for (index_t k = 0; k < i; ++k) {
+                        d[k] /= scale;
+                        h += d[k] * d[k];
+                    }
+                    data_t f = d[i-1];
+                    data_t g = f > 0 ? -std::sqrt(h) : std::sqrt(h);
+                    e[i] = scale * g;
+                    h -= f * g;
+                    d[i-1] = f - g;
+                    for (index_t j = 0; j < i; ++j) e[j] = 0;
+                    for (index_t j = 0; j < i; ++j) {
+                        f = d[j];
+                        V(j, i) = f;
+                        g = e[j] + V(j, j) * f;
+                        for (index_t k = j + 1; k < i; ++k) {
+                            g += V(k, j) * d[k];
+                            e[k] += V(k, j) * f;
+                        }
+                        e[j] = g;
+                    }
+                    f = 0;
+                    for (index_t j = 0; j < i; ++j) {
+                        e[j] /= h;
+                        f += e[j] * d[j];
+                    }
+                    data_t hh = f / (h + h);
+                    for (index_t j = 0; j < i; ++j) e[j] -= hh * d[j];
+                    for (index_t j = 0; j < i; ++j) {
+                        f = d[j];
+                        g = e[j];
+                        for (index_t k = j; k < i; ++k) V(k, j) -= f * e[k] + g * d[k];
+                        d[j] = V(i-1, j);
+                        V(i, j) = 0;
+                    }
+                }
+                d[i] = h;
+            }
+            for (index_t i = 0; i + 1 < n; ++i) {
+                V(n-1, i) = V(i, i);
+                V(i, i) = 1;
+                data_t h = d[i+1];
+                if (h != 0) {
+                    for (index_t k = 0; k <= i; ++k) d[k] = V(k, i+1) / h;
+                    for (index_t j = 0; j <= i; ++j) {
+                        data_t g = 0;
+                        for (index_t k = 0; k <= i; ++k) g += V(k, i+1) * V(k, j);
+                        for (index_t k = 0; k <= i; ++k) V(k, j) -= g * d[k];
+                    }
+                }
+                for (index_t k = 0; k <= i; ++k) V(k, i+1) = 0;
+            }
+            for (index_t j = 0; j < n; ++j) {
+                d[j] = V(n-1, j);
+                V(n-1, j) = 0;
+            }
+            V(n-1, n-1) = 1;
+            e[0] = 0;
+        }
+
+        // implicit QL iteration on the tridiagonal (d, e), rotating the columns of v along.
+        // eigenvalues end up ascending in d with their vectors in the columns of v
+        void tridiagonal_ql(index_t n, data_t* v, data_t* d, data_t* e) {
+            auto V = [&](index_t i, index_t j) -> data_t& { return v[(size_t)i * n + j]; };
+            for (index_t i = 1; i < n; ++i) e[i-1] = e[i];
+            e[n-1] = 0;
+            const data_t eps = std::ldexp(1.0, -52);
+            data_t f = 0, tst1 = 0;
+            for (index_t l = 0; l < n; ++l) {
+                tst1 = std::max(tst1, std::abs(d[l]) + std::abs(e[l]));
+                index_t m = l;
+                while (m < n && std::abs(e[m]) > eps * tst1) ++m;
+                if (m > l) {
+                    index_t iter = 0;
+                    do {
+                        CHECK_TRUE(++iter <= 60, "eigh(): the QL iteration failed to converge");
+                        data_t g = d[l];
+                        data_t p = (d[l+1] - g) / (2 * e[l]);
+                        data_t r = std::hypot(p, 1.0);
+                        if (p < 0) r = -r;
+                        d[l] = e[l] / (p + r);
+                        d[l+1] = e[l] * (p + r);
+                        data_t dl1 = d[l+1];
+                        data_t h = g - d[l];
+                        for (index_t i = l + 2; i < n; ++i) d[i] -= h;
+                        f += h;
+                        p = d[m];
+                        data_t c = 1, c2 = 1, c3 = 1, s = 0, s2 = 0;
+                        data_t el1 = e[l+1];
+                        for (index_t i = m; i-- > l;) {
+                            c3 = c2;
+                            c2 = c;
+                            s2 = s;
+                            g = c * e[i];
+                            h = c * p;
+                            r = std::hypot(p, e[i]);
+                            e[i+1] = s * r;
+                            s = e[i] / r;
+                            c = p / r;
+                            p = c * d[i] - s * g;
+                            d[i+1] = h + s * (c * g + s * d[i]);
+                            for (index_t k = 0; k < n; ++k) {
+                                h = V(k, i+1);
+                                V(k, i+1) = s * V(k, i) + c * h;
+                                V(k, i) = c * V(k, i) - s * h;
+                            }
+                        }
+                        p = -s * s2 * c3 * el1 * e[l] / dl1;
+                        e[l] = s * p;
+                        d[l] = c * p;
+                    } while (std::abs(e[l]) > eps * tst1);
+                }
+                d[l] += f;
+                e[l] = 0;
+            }
+            for (index_t i = 0; i + 1 < n; ++i) {
+                index_t k = std::min_element(d + i, d + n) - d;
+                if (k == i) continue;
+                std::swap(d[i], d[k]);
+                for (index_t j = 0; j < n; ++j) std::swap(V(j, i), V(j, k));
+            }
+        }
+
+        // thin SVD of a tall m x n row-major matrix (m >= n): a = q r, then one-sided Jacobi
+        // on r. u is m x n, s is n and vh is n x n
+        void svd_tall(index_t m, index_t n, data_t* a, data_t* u, data_t* s, data_t* vh) {
+            std::vector<data_t> q((size_t)m * n), r((size_t)n * n);
+            qr_inplace(m, n, a, q.data(), r.data());
+            // rows of g are the columns of r, rows of jt the accumulated rotations, i.e. v^T
+            std::vector<data_t> g((size_t)n * n), jt((size_t)n * n, 0);
+            for (index_t i = 0; i < n; ++i) {
+                for (index_t j = 0; j < n; ++j) g[(size_t)j * n + i] = r[(size_t)i * n + j];
+                jt[(size_t)i * n + i] = 1;
+            }
+            auto rotate = [&](data_t* x, data_t* y, data_t c, data_t sn) {
+                for (index_t k = 0; k < n; ++k) {
+                    data_t xk = x[k], yk = y[k];
+                    x[k] = c * xk - sn * yk;
+                    y[k] = sn * xk + c * yk;
+                }
+            };
+            const data_t eps = std::ldexp(1.0, -52);
+            bool rotated = true;
+            for (index_t sweep = 0; sweep < 60 && rotated; ++sweep) {
+                rotated = false;
+                for (index_t p = 0; p + 1 < n; ++p)
+                    for (index_t t = p + 1; t < n; ++t) {
+                        data_t* gp = g.data() + (size_t)p * n;
+                        data_t* gt = g.data() + (size_t)t * n;
+                        data_t alpha = dot(n, gp, 1, gp, 1), beta = dot(n, gt, 1, gt, 1);
+                        data_t gamma = dot(n, gp, 1, gt, 1);
+                        if (std::abs(gamma) <= eps * std::sqrt(alpha * beta)) continue;
+                        rotated = true;
+                        data_t zeta = (beta - alpha) / (2 * gamma);
+                        data_t tn = (zeta >= 0 ? 1 : -1) / (std::abs(zeta) + std::sqrt(1 + zeta * zeta));
+                        data_t c = 1 / std::sqrt(1 + tn * tn);
+                        rotate(gp, gt, c, c * tn);
+                        rotate(jt.data() + (size_t)p * n, jt.data() + (size_t)t * n, c, c * tn);
+                    }
+            }
+            std::vector<index_t> order(n);
+            std::vector<data_t> norm(n);
+            for (index_t j = 0; j < n; ++j) {
+                order[j] = j;
+                norm[j] = std::sqrt(dot(n, g.data() + (size_t)j * n, 1, g.data() + (size_t)j * n, 1));
+            }
+            std::stable_sort(order.begin(), order.end(), [&](index_t x, index_t y) { return norm[x] > norm[y]; });
+            // u_r has the normalised rows of g as its columns, u = q u_r
+            std::vector<data_t> ur((size_t)n * n);
+            for (index_t j = 0; j < n; ++j) {
+                index_t o = order[j];
+                s[j] = norm[o];
+                for (index_t i = 0; i < n; ++i) {
+                    ur[(size_t)i * n + j] = norm[o] == 0 ? 0 : g[(size_t)o * n + i] / norm[o];
+                    vh[(size_t)j * n + i] = jt[(size_t)o * n + i];
+                }
+            }
+            gemm(m, n, n, 1, q.data(), n, 1, ur.data(), n, 1, 0, u, n, 1);
+        }
+    }
+
+    LUFactor lu_factor(const Tensor& a) {
+        check_square(a, "lu_factor");
+        index_t n = a.size(a.n_dim()-1);
+        LUFactor res{dense_copy(a), {}};
+        index_t batch = count(batch_dims(a, 2));
+        res.pivots.resize((size_t)batch * n);
+        for_each_batch(batch, [&](index_t b) {
+            lu_inplace(n, res.lu.data() + (size_t)b * n * n, res.pivots.data() + (size_t)b * n);
+        });
+        return res;
+    }
+
+    Tensor lu_solve(const LUFactor& factor, const Tensor& b) {
+        const Tensor& lu = factor.lu;
+        Rhs rhs = check_rhs(lu, b, "lu_solve");
+        index_t n = rhs.rows, k = rhs.cols;
+        Tensor x = dense_copy(b);
+        for_each_batch(count(batch_dims(lu, 2)), [&](index_t bi) {
+            const data_t* a = lu.data() + (size_t)bi * n * n;
+            const index_t* piv = factor.pivots.data() + (size_t)bi * n;
+            data_t* xb = x.data() + (size_t)bi * n * k;
+            for (index_t i = 0; i < n; ++i) {
+                CHECK_TRUE(a[(size_t)i * n + i] != 0, "lu_solve(): the matrix is singular");
+                if (piv[i] != i) std::swap_ranges(xb + (size_t)i * k, xb + (size_t)(i + 1) * k, xb + (size_t)piv[i] * k);
+            }
+            trsm(false, true, n, k, a, n, 1, xb, k);
+            trsm(true, false, n, k, a, n, 1, xb, k);
+        });
+        return x;
+    }
+
+    Tensor cholesky(const Tensor& a) {
+        check_square(a, "cholesky");
+        index_t n = a.size(a.n_dim()-1);
+        Tensor res = dense_copy(a);
+        for_each_batch(count(batch_dims(a, 2)), [&](index_t bi) {
+            data_t* l = res.data() + (size_t)bi * n * n;
+            auto row = [&](index_t i) { return l + (size_t)i * n; };
+            // each block of columns is finished against its own columns only, the columns
+            // to its left were already subtracted by the trailing GEMM
+            for (index_t j0 = 0; j0 < n; j0 += NB) {
+                index_t j1 = std::min(n, j0 + NB);
+                for (index_t j = j0; j < j1; ++j) {
+                    data_t d = row(j)[j] - dot(j - j0, row(j) + j0, 1, row(j) + j0, 1);
+                    CHECK_TRUE(d > 0, "cholesky(): the matrix is not positive-definite (leading minor of order %d)", j + 1);
+                    d = std::sqrt(d);
+                    row(j)[j] = d;
+                    for (index_t i = j + 1; i < n; ++i)
+                        row(i)[j] = (row(i)[j] - dot(j - j0, row(i) + j0, 1, row(j) + j0, 1)) / d;
+                }
+                if (j1 < n)
+                    gemm(n - j1, n - j1, j1 - j0, -1, row(j1) + j0, n, 1, row(j1) + j0, 1, n,
+                         1, row(j1) + j1, n, 1);
+            }
+            for (index_t i = 0; i < n; ++i)
+                std::fill(row(i) + i + 1, row(i) + n, 0);
+        });
+        return res;
+    }
+
+    QRFactor qr(const Tensor& a) {
+        CHECK_TRUE(a.n_dim() >= 2, "qr() expects a tensor with at least 2 dims, but got %dD", a.n_dim());
+        index_t m = a.size(a.n_dim()-2), n = a.size(a.n_dim()-1), k = std::min(m, n);
+        std::vector<index_t> batch = batch_dims(a, 2);
+        Tensor work = dense_copy(a);
+        std::vector<index_t> q_dims = batch, r_dims = batch;
+        q_dims.insert(q_dims.end(), {m, k});
+        r_dims.insert(r_dims.end(), {k, n});
+        QRFactor res{Tensor(make_shape(q_dims)), Tensor(make_shape(r_dims))};
+        for_each_batch(count(batch), [&](index_t bi) {
+            qr_inplace(m, n, work.data() + (size_t)bi * m * n, res.q.data() + (size_t)bi * m * k,
+                       res.r.data() + (size_t)bi * k * n);
+        });
+        return res;
+    }
+
+    Tensor triangular_solve(const Tensor& a, const Tensor& b, bool upper, bool unitriangular) {
+        check_square(a, "triangular_solve");
+        Rhs rhs = check_rhs(a, b, "triangular_solve");
+        index_t n = rhs.rows, k = rhs.cols;
+        Tensor x = dense_copy(b);
+        // the triangle is read in place through its strides, only x is copied
+        index_t nd = a.n_dim();
+        std::vector<index_t> batch = batch_dims(a, 2);
+        for_each_batch(count(batch), [&](index_t bi) {
+            stride_t offset = 0;
+            for (index_t i = batch.size(), rest = bi; i-- > 0; rest /= batch[i])
+                offset += (stride_t)(rest % batch[i]) * a.stride()[i];
+            trsm(upper, unitriangular, n, k, a.data() + offset, a.stride()[nd-2], a.stride()[nd-1],
+                 x.data() + (size_t)bi * n * k, k);
+        });
+        return x;
+    }
+
+    Tensor solve(const Tensor& a, const Tensor& b) {
+        check_square(a, "solve");
+        check_rhs(a, b, "solve");
+        return lu_solve(lu_factor(a), b);
+    }
+
+    Tensor lstsq(const Tensor& a, const Tensor& b) {
+        CHECK_TRUE(a.n_dim() >= 2, "lstsq() expects a tensor with at least 2 dims, but got %dD", a.n_dim());
+        Rhs rhs = check_rhs(a, b, "lstsq");
+        index_t nd = a.n_dim(), m = a.size(nd-2), n = a.size(nd-1), p = rhs.cols;
+        std::vector<index_t> batch = batch_dims(a, 2);
+        std::vector<index_t> x_dims = batch;
+        x_dims.push_back(n);
+        if (!rhs.vector) x_dims.push_back(p);
+        Tensor x(make_shape(x_dims));
+        Tensor bd = dense_copy(b);
+
+        if (m >= n) {
+            // a = q r, so x = r^{-1} q^T b
+            QRFactor f = qr(a);
+            for_each_batch(count(batch), [&](index_t bi) {
+                const data_t* q = f.q.data() + (size_t)bi * m * n;
+                data_t* xb = x.data() + (size_t)bi * n * p;
+                gemm(n, p, m, 1, q, 1, n, bd.data() + (size_t)bi * m * p, p, 1, 0, xb, p, 1);
+                trsm(true, false, n, p, f.r.data() + (size_t)bi * n * n, n, 1, xb, p);
+            });
+        } else {
+            // a^T = q r, so a = r^T q^T and the minimum-norm solution is x = q r^{-T} b
+            QRFactor f = qr(a.transpose(nd-2, nd-1));
+            for_each_batch(count(batch), [&](index_t bi) {
+                data_t* y = bd.data() + (size_t)bi * m * p;
+                trsm(false, false, m, p, f.r.data() + (size_t)bi * m * m, 1, m, y, p);
+                gemm(n, p, m, 1, f.q.data() + (size_t)bi * n * m, m, 1, y, p, 1,
+                     0, x.data() + (size_t)bi * n * p, p, 1);
+            });
+        }
+        return x;
+    }
+
+    Tensor inv(const Tensor& a) {
+        check_square(a, "inv");
+        index_t n = a.size(a.n_dim()-1);
+        Tensor eye(a.size());
+        data_t* e = eye.data();
+        for (index_t bi = 0, batch = count(batch_dims(a, 2)); bi < batch; ++bi)
+            for (index_t i = 0; i < n; ++i)
+                e[(size_t)bi * n * n + (size_t)i * n + i] = 1;
+        return lu_solve(lu_factor(a), eye);
+    }
+
+    Tensor det(const Tensor& a) {
+        check_square(a, "det");
+        index_t n = a.size(a.n_dim()-1);
+        std::vector<index_t> batch = batch_dims(a, 2);
+        Tensor res(make_shape(batch));
+        Tensor work = dense_copy(a);
+        for_each_batch(count(batch), [&](index_t bi) {
+            std::vector<index_t> piv(n);
+            data_t* lu = work.data() + (size_t)bi * n * n;
+            data_t d = lu_inplace(n, lu, piv.data());
+            for (index_t i = 0; i < n; ++i) d *= lu[(size_t)i * n + i];
+            res.data()[bi] = d;
+        });
+        return res;
+    }
+
+    EighResult eigh(const Tensor& a) {
+        check_square(a, "eigh");
+        index_t nd = a.n_dim(), n = a.size(nd-1);
+        std::vector<index_t> batch = batch_dims(a, 2);
+        std::vector<index_t> value_dims = batch;
+        value_dims.push_back(n);
+        EighResult res{Tensor(make_shape(value_dims)), dense_copy(a)};
+        if (n == 0) return res;
+        for_each_batch(count(batch), [&](index_t bi) {
+            data_t* v = res.vectors.data() + (size_t)bi * n * n;
+            // the reduction reads the lower triangle, mirror it so the input can be either
+            for (index_t i = 0; i < n; ++i)
+                for (index_t j = i + 1; j < n; ++j)
+                    v[(size_t)i * n + j] = v[(size_t)j * n + i];
+            std::vector<data_t> e(n);
+            data_t* d = res.values.data() + (size_t)bi * n;
+            tridiagonalise(n, v, d, e.data());
+            tridiagonal_ql(n, v, d, e.data());
+        });
+        return res;
+    }
+
+    SVDResult svd(const Tensor& a, index_t rank) {
+        CHECK_TRUE(a.n_dim() >= 2, "svd() expects a tensor with at least 2 dims, but got %dD", a.n_dim());
+        index_t nd = a.n_dim(), m = a.size(nd-2), n = a.size(nd-1), k = std::min(m, n);
+        CHECK_IN_RANGE(rank, 0, k + 1, "svd() expects a rank in [0, %d], but got %d", k, rank);
+        // a wide matrix is decomposed through its transpose, a^T = u s vh gives a = vh^T s u^T
+        bool wide = m < n;
+        index_t tall_m = std::max(m, n);
+        std::vector<index_t> batch = batch_dims(a, 2);
+        Tensor work = dense_copy(wide ? a.transpose(nd-2, nd-1) : a);
+        std::vector<index_t> u_dims = batch, s_dims = batch, vh_dims = batch;
+        u_dims.insert(u_dims.end(), {m, k});
+        s_dims.push_back(k);
+        vh_dims.insert(vh_dims.end(), {k, n});
+        SVDResult res{Tensor(make_shape(u_dims)), Tensor(make_shape(s_dims)), Tensor(make_shape(vh_dims))};
+        for_each_batch(count(batch), [&](index_t bi) {
+            data_t* u = res.u.data() + (size_t)bi * m * k;
+            data_t* vh = res.vh.data() + (size_t)bi * k * n;
+            data_t* s = res.s.data() + (size_t)bi * k;
+            data_t* w = work.data() + (size_t)bi * m * n;
+            if (!wide) {
+                svd_tall(m, n, w, u, s, vh);
+                return;
+            }
+            std::vector<data_t> ut((size_t)tall_m * k), vht((size_t)k * k);
+            svd_tall(tall_m, k, w, ut.data(), s, vht.data());
+            for (index_t i = 0; i < m; ++i)
+                for (index_t j = 0; j < k; ++j)
+                    u[(size_t)i * k + j] = vht[(size_t)j * k + i];
+            for (index_t i = 0; i < k; ++i)
+                for (index_t j = 0; j < n; ++j)
+                    vh[(size_t)i * n + j] = ut[(size_t)j * k + i];
+        });
+        if (rank == 0 || rank == k) return res;
+        return {dense_copy(res.u.slice(0, rank, nd-1)), dense_copy(res.s.slice(0, rank, nd-2)),
+                dense_copy(res.vh.slice(0, rank, nd-2))};
+    }
+
+    SVDResult svd_lowrank(const Tensor& a, index_t rank, index_t n_oversamples, index_t n_iter) {
+        CHECK_TRUE(a.n_dim() == 2, "svd_lowrank() expects a 2D tensor, but got %dD", a.n_dim());
+        index_t m = a.size(0), n = a.size(1), k = std::min(m, n);
+        CHECK_IN_RANGE(rank, 1, k + 1, "svd_lowrank() expects a rank in [1, %d], but got %d", k, rank);
+        index_t l = std::min(k, rank + n_oversamples);
+        Tensor at = a.transpose(0, 1);
+        // orthonormal basis of the sketch a * omega, sharpened by power iterations that
+        // re-orthonormalise after every product to keep small singular values from vanishing
+        Tensor y = matmul(a, Tensor::randn(Shape({n, l})));
+        for (index_t it = 0; it < n_iter; ++it) {
+            Tensor z = matmul(at, qr(y).q);
+            y = matmul(a, qr(z).q);
+        }
+        Tensor q = qr(y).q;
+        Tensor b = matmul(q.transpose(0, 1), a);
+        SVDResult small = svd(b, rank);
+        return {matmul(q, small.u), small.s, small.vh};
+    }
+} // st
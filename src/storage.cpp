@@ -3,19 +3,27 @@
 #include <cstring>
 
 namespace st {
-    Storage::Storage(index_t size) :
-            size_(size), b_ptr(Alloc::shared_allocate<Data>(size*sizeof(data_t)+sizeof(index_t))), f_ptr(b_ptr->data_) {}
-    Storage::Storage(const Storage &other, index_t offset) :
+    template<typename T>
+    BasicStorage<T>::BasicStorage(index_t size) :
+            size_(size), b_ptr(Alloc::shared_allocate<Data>(size*sizeof(T)+sizeof(Data))), f_ptr(b_ptr->data_) {}
+    template<typename T>
+    BasicStorage<T>::BasicStorage(const BasicStorage &other, stride_t offset) :
             size_(other.size_), b_ptr(other.b_ptr), f_ptr(other.f_ptr+offset) {}
-    Storage::Storage(index_t size, data_t value) : Storage(size) {
+    template<typename T>
+    BasicStorage<T>::BasicStorage(index_t size, T value) : BasicStorage(size) {
         for (int i = 0; i < size; ++i)
             *(f_ptr+i) = value;
     }
-    Storage::Storage(const data_t* data, index_t size) : Storage(size) {
-        std::memcpy(f_ptr, data, size*sizeof(data_t));
+    template<typename T>
+    BasicStorage<T>::BasicStorage(const T* data, index_t size) : BasicStorage(size) {
+        std::memcpy(f_ptr, data, size*sizeof(T));
     }
 
-    Storage::Storage(const std::initializer_list<data_t> &list) : Storage(list.size()) {
-        std::memcpy(f_ptr, list.begin(), size_*sizeof(data_t));
+    template<typename T>
+    BasicStorage<T>::BasicStorage(const std::initializer_list<T> &list) : BasicStorage(list.size()) {
+        std::memcpy(f_ptr, list.begin(), size_*sizeof(T));
     }
-} // SimpleTensor
\ No newline at end of file
+
+    template class BasicStorage<data_t>;
+    template class BasicStorage<bool_t>;
+} // SimpleTensor
@@ -6,17 +6,17 @@
 namespace st
 {
 	//constructors
-	Tensor::Tensor(const Storage& storage, const Shape& shape, const IndexArray& stride) :
-		Exp<TensorImpl>(Alloc::unique_construct<TensorImpl>(storage, shape, stride)) {}
+	Tensor::Tensor(const Storage& storage, const Shape& shape, const StrideArray& stride) :
+		impl_ptr(Alloc::unique_construct<TensorImpl>(storage, shape, stride)) {}
 	Tensor::Tensor(const Storage& storage, const Shape& shape) :
-		Exp<TensorImpl>(Alloc::unique_construct<TensorImpl>(storage, shape)) {}
+		impl_ptr(Alloc::unique_construct<TensorImpl>(storage, shape)) {}
 	Tensor::Tensor(const Shape& shape) :
-        Exp<TensorImpl>(Alloc::unique_construct<TensorImpl>(shape)) {}
+        impl_ptr(Alloc::unique_construct<TensorImpl>(shape)) {}
 	Tensor::Tensor(const data_t* data, const Shape& shape) :
-        Exp<TensorImpl>(Alloc::unique_construct<TensorImpl>(data, shape)) {}
-	Tensor::Tensor(Storage&& storage, Shape&& shape, IndexArray&& stride) :
-        Exp<TensorImpl>(Alloc::unique_construct<TensorImpl>(std::move(storage), std::move(shape), std::move(stride))) {}
-	Tensor::Tensor(Alloc::NonTrivalUniquePtr<TensorImpl>&& ptr) : Exp<TensorImpl>(std::move(ptr)) {}
+        impl_ptr(Alloc::unique_construct<TensorImpl>(data, shape)) {}
+	Tensor::Tensor(Storage&& storage, Shape&& shape, StrideArray&& stride) :
+        impl_ptr(Alloc::unique_construct<TensorImpl>(std::move(storage), std::move(shape), std::move(stride))) {}
+	Tensor::Tensor(Alloc::NonTrivalUniquePtr<TensorImpl>&& ptr) : impl_ptr(std::move(ptr)) {}
 
 	//operations
 	bool Tensor::is_contiguous() { return impl_ptr->is_contiguous(); }
@@ -33,6 +33,22 @@ namespace st
 	{
 		return Tensor(impl_ptr->slice(start, end, dim));
 	}
+	Tensor Tensor::slice(const std::vector<Slice>& slices) const
+	{
+		return Tensor(impl_ptr->slice(slices));
+	}
+	Tensor Tensor::narrow(index_t dim, index_t start, index_t length) const
+	{
+		return Tensor(impl_ptr->narrow(dim, start, length));
+	}
+	Tensor Tensor::select(index_t dim, index_t idx) const
+	{
+		return Tensor(impl_ptr->select(dim, idx));
+	}
+	Tensor Tensor::unfold(index_t dim, index_t size, index_t step) const
+	{
+		return Tensor(impl_ptr->unfold(dim, size, step));
+	}
 	Tensor Tensor::view(const Shape& shape) const
 	{
 		return Tensor(impl_ptr->view(shape));
@@ -48,6 +64,88 @@ namespace st
     Tensor Tensor::sum(int idx) const {
         return Tensor(impl_ptr->sum(idx));
     }
+	Tensor Tensor::expand(const Shape& shape) const
+	{
+		return Tensor(impl_ptr->expand(shape));
+	}
+	Tensor Tensor::broadcast_to(const Shape& shape) const
+	{
+		return Tensor(impl_ptr->expand(shape));
+	}
+	Tensor Tensor::unsqueeze(index_t dim) const
+	{
+		return Tensor(impl_ptr->unsqueeze(dim));
+	}
+	Tensor Tensor::squeeze() const
+	{
+		return Tensor(impl_ptr->squeeze());
+	}
+	Tensor Tensor::squeeze(index_t dim) const
+	{
+		return Tensor(impl_ptr->squeeze(dim));
+	}
+	Tensor Tensor::flatten(index_t start_dim) const
+	{
+		return Tensor(impl_ptr->flatten(start_dim, n_dim()-1));
+	}
+	Tensor Tensor::flatten(index_t start_dim, index_t end_dim) const
+	{
+		return Tensor(impl_ptr->flatten(start_dim, end_dim));
+	}
+	Tensor Tensor::contiguous() const
+	{
+		return Tensor(impl_ptr->contiguous());
+	}
+	std::vector<Tensor> Tensor::split(index_t split_size, index_t dim) const
+	{
+		std::vector<Tensor> res;
+		for (auto& ptr : impl_ptr->split(split_size, dim))
+			res.emplace_back(std::move(ptr));
+		return res;
+	}
+	std::vector<Tensor> Tensor::chunk(index_t chunks, index_t dim) const
+	{
+		std::vector<Tensor> res;
+		for (auto& ptr : impl_ptr->chunk(chunks, dim))
+			res.emplace_back(std::move(ptr));
+		return res;
+	}
+	Tensor Tensor::index_select(index_t dim, const Tensor& index) const
+	{
+		return Tensor(impl_ptr->index_select(dim, *index.impl_ptr));
+	}
+	Tensor Tensor::gather(index_t dim, const Tensor& index) const
+	{
+		return Tensor(impl_ptr->gather(dim, *index.impl_ptr));
+	}
+	Tensor Tensor::masked_select(const Tensor& mask) const
+	{
+		return Tensor(impl_ptr->masked_select(*mask.impl_ptr));
+	}
+	Tensor Tensor::masked_select(const BoolTensor& mask) const
+	{
+		return Tensor(impl_ptr->masked_select(*mask.ptr()));
+	}
+	Tensor& Tensor::masked_fill(const BoolTensor& mask, data_t value)
+	{
+		impl_ptr->masked_fill(*mask.ptr(), value);
+		return *this;
+	}
+	Tensor& Tensor::scatter(index_t dim, const Tensor& index, const Tensor& src)
+	{
+		impl_ptr->scatter(dim, *index.impl_ptr, *src.impl_ptr);
+		return *this;
+	}
+	Tensor& Tensor::scatter_add(index_t dim, const Tensor& index, const Tensor& src)
+	{
+		impl_ptr->scatter_add(dim, *index.impl_ptr, *src.impl_ptr);
+		return *this;
+	}
+	Tensor& Tensor::masked_fill(const Tensor& mask, data_t value)
+	{
+		impl_ptr->masked_fill(*mask.impl_ptr, value);
+		return *this;
+	}
 	std::ostream& operator<<(std::ostream& out, const Tensor& tensor)
 	{
 		out << *tensor.impl_ptr;
@@ -61,7 +159,7 @@ namespace st
         CHECK_EQUAL(idx.size(), tensor->n_dim(), "Index size not match.");
 		_tensor = tensor;
         for (index_t i = 0; i < idx.size(); ++i) {
-            CHECK_IN_RANGE(i, 0, tensor->size()[i], "Index out of range.");
+            CHECK_IN_RANGE(idx[i], 0, tensor->size()[i]+1, "Index out of range.");
             _idx.push_back(idx[i]);
         }
 	}
@@ -159,10 +257,10 @@ namespace st
 	{
         CHECK_EQUAL(_idx.size(), _tensor->n_dim(), "Index size not match.");
         CHECK_TRUE(*this != _tensor->end(), "Iterator out of range.");
-		index_t idx = 0;
+		stride_t idx = 0;
 		for (int i = 0; i < _idx.size(); ++i)
 		{
-			idx += _idx[i] * _tensor->impl_ptr->stride()[i];
+			idx += (stride_t)_idx[i] * _tensor->impl_ptr->stride()[i];
 		}
 		return _tensor->impl_ptr->item(idx);
 	}
@@ -180,7 +278,7 @@ namespace st
         CHECK_EQUAL(idx.size(), tensor->n_dim(), "Index size not match.");
 		_tensor = tensor;
 		for (index_t i = 0; i < idx.size(); ++i) {
-            CHECK_IN_RANGE(i, 0, tensor->size()[i], "Index out of range.");
+            CHECK_IN_RANGE(idx[i], 0, tensor->size()[i]+1, "Index out of range.");
             _idx.push_back(idx[i]);
         }
 	}
@@ -277,10 +375,10 @@ namespace st
 	{
         CHECK_EQUAL(_idx.size(), _tensor->n_dim(), "Index size not match.");
         CHECK_TRUE(*this != _tensor->end(), "Iterator out of range.");
-        index_t idx = 0;
+        stride_t idx = 0;
 		for (int i = 0; i < _idx.size(); ++i)
 		{
-			idx += _idx[i] * _tensor->impl_ptr->stride()[i];
+			idx += (stride_t)_idx[i] * _tensor->impl_ptr->stride()[i];
 		}
 		return _tensor->impl_ptr->item(idx);
 	}
@@ -323,6 +421,23 @@ namespace st
 		return const_iterator(this, idx);
 	}
 
+	Tensor& Tensor::operator+=(data_t value)
+	{
+		return compound<op::Add>(ScalarExp(value));
+	}
+	Tensor& Tensor::operator-=(data_t value)
+	{
+		return compound<op::Sub>(ScalarExp(value));
+	}
+	Tensor& Tensor::operator*=(data_t value)
+	{
+		return compound<op::Mul>(ScalarExp(value));
+	}
+	Tensor& Tensor::operator/=(data_t value)
+	{
+		return compound<op::Div>(ScalarExp(value));
+	}
+
 	data_t Tensor::eval(IndexArray idx) const
 	{
         return impl_ptr->eval(idx);
@@ -360,4 +475,15 @@ namespace st
         return Tensor(Alloc::unique_construct<TensorImpl>(TensorMaker::randn_like(*(tensor.impl_ptr))));
     }
 
+    Tensor cat(const std::vector<Tensor>& tensors, index_t dim) {
+        std::vector<const TensorImpl*> impls;
+        for (auto& t : tensors) impls.push_back(t.ptr().get());
+        return Tensor(Alloc::unique_construct<TensorImpl>(TensorMaker::cat(impls, dim)));
+    }
+    Tensor stack(const std::vector<Tensor>& tensors, index_t dim) {
+        std::vector<const TensorImpl*> impls;
+        for (auto& t : tensors) impls.push_back(t.ptr().get());
+        return Tensor(Alloc::unique_construct<TensorImpl>(TensorMaker::stack(impls, dim)));
+    }
+
 } // SimpleTensor
\ No newline at end of file
@@ -1,46 +1,94 @@
 #include "tensor_impl.h"
 #include "exception.h"
+#include "parallel.h"
 #include <memory>
 #include <cmath>
 #include <iomanip>
 #include <random>
 #include <ctime>
+#include <atomic>
 
 #define debug printf("%d %s\n", __LINE__, __FUNCTION__)
 
 namespace st {
+    namespace {
+        // offset of the j-th position (row-major) over dims [0, dim)
+        stride_t outer_offset(const Shape& shape, const StrideArray& stride, index_t j, index_t dim) {
+            stride_t base = 0;
+            for (int i = (int)dim-1; i >= 0; --i) {
+                base += (stride_t)(j % shape[i]) * stride[i];
+                j /= shape[i];
+            }
+            return base;
+        }
+
+        // copy dims [dim, n) of the block starting at ptr into dst in row-major order
+        void copy_inner(const data_t* ptr, const Shape& shape, const StrideArray& stride, index_t dim, data_t* dst) {
+            index_t n = shape.n_dim();
+            if (dim >= n) {
+                *dst = *ptr;
+                return;
+            }
+            index_t inner = shape.sub_size(dim);
+            index_t last = shape[n-1];
+            stride_t step = stride[n-1];
+            std::vector<index_t> idx(n, 0);
+            for (index_t cnt = 0; cnt < inner; cnt += last) {
+                stride_t offset = 0;
+                for (index_t i = dim; i+1 < n; ++i)
+                    offset += (stride_t)idx[i] * stride[i];
+                for (index_t t = 0; t < last; ++t)
+                    *dst++ = ptr[offset + (stride_t)t*step];
+                for (int i = (int)n-2; i >= (int)dim; --i) {
+                    if (idx[i]+1 < shape[i]) { ++idx[i]; break; }
+                    idx[i] = 0;
+                }
+            }
+        }
+
+        // whether dims [dim, n) are laid out densely in row-major order
+        bool dense_inner(const Shape& shape, const StrideArray& stride, index_t dim) {
+            stride_t expect = 1;
+            for (int i = (int)shape.n_dim()-1; i >= (int)dim; --i) {
+                if (shape[i] == 1) continue;
+                if (stride[i] != expect) return false;
+                expect *= (stride_t)shape[i];
+            }
+            return true;
+        }
+
+        // read an integral index stored in a data_t tensor, -1 if it is not in [0, bound)
+        inline stride_t to_index(data_t value, index_t bound) {
+            // range check before the cast, converting NaN, inf or a huge value is undefined
+            if (!std::isfinite(value) || value < 0 || value >= (data_t)bound) return -1;
+            auto v = (stride_t)value;
+            if ((data_t)v != value) return -1;
+            return v;
+        }
+
+        inline void prefetch(const void* ptr) {
+#if defined(__GNUC__)
+            __builtin_prefetch(ptr);
+#endif
+        }
+    }
+
     // constructor
-    TensorImpl::TensorImpl(const Storage& storage, const Shape& shape, const IndexArray& stride) :
+    TensorImpl::TensorImpl(const Storage& storage, const Shape& shape, const StrideArray& stride) :
         _storage(storage), _shape(shape), _stride(stride) {}
     TensorImpl::TensorImpl(const Storage& storage, const Shape& shape) :
-        _storage(storage), _shape(shape), _stride(shape.n_dim()){
-        for (int i = 0; i < shape.n_dim(); ++i) {
-            if (i == shape.n_dim()-1) _stride[i] = 1;
-            else _stride[i] = shape.sub_size(i+1);
-            if (shape[i] == 1) _stride[i] = 0;
-        }
-    }
+        _storage(storage), _shape(shape), _stride(contiguous_stride(shape)) {}
     TensorImpl::TensorImpl(const Shape& shape) :
-        _storage(shape.d_size()), _shape(shape), _stride(shape.n_dim()) {
+        _storage(shape.d_size()), _shape(shape), _stride(contiguous_stride(shape)) {
         for (int i = 0; i < shape.d_size(); ++i)
             _storage[i] = 0;
-        for (int i = 0; i < shape.n_dim(); ++i) {
-            if (i == shape.n_dim()-1) _stride[i] = 1;
-            else _stride[i] = shape.sub_size(i+1);
-            if (shape[i] == 1) _stride[i] = 0;
-        }
     }
     TensorImpl::TensorImpl(const data_t* data, const Shape& shape) :
-        _storage(shape.d_size()), _shape(shape), _stride(shape.n_dim()) {
+        _storage(shape.d_size()), _shape(shape), _stride(contiguous_stride(shape)) {
         for (int i = 0; i < shape.d_size(); ++i)
             _storage[i] = data[i];
-        for (int i = 0; i < shape.n_dim(); ++i) {
-            if (i == shape.n_dim()-1) _stride[i] = 1;
-            else _stride[i] = shape.sub_size(i+1);
-            if (shape[i] == 1) _stride[i] = 0;
-        }
     }
-    TensorImpl::TensorImpl(Storage&& storage, Shape&& shape, IndexArray&& stride) :
+    TensorImpl::TensorImpl(Storage&& storage, Shape&& shape, StrideArray&& stride) :
         _storage(std::move(storage)), _shape(std::move(shape)), _stride(std::move(stride)) {}
 
     // method
@@ -48,21 +96,62 @@ namespace st {
 	{
         for (int i = 0; i < n_dim()-1; ++i) {
             if (_shape[i] == 1) continue;
-            if (_stride[i] != _shape.sub_size(i+1)) return false;
+            if (_stride[i] != (stride_t)_shape.sub_size(i+1)) return false;
         }
         if (_shape[n_dim()-1] != 1 && _stride[n_dim()-1] != 1) return false;
         return true;
     }
 
+    bool TensorImpl::has_internal_overlap() const {
+        // sort the non-trivial dims by stride, each stride must jump over
+        // everything the smaller dims can reach, otherwise two indices may alias
+        std::vector<std::pair<stride_t, index_t>> dims;
+        for (index_t i = 0; i < n_dim(); ++i) {
+            if (_shape[i] == 1) continue;
+            if (_stride[i] == 0) return true;
+            dims.emplace_back(std::abs(_stride[i]), _shape[i]);
+        }
+        std::sort(dims.begin(), dims.end());
+        stride_t reach = 0;
+        for (auto& [stride, size] : dims) {
+            if (stride <= reach) return true;
+            reach += stride * ((stride_t)size-1);
+        }
+        return false;
+    }
+
+    bool TensorImpl::overlaps(const TensorImpl& src, bool pointwise) const {
+        if (!_storage.shares_with(src._storage)) return false;
+        // views of disjoint parts of one buffer, e.g. slices of an arena, can't clobber each other
+        auto extent = [](const TensorImpl& t) {
+            const data_t* lo = t.data();
+            const data_t* hi = t.data();
+            for (index_t i = 0; i < t.n_dim(); ++i) {
+                stride_t span = (stride_t)(t._shape[i] - 1) * t._stride[i];
+                (span < 0 ? lo : hi) += span;
+            }
+            return std::make_pair(lo, hi);
+        };
+        if (d_size() == 0 || src.d_size() == 0) return false;
+        auto [lo, hi] = extent(*this);
+        auto [src_lo, src_hi] = extent(src);
+        if (hi < src_lo || src_hi < lo) return false;
+        if (!pointwise || data() != src.data() || !(_shape == src._shape)) return true;
+        for (index_t i = 0; i < n_dim(); ++i)
+            if (_stride[i] != src._stride[i]) return true;
+        return false;
+    }
+
     data_t& TensorImpl::operator[](std::initializer_list<index_t> dims) {
 		CHECK_EQUAL(n_dim(), dims.size(),
 				"Invalid %zuD indices for %dD tensor", dims.size(), n_dim());
-        index_t index = 0, dim = 0;
+        stride_t index = 0;
+        index_t dim = 0;
         for (auto v : dims) {
             CHECK_IN_RANGE(v, 0, size(dim),
                            "Index out of range (expected to be in range of [0, %d), but got %d)",
                            size(dim), v);
-            index += v*_stride[dim];
+            index += (stride_t)v*_stride[dim];
             ++dim;
         }
         return _storage[index];
@@ -70,13 +159,14 @@ namespace st {
     data_t TensorImpl::operator[](std::initializer_list<index_t> dims) const {
 		CHECK_EQUAL(n_dim(), dims.size(),
 			"Invalid %zuD indices for %dD tensor", dims.size(), n_dim());
-        index_t index = 0, dim = 0;
+        stride_t index = 0;
+        index_t dim = 0;
         for (auto v : dims) {
             std::cout << v << " ";
             CHECK_IN_RANGE(v, 0, size(dim),
                            "Index out of range (expected to be in range of [0, %d), but got %d)",
                            size(dim), v);
-            index += v*_stride[dim];
+            index += (stride_t)v*_stride[dim];
             ++dim;
         }
         std::cout << std::endl;
@@ -89,22 +179,22 @@ namespace st {
         return _storage[0];
     }
 
-   data_t TensorImpl::item(index_t idx) const {
+   data_t TensorImpl::item(stride_t idx) const {
         return _storage[idx];
 	}
 
-	data_t& TensorImpl::item(index_t idx)
+	data_t& TensorImpl::item(stride_t idx)
 	{
 		return _storage[idx];
 	}
 	data_t TensorImpl::eval(IndexArray idx) const {
-        int index = 0;
+        stride_t index = 0;
         if (idx.size() >= _shape.n_dim()) {
             for (int i = idx.size() - n_dim(); i < idx.size(); ++i)
-                index += idx[i]*_stride[i-(idx.size()-n_dim())];
+                index += (stride_t)idx[i]*_stride[i-(idx.size()-n_dim())];
         } else {
             for (int i = 0; i < idx.size(); ++i)
-                index += idx[i]*_stride[i+(n_dim()-idx.size())];
+                index += (stride_t)idx[i]*_stride[i+(n_dim()-idx.size())];
         }
         return item(index);
     }
@@ -119,7 +209,7 @@ namespace st {
 			idx, dim, size(dim));
         Alloc::NonTrivalUniquePtr<TensorImpl> ptr;
         ptr = Alloc::unique_construct<TensorImpl>(
-                Storage(_storage, offset() + _stride[dim] * idx),
+                Storage(_storage, _stride[dim] * (stride_t)idx),
                 _shape, _stride);
         ptr->_shape[dim] = 1;
         ptr->_stride[dim] = 0;
@@ -141,12 +231,101 @@ namespace st {
                    "slice() expects the start index must be smaller than the end index");
         Alloc::NonTrivalUniquePtr<TensorImpl> ptr;
         ptr = Alloc::unique_construct<TensorImpl>(
-                Storage(_storage, offset() + start_idx * _stride[dim]),
+                Storage(_storage, (stride_t)start_idx * _stride[dim]),
                 _shape, _stride);
         ptr->_shape[dim] = end_idx-start_idx;
+        if (end_idx-start_idx == 1) ptr->_stride[dim] = 0;
         return ptr;
     }
 
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::slice(const std::vector<Slice>& slices) const {
+        CHECK_TRUE(slices.size() <= n_dim(),
+            "Too many indices for tensor of dimension %d (got %zu)", n_dim(), slices.size());
+        Shape shape(_shape);
+        StrideArray stride(_stride);
+        stride_t offset = 0;
+        for (index_t dim = 0; dim < slices.size(); ++dim) {
+            const Slice& s = slices[dim];
+            stride_t len = _shape[dim];
+            CHECK_TRUE(s.step != 0, "slice step cannot be zero");
+            stride_t start = s.start, stop = s.stop, count;
+            if (s.step > 0) {
+                if (start == Slice::none) start = 0;
+                else if (start < 0) start += len;
+                if (stop == Slice::none) stop = len;
+                else if (stop < 0) stop += len;
+                start = std::clamp(start, 0, len);
+                stop = std::clamp(stop, 0, len);
+                count = stop > start ? (stop-start+s.step-1) / s.step : 0;
+            } else {
+                // a stop of -1 (after normalization) means "run past index 0"
+                if (start == Slice::none) start = len-1;
+                else if (start < 0) start += len;
+                if (stop == Slice::none) stop = -1;
+                else if (stop < 0) stop += len;
+                start = std::clamp(start, -1, len-1);
+                stop = std::clamp(stop, -1, len-1);
+                count = start > stop ? (start-stop-s.step-1) / (-s.step) : 0;
+            }
+            CHECK_TRUE(count > 0,
+                "slice() got an empty range on dimension %d", dim);
+            offset += start * _stride[dim];
+            shape[dim] = count;
+            stride[dim] = count == 1 ? 0 : _stride[dim] * s.step;
+        }
+        return Alloc::unique_construct<TensorImpl>(
+                Storage(_storage, offset), std::move(shape), std::move(stride));
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::narrow(index_t dim, index_t start, index_t length) const {
+        CHECK_IN_RANGE(dim, 0, n_dim(),
+            "Dimension out of range (expected to be in range of [0, %d), but got %d)",
+            n_dim(), dim);
+        CHECK_TRUE(length > 0 && start + length <= size(dim),
+            "start (%d) + length (%d) exceeds dimension size (%d)", start, length, size(dim));
+        return slice(start, start+length, dim);
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::select(index_t dim, index_t idx) const {
+        CHECK_IN_RANGE(dim, 0, n_dim(),
+            "Dimension out of range (expected to be in range of [0, %d), but got %d)",
+            n_dim(), dim);
+        CHECK_IN_RANGE(idx, 0, size(dim),
+            "Index %d is out of bound for dimension %d with size %d",
+            idx, dim, size(dim));
+        CHECK_TRUE(n_dim() > 1, "select() cannot be applied to a 1D tensor");
+        StrideArray stride(n_dim()-1);
+        for (index_t i = 0, j = 0; i < n_dim(); ++i)
+            if (i != dim) stride[j++] = _stride[i];
+        return Alloc::unique_construct<TensorImpl>(
+                Storage(_storage, (stride_t)idx * _stride[dim]), Shape(_shape, dim), std::move(stride));
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::unfold(index_t dim, index_t size, index_t step) const {
+        CHECK_IN_RANGE(dim, 0, n_dim(),
+            "Dimension out of range (expected to be in range of [0, %d), but got %d)",
+            n_dim(), dim);
+        CHECK_TRUE(size > 0 && size <= _shape[dim],
+            "Maximum size for tensor at dimension %d is %d but size is %d", dim, _shape[dim], size);
+        CHECK_TRUE(step > 0, "Step is %d but must be > 0", step);
+        IndexArray shape(n_dim()+1);
+        StrideArray stride(n_dim()+1);
+        for (index_t i = 0; i < n_dim(); ++i) {
+            shape[i] = _shape[i];
+            stride[i] = _stride[i];
+        }
+        shape[dim] = (_shape[dim]-size) / step + 1;
+        stride[dim] = shape[dim] == 1 ? 0 : _stride[dim] * (stride_t)step;
+        shape[n_dim()] = size;
+        stride[n_dim()] = size == 1 ? 0 : _stride[dim];
+        return Alloc::unique_construct<TensorImpl>(
+                Storage(_storage, 0), Shape(std::move(shape)), std::move(stride));
+    }
+
     Alloc::NonTrivalUniquePtr<TensorImpl>
     TensorImpl::transpose(index_t dim1, index_t dim2) const {
 		CHECK_IN_RANGE(dim1, 0, n_dim(),
@@ -234,14 +413,359 @@ namespace st {
         return ptr;
     }
 
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::expand(const Shape& shape) const {
+        return Alloc::unique_construct<TensorImpl>(Storage(_storage, 0), Shape(shape),
+                                                   expand_stride(_shape, _stride, shape));
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::unsqueeze(index_t dim) const {
+        CHECK_IN_RANGE(dim, 0, n_dim()+1,
+            "Dimension out of range (expected to be in range of [0, %d], but got %d)",
+            n_dim(), dim);
+        IndexArray shape(n_dim()+1);
+        StrideArray stride(n_dim()+1);
+        for (index_t i = 0, j = 0; i <= n_dim(); ++i) {
+            if (i == dim) {
+                shape[i] = 1;
+                stride[i] = 0;
+            } else {
+                shape[i] = _shape[j];
+                stride[i] = _stride[j];
+                ++j;
+            }
+        }
+        return Alloc::unique_construct<TensorImpl>(Storage(_storage, 0), Shape(std::move(shape)), std::move(stride));
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::squeeze() const {
+        index_t n = 0;
+        for (index_t i = 0; i < n_dim(); ++i)
+            if (_shape[i] != 1) ++n;
+        // keep at least one dimension, a tensor here always has n_dim() >= 1
+        IndexArray shape(std::max(n, 1u));
+        StrideArray stride(std::max(n, 1u));
+        shape[0] = 1;
+        stride[0] = 0;
+        for (index_t i = 0, j = 0; i < n_dim(); ++i) {
+            if (_shape[i] == 1) continue;
+            shape[j] = _shape[i];
+            stride[j] = _stride[i];
+            ++j;
+        }
+        return Alloc::unique_construct<TensorImpl>(Storage(_storage, 0), Shape(std::move(shape)), std::move(stride));
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::squeeze(index_t dim) const {
+        CHECK_IN_RANGE(dim, 0, n_dim(),
+            "Dimension out of range (expected to be in range of [0, %d), but got %d)",
+            n_dim(), dim);
+        if (_shape[dim] != 1 || n_dim() == 1)
+            return Alloc::unique_construct<TensorImpl>(_storage, _shape, _stride);
+        StrideArray stride(n_dim()-1);
+        for (index_t i = 0, j = 0; i < n_dim(); ++i)
+            if (i != dim) stride[j++] = _stride[i];
+        return Alloc::unique_construct<TensorImpl>(Storage(_storage, 0), Shape(_shape, dim), std::move(stride));
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::flatten(index_t start_dim, index_t end_dim) const {
+        CHECK_TRUE(start_dim <= end_dim && end_dim < n_dim(),
+            "flatten() has invalid args: start_dim (%d), end_dim (%d) for %dD tensor",
+            start_dim, end_dim, n_dim());
+        // dims can be merged without a copy when each one steps exactly over the next
+        bool mergeable = true, found = false;
+        stride_t inner = 0, expect = 0;
+        for (int i = (int)end_dim; i >= (int)start_dim; --i) {
+            if (_shape[i] == 1) continue;
+            if (!found) {
+                inner = _stride[i];
+                found = true;
+            } else if (_stride[i] != expect) {
+                mergeable = false;
+                break;
+            }
+            expect = _stride[i] * (stride_t)_shape[i];
+        }
+        if (!mergeable)
+            return contiguous()->flatten(start_dim, end_dim);
+        IndexArray shape(n_dim() - (end_dim-start_dim));
+        StrideArray stride(n_dim() - (end_dim-start_dim));
+        for (index_t i = 0, j = 0; i < n_dim(); ++i) {
+            if (i > start_dim && i <= end_dim) continue;
+            shape[j] = i == start_dim ? _shape.sub_size(start_dim, end_dim+1) : _shape[i];
+            stride[j] = i == start_dim ? inner : _stride[i];
+            if (shape[j] == 1) stride[j] = 0;
+            ++j;
+        }
+        return Alloc::unique_construct<TensorImpl>(Storage(_storage, 0), Shape(std::move(shape)), std::move(stride));
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::contiguous() const {
+        if (is_contiguous())
+            return Alloc::unique_construct<TensorImpl>(_storage, _shape, _stride);
+        Alloc::NonTrivalUniquePtr<TensorImpl> ptr;
+        ptr = Alloc::unique_construct<TensorImpl>(_shape);
+        std::vector<index_t> idx(n_dim(), 0);
+        for (index_t cnt = 0; cnt < d_size(); ++cnt) {
+            stride_t offset = 0;
+            for (index_t i = 0; i < n_dim(); ++i)
+                offset += (stride_t)idx[i] * _stride[i];
+            ptr->item(cnt) = item(offset);
+            for (int i = (int)n_dim()-1; i >= 0; --i) {
+                if (idx[i]+1 < _shape[i]) { ++idx[i]; break; }
+                idx[i] = 0;
+            }
+        }
+        return ptr;
+    }
+
+    std::vector<Alloc::NonTrivalUniquePtr<TensorImpl>>
+    TensorImpl::split(index_t split_size, index_t dim) const {
+        CHECK_IN_RANGE(dim, 0, n_dim(),
+            "Dimension out of range (expected to be in range of [0, %d), but got %d)",
+            n_dim(), dim);
+        CHECK_TRUE(split_size > 0, "split_size must be positive, but got %d", split_size);
+        std::vector<Alloc::NonTrivalUniquePtr<TensorImpl>> res;
+        for (index_t start = 0; start < _shape[dim]; start += split_size)
+            res.push_back(narrow(dim, start, std::min(split_size, _shape[dim]-start)));
+        return res;
+    }
+
+    std::vector<Alloc::NonTrivalUniquePtr<TensorImpl>>
+    TensorImpl::chunk(index_t chunks, index_t dim) const {
+        CHECK_TRUE(chunks > 0, "chunk expects `chunks` to be greater than 0, got: %d", chunks);
+        CHECK_IN_RANGE(dim, 0, n_dim(),
+            "Dimension out of range (expected to be in range of [0, %d), but got %d)",
+            n_dim(), dim);
+        return split((_shape[dim] + chunks - 1) / chunks, dim);
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::index_select(index_t dim, const TensorImpl& index) const {
+        CHECK_IN_RANGE(dim, 0, n_dim(),
+            "Dimension out of range (expected to be in range of [0, %d), but got %d)",
+            n_dim(), dim);
+        CHECK_EQUAL(index.n_dim(), 1,
+            "index_select(): Index is supposed to be a vector, but got %dD", index.n_dim());
+        index_t len = index.size(0);
+        std::vector<stride_t> idx(len);
+        for (index_t p = 0; p < len; ++p) {
+            idx[p] = to_index(index.item((stride_t)p * index.stride()[0]), _shape[dim]);
+            CHECK_TRUE(idx[p] >= 0,
+                "index_select(): index %g is out of bounds for dimension %d with size %d",
+                index.item((stride_t)p * index.stride()[0]), dim, _shape[dim]);
+        }
+
+        Shape shape(_shape);
+        shape[dim] = len;
+        Alloc::NonTrivalUniquePtr<TensorImpl> ptr;
+        ptr = Alloc::unique_construct<TensorImpl>(Storage(shape.d_size()), shape);
+        // every output row (outer position, selected index) is one block of the inner dims
+        index_t inner = _shape.sub_size(dim+1);
+        bool dense = dense_inner(_shape, _stride, dim+1);
+        data_t* out = ptr->data();
+        const data_t* src = data();
+        parallel_for(0, _shape.sub_size(0, dim) * len, std::max(1u, 4096 / std::max(inner, 1u)),
+                     [&](index_t begin, index_t end) {
+            for (index_t r = begin; r < end; ++r) {
+                index_t j = r / len, p = r % len;
+                const data_t* base = src + outer_offset(_shape, _stride, j, dim);
+                const data_t* row = base + idx[p] * _stride[dim];
+                if (p+1 < len) prefetch(base + idx[p+1] * _stride[dim]);
+                if (dense)
+                    std::memcpy(out + r*inner, row, inner*sizeof(data_t));
+                else
+                    copy_inner(row, _shape, _stride, dim+1, out + r*inner);
+            }
+        });
+        return ptr;
+    }
+
+    namespace {
+        // walk `index` with `dim` as the innermost loop, so that positions which
+        // differ only along `dim` are handled by one thread. fn gets, for each
+        // index element, its value, the offset of the other coordinates in
+        // `self` and in `other`, and its coordinate along dim.
+        template<typename Fn>
+        bool index_walk(const TensorImpl& self, const TensorImpl& index, const TensorImpl& other,
+                        index_t dim, const char* name, Fn fn) {
+            const Shape& shape = index.size();
+            index_t n = index.n_dim();
+            CHECK_EQUAL(n, self.n_dim(),
+                "%s(): Index tensor must have the same number of dimensions as self tensor", name);
+            CHECK_EQUAL(n, other.n_dim(),
+                "%s(): Index tensor must have the same number of dimensions as the other tensor", name);
+            CHECK_IN_RANGE(dim, 0, n,
+                "Dimension out of range (expected to be in range of [0, %d), but got %d)", n, dim);
+            for (index_t i = 0; i < n; ++i) {
+                CHECK_TRUE(shape[i] <= other.size(i),
+                    "%s(): Size does not match at dimension %d", name, i);
+                if (i != dim)
+                    CHECK_TRUE(shape[i] <= self.size(i),
+                        "%s(): Size does not match at dimension %d", name, i);
+            }
+            Shape rest(shape, dim);
+            StrideArray s_self(n-1), s_index(n-1), s_other(n-1);
+            for (index_t i = 0, j = 0; i < n; ++i) {
+                if (i == dim) continue;
+                s_self[j] = self.stride()[i];
+                s_index[j] = index.stride()[i];
+                s_other[j] = other.stride()[i];
+                ++j;
+            }
+            index_t bound = self.size(dim);
+            std::atomic<bool> bad(false);
+            parallel_for(0, rest.d_size(), std::max(1u, 4096 / shape[dim]), [&](index_t begin, index_t end) {
+                for (index_t p = begin; p < end; ++p) {
+                    stride_t b_self = outer_offset(rest, s_self, p, n-1);
+                    stride_t b_index = outer_offset(rest, s_index, p, n-1);
+                    stride_t b_other = outer_offset(rest, s_other, p, n-1);
+                    for (index_t c = 0; c < shape[dim]; ++c) {
+                        stride_t v = to_index(index.item(b_index + (stride_t)c * index.stride()[dim]), bound);
+                        if (v < 0) {
+                            bad = true;
+                            return;
+                        }
+                        fn(v, b_self, b_other, c);
+                    }
+                }
+            });
+            return !bad;
+        }
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl>
+    TensorImpl::gather(index_t dim, const TensorImpl& index) const {
+        Alloc::NonTrivalUniquePtr<TensorImpl> ptr;
+        ptr = Alloc::unique_construct<TensorImpl>(Storage(index.d_size()), index.size());
+        TensorImpl& out = *ptr;
+        const StrideArray& s_out = out.stride();
+        bool ok = index_walk(*this, index, out, dim, "gather",
+                             [&](stride_t v, stride_t b_self, stride_t b_out, index_t c) {
+            out.item(b_out + (stride_t)c * s_out[dim]) = item(b_self + v * _stride[dim]);
+        });
+        CHECK_TRUE(ok, "gather(): index out of bounds for dimension %d with size %d", dim, _shape[dim]);
+        return ptr;
+    }
+
+    TensorImpl& TensorImpl::scatter(index_t dim, const TensorImpl& index, const TensorImpl& src) {
+        CHECK_TRUE(!has_internal_overlap(),
+            "unsupported operation: more than one element of the written-to tensor refers to a single memory location");
+        bool ok = index_walk(*this, index, src, dim, "scatter",
+                             [&](stride_t v, stride_t b_self, stride_t b_src, index_t c) {
+            item(b_self + v * _stride[dim]) = src.item(b_src + (stride_t)c * src.stride()[dim]);
+        });
+        CHECK_TRUE(ok, "scatter(): index out of bounds for dimension %d with size %d", dim, _shape[dim]);
+        return *this;
+    }
+
+    TensorImpl& TensorImpl::scatter_add(index_t dim, const TensorImpl& index, const TensorImpl& src) {
+        CHECK_TRUE(!has_internal_overlap(),
+            "unsupported operation: more than one element of the written-to tensor refers to a single memory location");
+        bool ok = index_walk(*this, index, src, dim, "scatter_add",
+                             [&](stride_t v, stride_t b_self, stride_t b_src, index_t c) {
+            item(b_self + v * _stride[dim]) += src.item(b_src + (stride_t)c * src.stride()[dim]);
+        });
+        CHECK_TRUE(ok, "scatter_add(): index out of bounds for dimension %d with size %d", dim, _shape[dim]);
+        return *this;
+    }
+
+    namespace {
+        // count the selected elements per row, then write each row at its prefix offset
+        template<typename MaskImpl>
+        Alloc::NonTrivalUniquePtr<TensorImpl> masked_select_impl(const TensorImpl& self, const MaskImpl& mask) {
+            const Shape& shape = self.size();
+            const StrideArray& stride = self.stride();
+            StrideArray m_stride = expand_stride(mask.size(), mask.stride(), shape);
+            index_t n = self.n_dim(), last = shape[n-1];
+            index_t rows = self.d_size() / last;
+            std::vector<index_t> start(rows+1, 0);
+            parallel_for(0, rows, std::max(1u, 4096 / last), [&](index_t begin, index_t end) {
+                for (index_t r = begin; r < end; ++r) {
+                    stride_t b_mask = outer_offset(shape, m_stride, r, n-1);
+                    index_t cnt = 0;
+                    for (index_t t = 0; t < last; ++t)
+                        cnt += mask.item(b_mask + (stride_t)t * m_stride[n-1]) != 0;
+                    start[r+1] = cnt;
+                }
+            });
+            for (index_t r = 0; r < rows; ++r)
+                start[r+1] += start[r];
+            Alloc::NonTrivalUniquePtr<TensorImpl> ptr;
+            ptr = Alloc::unique_construct<TensorImpl>(Storage(std::max(start[rows], 1u)), Shape({start[rows]}));
+            data_t* out = ptr->data();
+            parallel_for(0, rows, std::max(1u, 4096 / last), [&](index_t begin, index_t end) {
+                for (index_t r = begin; r < end; ++r) {
+                    stride_t b_mask = outer_offset(shape, m_stride, r, n-1);
+                    stride_t b_self = outer_offset(shape, stride, r, n-1);
+                    data_t* dst = out + start[r];
+                    for (index_t t = 0; t < last; ++t)
+                        if (mask.item(b_mask + (stride_t)t * m_stride[n-1]) != 0)
+                            *dst++ = self.item(b_self + (stride_t)t * stride[n-1]);
+                }
+            });
+            return ptr;
+        }
+
+        template<typename MaskImpl>
+        void masked_fill_impl(TensorImpl& self, const MaskImpl& mask, data_t value) {
+            CHECK_TRUE(!self.has_internal_overlap(),
+                "unsupported operation: more than one element of the written-to tensor refers to a single memory location");
+            const Shape& shape = self.size();
+            const StrideArray& stride = self.stride();
+            StrideArray m_stride = expand_stride(mask.size(), mask.stride(), shape);
+            index_t n = self.n_dim(), last = shape[n-1];
+            parallel_for(0, self.d_size() / last, std::max(1u, 4096 / last), [&](index_t begin, index_t end) {
+                for (index_t r = begin; r < end; ++r) {
+                    stride_t b_mask = outer_offset(shape, m_stride, r, n-1);
+                    stride_t b_self = outer_offset(shape, stride, r, n-1);
+                    for (index_t t = 0; t < last; ++t)
+                        if (mask.item(b_mask + (stride_t)t * m_stride[n-1]) != 0)
+                            self.item(b_self + (stride_t)t * stride[n-1]) = value;
+                }
+            });
+        }
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl> TensorImpl::masked_select(const TensorImpl& mask) const {
+        return masked_select_impl(*this, mask);
+    }
+
+    Alloc::NonTrivalUniquePtr<TensorImpl> TensorImpl::masked_select(const BoolTensorImpl& mask) const {
+        return masked_select_impl(*this, mask);
+    }
+
+    TensorImpl& TensorImpl::masked_fill(const TensorImpl& mask, data_t value) {
+        masked_fill_impl(*this, mask, value);
+        return *this;
+    }
+
+    TensorImpl& TensorImpl::masked_fill(const BoolTensorImpl& mask, data_t value) {
+        masked_fill_impl(*this, mask, value);
+        return *this;
+    }
+
     // friend function
     std::ostream& operator<<(std::ostream& out, const TensorImpl& tensor) {
         int max_width = 0;
+        std::vector<index_t> pos(tensor.n_dim(), 0);
         for (int i = 0; i < tensor.d_size(); ++i) {
-            int value = (int)std::abs(tensor.item(i));
+            stride_t offset = 0;
+            for (int j = 0; j < tensor.n_dim(); ++j)
+                offset += (stride_t)pos[j] * tensor.stride()[j];
+            int value = (int)std::abs(tensor.item(offset));
             int dig = value = (int)(std::log10(value))+1;
-            if (tensor.item(i) < 0) ++dig;
+            if (tensor.item(offset) < 0) ++dig;
             max_width = std::max(max_width, dig);
+            for (int j = (int)tensor.n_dim()-1; j >= 0; --j) {
+                if (pos[j]+1 < tensor.size()[j]) { ++pos[j]; break; }
+                pos[j] = 0;
+            }
         }
         int cnt = 0, idx = 0, end_flag = tensor.n_dim();
         std::vector<int> dim_cnt(tensor.n_dim());
@@ -347,4 +871,68 @@ namespace st {
     TensorImpl TensorMaker::randn_like(const TensorImpl &tensor) {
         return randn(tensor.size());
     }
+
+    TensorImpl TensorMaker::cat(const std::vector<const TensorImpl*>& tensors, index_t dim) {
+        CHECK_TRUE(!tensors.empty(), "cat() expects a non-empty list of tensors");
+        const TensorImpl& first = *tensors[0];
+        CHECK_IN_RANGE(dim, 0, first.n_dim(),
+            "Dimension out of range (expected to be in range of [0, %d), but got %d)",
+            first.n_dim(), dim);
+        Shape shape(first.size());
+        shape[dim] = 0;
+        for (index_t k = 0; k < tensors.size(); ++k) {
+            const TensorImpl& t = *tensors[k];
+            CHECK_EQUAL(t.n_dim(), first.n_dim(),
+                "Tensors must have same number of dimensions: got %d and %d", first.n_dim(), t.n_dim());
+            for (index_t i = 0; i < t.n_dim(); ++i) {
+                if (i == dim) continue;
+                CHECK_EQUAL(t.size(i), first.size(i),
+                    "Sizes of tensors must match except in dimension %d. Expected size %d but got size %d for tensor number %d in the list.",
+                    dim, first.size(i), t.size(i), k);
+            }
+            shape[dim] += t.size(dim);
+        }
+
+        // plan: every (outer row, input) pair is one independent run in the output
+        TensorImpl res(Storage(shape.d_size()), shape);
+        index_t outer = shape.sub_size(0, dim);
+        index_t out_row = shape.sub_size(dim);
+        index_t n_input = tensors.size();
+        std::vector<index_t> col(n_input), len(n_input);
+        std::vector<bool> dense(n_input);
+        for (index_t k = 0, c = 0; k < n_input; ++k) {
+            col[k] = c;
+            len[k] = tensors[k]->size().sub_size(dim);
+            dense[k] = tensors[k]->is_contiguous();
+            c += len[k];
+        }
+        data_t* out = res.data();
+        index_t grain = std::max(1u, (1u << 14) / std::max(1u, out_row / n_input));
+        parallel_for(0, outer * n_input, grain, [&](index_t begin, index_t end) {
+            for (index_t r = begin; r < end; ++r) {
+                index_t j = r / n_input, k = r % n_input;
+                data_t* dst = out + j*out_row + col[k];
+                const TensorImpl& t = *tensors[k];
+                if (dense[k])
+                    std::memcpy(dst, t.data() + j*len[k], len[k]*sizeof(data_t));
+                else
+                    copy_inner(t.data() + outer_offset(t.size(), t.stride(), j, dim), t.size(), t.stride(), dim, dst);
+            }
+        });
+        return res;
+    }
+
+    TensorImpl TensorMaker::stack(const std::vector<const TensorImpl*>& tensors, index_t dim) {
+        CHECK_TRUE(!tensors.empty(), "stack() expects a non-empty list of tensors");
+        for (index_t k = 1; k < tensors.size(); ++k)
+            CHECK_TRUE(tensors[k]->size() == tensors[0]->size(),
+                "stack() expects each tensor to be equal size, but tensor number %d differs", k);
+        std::vector<Alloc::NonTrivalUniquePtr<TensorImpl>> views;
+        std::vector<const TensorImpl*> ptrs;
+        for (auto t : tensors) {
+            views.push_back(t->unsqueeze(dim));
+            ptrs.push_back(views.back().get());
+        }
+        return cat(ptrs, dim);
+    }
 } // st
\ No newline at end of file
@@ -1,5 +1,12 @@
 #include <iostream>
 #include "tensor.h"
+#include "graph.h"
+#include "linalg.h"
+#include "gemm.h"
+#include "nn.h"
+#include "autograd.h"
+#include "optim.h"
+#include "parallel.h"
 #include "gtest/gtest.h"
 
 TEST(tensorConstructorTest, by_storage_and_shape) {
@@ -123,6 +130,208 @@ TEST(tensorCalcOperator, matmul) {
     std::cout << C << std::endl;
 }
 
+TEST(tensorCalcOperator, batchedMatmul) {
+    st::Tensor A = st::Tensor::rand({5, 3, 4});
+    st::Tensor B = st::Tensor::rand({5, 4, 2});
+    st::Tensor C = st::bmm(A, B);
+    EXPECT_EQ(C.size(), st::Shape({5, 3, 2}));
+    for (st::index_t b = 0; b < 5; ++b)
+        for (st::index_t i = 0; i < 3; ++i)
+            for (st::index_t j = 0; j < 2; ++j) {
+                st::data_t sum = 0;
+                for (st::index_t k = 0; k < 4; ++k)
+                    sum += A[{b, i, k}] * B[{b, k, j}];
+                EXPECT_NEAR(sum, (C[{b, i, j}]), 1e-12);
+            }
+    EXPECT_THROW(({ st::Tensor res = st::bmm(A, A); }), st::err::Error);
+    EXPECT_THROW(({ st::Tensor res = st::bmm(A, st::Tensor::rand({4, 4, 2})); }), st::err::Error);
+    EXPECT_THROW(({ st::Tensor res = st::mm(A, B); }), st::err::Error);
+    // wrong ranks are reported, not left to an out-of-range dim lookup
+    st::Tensor M = st::Tensor::rand({3, 4}), v = st::Tensor::rand({4});
+    EXPECT_THROW(({ st::Tensor res = st::bmm(M, st::Tensor::rand({4, 2})); }), st::err::Error);
+    EXPECT_THROW(({ st::Tensor res = st::bmm(A, M.transpose(0, 1)); }), st::err::Error);
+    EXPECT_THROW(({ st::Tensor res = st::matmul(M, v); }), st::err::Error);
+    EXPECT_THROW(({ st::Tensor res = st::matmul(v, v); }), st::err::Error);
+
+    // batch dims broadcast: a size-1 dim and a missing dim both reuse one matrix
+    st::Tensor X = st::Tensor::rand({2, 1, 6, 5});
+    st::Tensor Y = st::Tensor::rand({3, 5, 7});
+    st::Tensor Z = st::matmul(X, Y);
+    EXPECT_EQ(Z.size(), st::Shape({2, 3, 6, 7}));
+    for (st::index_t p = 0; p < 2; ++p)
+        for (st::index_t q = 0; q < 3; ++q)
+            for (st::index_t i = 0; i < 6; i += 2)
+                for (st::index_t j = 0; j < 7; j += 3) {
+                    st::data_t sum = 0;
+                    for (st::index_t k = 0; k < 5; ++k)
+                        sum += X[{p, 0, i, k}] * Y[{q, k, j}];
+                    EXPECT_NEAR(sum, (Z[{p, q, i, j}]), 1e-12);
+                }
+    EXPECT_THROW(({ st::Tensor res = st::matmul(st::Tensor::rand({2, 3, 6, 5}), st::Tensor::rand({4, 5, 7})); }), st::err::Error);
+
+    // many small problems share a task, a transposed view is read through its strides
+    st::Tensor P = st::Tensor::rand({2000, 4, 4});
+    st::Tensor Q = st::Tensor::rand({2000, 4, 4});
+    st::Tensor R = st::matmul(P, Q.transpose(1, 2));
+    st::data_t sum = 0;
+    for (st::index_t k = 0; k < 4; ++k)
+        sum += P[{1999, 2, k}] * Q[{1999, 1, k}];
+    EXPECT_NEAR(sum, (R[{1999, 2, 1}]), 1e-12);
+}
+
+TEST(tensorCalcOperator, smallMatmulKernels) {
+    for (st::index_t n : {2u, 3u, 4u, 8u, 16u}) {
+        st::Tensor A = st::Tensor::rand({3, n, n});
+        st::Tensor B = st::Tensor::rand({3, n, n});
+        st::Tensor C = st::bmm(A, B.transpose(1, 2));
+        for (st::index_t i = 0; i < n; ++i)
+            for (st::index_t j = 0; j < n; ++j) {
+                st::data_t sum = 0;
+                for (st::index_t k = 0; k < n; ++k)
+                    sum += A[{2, i, k}] * B[{2, j, k}];
+                EXPECT_NEAR(sum, (C[{2, i, j}]), 1e-12);
+            }
+    }
+    // alpha and beta are honoured on the unrolled path
+    st::Tensor A = st::Tensor::rand({4, 4});
+    st::Tensor B = st::Tensor::rand({4, 4});
+    st::Tensor C = st::Tensor::rand({4, 4});
+    st::Tensor C0(C.data(), C.size());
+    st::gemm(4, 4, 4, 2.0, A.data(), 4, 1, B.data(), 4, 1, 0.5, C.data(), 4, 1);
+    st::data_t sum = 0;
+    for (st::index_t k = 0; k < 4; ++k)
+        sum += A[{1, k}] * B[{k, 3}];
+    EXPECT_NEAR((2.0 * sum + 0.5 * C0[{1, 3}]), (C[{1, 3}]), 1e-12);
+}
+
+TEST(tensorCalcOperatorTest, compareAndLogical) {
+    st::Tensor A({1, -2, 3, -4, 5, -6}, {2, 3});
+    st::Tensor B({0, 0, 3, 3, 6, -7}, {2, 3});
+    st::Tensor lt = A < B;
+    st::Tensor eq = A == B;
+    st::Tensor both = st::logical_and(A > B, st::logical_not(A == B));
+    st::BoolTensor mask = A <= B;
+    EXPECT_EQ(1, sizeof(mask[{0, 0}]));
+    EXPECT_EQ(4, mask.count());
+    EXPECT_TRUE(mask.any());
+    EXPECT_FALSE(mask.all());
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t j = 0; j < 3; ++j) {
+            EXPECT_EQ((A[{i, j}] < B[{i, j}]), (lt[{i, j}]));
+            EXPECT_EQ((A[{i, j}] == B[{i, j}]), (eq[{i, j}]));
+            EXPECT_EQ((A[{i, j}] > B[{i, j}]), (both[{i, j}]));
+            EXPECT_EQ((A[{i, j}] <= B[{i, j}]), (mask[{i, j}]));
+        }
+    st::Tensor sel = A.masked_select(mask);
+    EXPECT_EQ(4, sel.size(0));
+    EXPECT_EQ(-2, (sel[{0}]));
+}
+
+TEST(tensorCalcOperatorTest, whereClampRelu) {
+    st::Tensor A({1, -2, 3, -4, 5, -6}, {2, 3});
+    st::Tensor B = st::Tensor::ones({3});
+    st::Tensor W = st::where(A > B, A, B);
+    st::Tensor C = st::clamp(A, -3, 4);
+    st::Tensor R = st::relu(A);
+    st::Tensor M = st::maximum(st::abs(A), B * A);
+    st::Tensor S = st::sin(A) + st::cos(A);
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t j = 0; j < 3; ++j) {
+            st::data_t a = A[{i, j}];
+            EXPECT_EQ(a > 1 ? a : 1, (W[{i, j}]));
+            EXPECT_EQ(std::min(std::max(a, -3.0), 4.0), (C[{i, j}]));
+            EXPECT_EQ(a > 0 ? a : 0, (R[{i, j}]));
+            EXPECT_EQ(std::fabs(a), (M[{i, j}]));
+            EXPECT_DOUBLE_EQ(std::sin(a) + std::cos(a), (S[{i, j}]));
+        }
+    EXPECT_THROW(({ st::Tensor res = st::clamp(A, 1, 0); }), st::err::Error);
+}
+
+TEST(tensorCalcOperatorTest, scalarOperands) {
+    st::Tensor A = st::Tensor::rand({2, 3});
+    st::Tensor B = 2.0 * A + 1.0;
+    st::Tensor C = 1.0 - A / 4.0;
+    st::Tensor D = 3.0 / (A + 1.0) - A * 0.5;
+    st::Tensor E = (A > 0.5) + (0.25 >= A);
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t j = 0; j < 3; ++j) {
+            st::data_t a = A[{i, j}];
+            EXPECT_DOUBLE_EQ(2.0 * a + 1.0, (B[{i, j}]));
+            EXPECT_DOUBLE_EQ(1.0 - a / 4.0, (C[{i, j}]));
+            EXPECT_DOUBLE_EQ(3.0 / (a + 1.0) - a * 0.5, (D[{i, j}]));
+            EXPECT_EQ((st::data_t)(a > 0.5) + (st::data_t)(0.25 >= a), (E[{i, j}]));
+        }
+    EXPECT_EQ(B.size(), A.size());
+    EXPECT_THROW(({ st::Tensor F = A / 0.0; }), st::err::Error);
+}
+
+TEST(tensorCalcOperatorTest, compoundAssign) {
+    st::Tensor X0 = st::Tensor::rand({3, 4});
+    st::Tensor X(X0.data(), X0.size());
+    st::Tensor Y = st::Tensor::rand({3, 4});
+    st::Tensor row = st::Tensor::rand({4});
+    X += Y;
+    X -= row;
+    X *= 2.0;
+    X /= Y;
+    X += 1.0;
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 4; ++j) {
+            st::data_t expect = (X0[{i, j}] + Y[{i, j}] - row[{j}]) * 2.0 / Y[{i, j}] + 1.0;
+            EXPECT_DOUBLE_EQ(expect, (X[{i, j}]));
+        }
+    EXPECT_THROW((row += X), st::err::Error);
+}
+
+TEST(tensorCalcOperatorTest, outAndAliasing) {
+    st::Tensor A = st::Tensor::rand({3, 3});
+    st::Tensor B = st::Tensor::rand({3, 3});
+    st::Tensor out = st::Tensor::zeros({3, 3});
+    st::add(A, B, out);
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            EXPECT_DOUBLE_EQ((A[{i, j}] + B[{i, j}]), (out[{i, j}]));
+    st::Tensor small = st::Tensor::zeros({2, 3});
+    EXPECT_THROW(st::add(A, B, small), st::err::Error);
+
+    // transposed reads and matmul both alias the destination, so they go through a temporary
+    st::Tensor T(A.data(), A.size());
+    st::Tensor C = A;
+    C = A.transpose(0, 1) + A;
+    st::Tensor D(B.data(), B.size());
+    st::matmul(D, T, D);
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 3; ++j) {
+            EXPECT_DOUBLE_EQ((T[{j, i}] + T[{i, j}]), (A[{i, j}]));
+            st::data_t sum = 0;
+            for (st::index_t k = 0; k < 3; ++k)
+                sum += B[{i, k}] * T[{k, j}];
+            EXPECT_NEAR(sum, (D[{i, j}]), 1e-12);
+        }
+
+    // disjoint slices of one buffer don't alias, so a product goes straight into its slice
+    st::Tensor W = st::Tensor::zeros({6, 3});
+    st::Tensor top = W.slice(0, 3, 0), bottom = W.slice(3, 6, 0);
+    EXPECT_FALSE(top.ptr()->overlaps(*bottom.ptr()));
+    EXPECT_TRUE(top.ptr()->overlaps(*W.slice(2, 4, 0).ptr()));
+    EXPECT_TRUE(top.ptr()->overlaps(*W.transpose(0, 1).ptr()));
+    top.assign(B);
+    st::matmul(top, A, bottom);
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 3; ++j) {
+            st::data_t sum = 0;
+            for (st::index_t k = 0; k < 3; ++k)
+                sum += B[{i, k}] * A[{k, j}];
+            EXPECT_NEAR(sum, (W[{i + 3, j}]), 1e-12);
+        }
+
+    // a shape-changing assignment rebinds instead of writing into the old storage
+    st::Tensor X = st::Tensor::rand({2, 5});
+    st::Tensor Y = st::Tensor::rand({5, 3});
+    X = st::matmul(X, Y);
+    EXPECT_EQ(X.size(), st::Shape({2, 3}));
+}
+
 TEST(tensorOperatorTest, slice_piece) {
     st::Tensor A = st::Tensor::rand({2, 3, 3});
     st::Tensor B = A.slice(2, 2);
@@ -152,6 +361,67 @@ TEST(tensorOperatorTest, slice_cube) {
     std::cout << B << std::endl;
 }
 
+TEST(tensorOperatorTest, slice_step) {
+    st::Tensor A = st::Tensor::rand({2, 6, 5});
+    st::Tensor B = A.slice({st::Slice(), st::Slice(st::Slice::none, st::Slice::none, 2),
+                            st::Slice(st::Slice::none, st::Slice::none, -1)});
+    EXPECT_EQ(3, B.n_dim());
+    EXPECT_EQ(2, B.size(0));
+    EXPECT_EQ(3, B.size(1));
+    EXPECT_EQ(5, B.size(2));
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            for (st::index_t k = 0; k < 5; ++k)
+                EXPECT_EQ((A[{i, 2*j, 4-k}]), (B[{i, j, k}]));
+    st::Tensor C = B.slice({st::Slice(-1, st::Slice::none, -1), st::Slice(1, 3), st::Slice(3, 0, -2)});
+    EXPECT_EQ(2, C.size(0));
+    EXPECT_EQ(2, C.size(1));
+    EXPECT_EQ(2, C.size(2));
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t j = 0; j < 2; ++j)
+            for (st::index_t k = 0; k < 2; ++k)
+                EXPECT_EQ((B[{1-i, j+1, 3-2*k}]), (C[{i, j, k}]));
+    st::Tensor D = C + C;
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t j = 0; j < 2; ++j)
+            for (st::index_t k = 0; k < 2; ++k)
+                EXPECT_EQ((C[{i, j, k}] * 2), (D[{i, j, k}]));
+    auto it = C.begin();
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t j = 0; j < 2; ++j)
+            for (st::index_t k = 0; k < 2; ++k, ++it)
+                EXPECT_EQ((C[{i, j, k}]), *it);
+    EXPECT_THROW((A.slice({st::Slice(0, 2, 0)})), st::err::Error);
+    EXPECT_THROW((A.slice({st::Slice(), st::Slice(4, 2)})), st::err::Error);
+}
+
+TEST(tensorOperatorTest, narrow_select_unfold) {
+    st::Tensor A = st::Tensor::rand({3, 8});
+    st::Tensor B = A.narrow(1, 2, 4);
+    EXPECT_EQ(3, B.size(0));
+    EXPECT_EQ(4, B.size(1));
+    st::Tensor C = A.select(0, 1);
+    EXPECT_EQ(1, C.n_dim());
+    EXPECT_EQ(8, C.size(0));
+    st::Tensor D = A.unfold(1, 3, 2);
+    EXPECT_EQ(3, D.n_dim());
+    EXPECT_EQ(3, D.size(0));
+    EXPECT_EQ(3, D.size(1));
+    EXPECT_EQ(3, D.size(2));
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 8; ++j) {
+            if (j < 4) EXPECT_EQ((A[{i, j+2}]), (B[{i, j}]));
+            if (i == 0) EXPECT_EQ((A[{1, j}]), (C[{j}]));
+        }
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t w = 0; w < 3; ++w)
+            for (st::index_t k = 0; k < 3; ++k)
+                EXPECT_EQ((A[{i, 2*w+k}]), (D[{i, w, k}]));
+    EXPECT_THROW((A.narrow(1, 6, 4)), st::err::Error);
+    EXPECT_THROW((A.select(2, 0)), st::err::Error);
+    EXPECT_THROW((A.unfold(1, 9, 1)), st::err::Error);
+}
+
 TEST(tensorOperatorTest, transpose) {
     st::Tensor A = st::Tensor::rand({2, 3, 4});
     st::Tensor B = A.transpose(1, 2);
@@ -210,6 +480,115 @@ TEST(tensorOperatorTest, sumInOneDim) {
     std::cout << B << std::endl;
 }
 
+TEST(tensorOperatorTest, catAndStack) {
+    st::Tensor A = st::Tensor::rand({2, 3, 4});
+    st::Tensor B = st::Tensor::rand({2, 1, 4});
+    st::Tensor C = st::Tensor::rand({4, 3, 2}).transpose(0, 2);
+    st::Tensor D = st::cat({A, B, C}, 1);
+    EXPECT_EQ(2, D.size(0));
+    EXPECT_EQ(7, D.size(1));
+    EXPECT_EQ(4, D.size(2));
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t k = 0; k < 4; ++k) {
+            for (st::index_t j = 0; j < 3; ++j) {
+                EXPECT_EQ((A[{i, j, k}]), (D[{i, j, k}]));
+                EXPECT_EQ((C[{i, j, k}]), (D[{i, j+4, k}]));
+            }
+            EXPECT_EQ((B[{i, 0, k}]), (D[{i, 3, k}]));
+        }
+    st::Tensor S = st::stack({A, C}, 3);
+    EXPECT_EQ(4, S.n_dim());
+    EXPECT_EQ(2, S.size(3));
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            for (st::index_t k = 0; k < 4; ++k) {
+                EXPECT_EQ((A[{i, j, k}]), (S[{i, j, k, 0}]));
+                EXPECT_EQ((C[{i, j, k}]), (S[{i, j, k, 1}]));
+            }
+    st::Tensor R = st::Tensor::rand({3000, 64});
+    st::Tensor big = st::cat({R, st::Tensor::ones({1000, 64})}, 0);
+    EXPECT_EQ(4000, big.size(0));
+    EXPECT_EQ(1000 * 64, big.slice(3000, 4000, 0).sum());
+    for (st::index_t i = 0; i < 3000; i += 997)
+        EXPECT_EQ((R[{i, 17}]), (big[{i, 17}]));
+    EXPECT_THROW((st::cat({A, B}, 0)), st::err::Error);
+    EXPECT_THROW((st::stack({A, B}, 0)), st::err::Error);
+}
+
+TEST(tensorOperatorTest, splitAndChunk) {
+    st::Tensor A = st::Tensor::rand({7, 3});
+    std::vector<st::Tensor> parts = A.split(3);
+    EXPECT_EQ(3, parts.size());
+    EXPECT_EQ(3, parts[0].size(0));
+    EXPECT_EQ(1, parts[2].size(0));
+    parts[1][{0, 0}] = 5;
+    EXPECT_EQ(5, (A[{3, 0}]));
+    std::vector<st::Tensor> chunks = A.chunk(3, 1);
+    EXPECT_EQ(3, chunks.size());
+    for (st::index_t i = 0; i < 7; ++i)
+        EXPECT_EQ((A[{i, 2}]), (chunks[2][{i, 0}]));
+    st::Tensor back = st::cat(parts, 0);
+    for (st::index_t i = 0; i < 7; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            EXPECT_EQ((A[{i, j}]), (back[{i, j}]));
+}
+
+TEST(tensorIndexingTest, indexSelect) {
+    st::Tensor table = st::Tensor::rand({10, 4});
+    st::Tensor ids({7, 2, 2, 9}, {4});
+    st::Tensor rows = table.index_select(0, ids);
+    EXPECT_EQ(4, rows.size(0));
+    EXPECT_EQ(4, rows.size(1));
+    st::Tensor cols = table.transpose(0, 1).index_select(1, ids);
+    for (st::index_t p = 0; p < 4; ++p)
+        for (st::index_t j = 0; j < 4; ++j) {
+            st::index_t id = ids[{p}];
+            EXPECT_EQ((table[{id, j}]), (rows[{p, j}]));
+            EXPECT_EQ((table[{id, j}]), (cols[{j, p}]));
+        }
+    EXPECT_THROW((table.index_select(0, st::Tensor({10}, {1}))), st::err::Error);
+    EXPECT_THROW((table.index_select(0, st::Tensor({1.5}, {1}))), st::err::Error);
+    const st::data_t inf = std::numeric_limits<st::data_t>::infinity();
+    for (st::data_t bad : {std::nan(""), inf, -inf, 1e300, -1.0})
+        EXPECT_THROW((table.index_select(0, st::Tensor({bad}, {1}))), st::err::Error);
+}
+
+TEST(tensorIndexingTest, gatherScatter) {
+    st::Tensor A({1, 2, 3, 4, 5, 6}, {2, 3});
+    st::Tensor idx({2, 0, 1, 1}, {2, 2});
+    st::Tensor G = A.gather(1, idx);
+    EXPECT_EQ(3, (G[{0, 0}]));
+    EXPECT_EQ(1, (G[{0, 1}]));
+    EXPECT_EQ(5, (G[{1, 0}]));
+    EXPECT_EQ(5, (G[{1, 1}]));
+    st::Tensor Z = st::Tensor::zeros({2, 3});
+    Z.scatter_add(1, idx, st::Tensor::ones({2, 2}));
+    EXPECT_EQ(1, (Z[{0, 0}]));
+    EXPECT_EQ(0, (Z[{0, 1}]));
+    EXPECT_EQ(1, (Z[{0, 2}]));
+    EXPECT_EQ(2, (Z[{1, 1}]));
+    st::Tensor Y = st::Tensor::zeros({3, 2});
+    Y.scatter(0, st::Tensor({2, 0}, {1, 2}), A);
+    EXPECT_EQ(1, (Y[{2, 0}]));
+    EXPECT_EQ(2, (Y[{0, 1}]));
+    EXPECT_THROW((A.gather(1, st::Tensor({3, 0}, {1, 2}))), st::err::Error);
+}
+
+TEST(tensorIndexingTest, masked) {
+    st::Tensor A({1, -2, 3, -4, 5, -6}, {2, 3});
+    st::Tensor mask({1, 0, 1, 0, 1, 0}, {2, 3});
+    st::Tensor sel = A.masked_select(mask);
+    EXPECT_EQ(1, sel.n_dim());
+    EXPECT_EQ(3, sel.size(0));
+    EXPECT_EQ(1, (sel[{0}]));
+    EXPECT_EQ(3, (sel[{1}]));
+    EXPECT_EQ(5, (sel[{2}]));
+    A.masked_fill(st::Tensor({0, 1, 0}, {3}), 0);
+    EXPECT_EQ(0, (A[{0, 1}]));
+    EXPECT_EQ(0, (A[{1, 1}]));
+    EXPECT_EQ(-4, (A[{1, 0}]));
+}
+
 TEST(tensorBroadcastTest, broadcast) {
     st::Tensor A = st::Tensor::rand({2, 3, 4});
     st::Tensor B = st::Tensor::rand({3, 4});
@@ -227,6 +606,55 @@ TEST(tensorBroadcastTest, broadcast) {
     std::cout << C << std::endl;
 }
 
+TEST(tensorBroadcastTest, expandView) {
+    st::Tensor bias = st::Tensor::rand({1, 4});
+    st::Tensor B = bias.expand({1000000, 4});
+    EXPECT_EQ(1000000, B.size(0));
+    EXPECT_EQ(0, B.stride()[0]);
+    EXPECT_TRUE(B.has_internal_overlap());
+    bias[{0, 2}] = 7;
+    EXPECT_EQ(7, (B[{999999, 2}]));
+    st::Tensor x = st::Tensor::rand({3, 4});
+    st::Tensor y = x + bias.broadcast_to({3, 4});
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 4; ++j)
+            EXPECT_EQ((x[{i, j}] + bias[{0, j}]), (y[{i, j}]));
+    st::Tensor E = bias.expand({2, 3, 4});
+    EXPECT_EQ(3, E.n_dim());
+    EXPECT_THROW((bias.expand({3, 5})), st::err::Error);
+    EXPECT_THROW(({ st::Tensor w = B; w = x + x; }), st::err::Error);
+}
+
+TEST(tensorOperatorTest, squeezeAndFlatten) {
+    st::Tensor A = st::Tensor::rand({2, 3, 4});
+    st::Tensor B = A.unsqueeze(1);
+    EXPECT_EQ(4, B.n_dim());
+    EXPECT_EQ(1, B.size(1));
+    st::Tensor C = B.unsqueeze(4).squeeze();
+    EXPECT_EQ(3, C.n_dim());
+    EXPECT_EQ(3, B.squeeze(1).n_dim());
+    EXPECT_EQ(4, B.squeeze(0).n_dim());
+    st::Tensor D = A.flatten();
+    EXPECT_EQ(1, D.n_dim());
+    EXPECT_EQ(24, D.size(0));
+    st::Tensor T = A.transpose(0, 2);
+    st::Tensor F = T.flatten(1);
+    EXPECT_EQ(2, F.n_dim());
+    EXPECT_EQ(4, F.size(0));
+    EXPECT_EQ(6, F.size(1));
+    st::Tensor G = A.flatten(0, 1);
+    EXPECT_EQ(6, G.size(0));
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            for (st::index_t k = 0; k < 4; ++k) {
+                EXPECT_EQ((A[{i, j, k}]), (B[{i, 0, j, k}]));
+                EXPECT_EQ((A[{i, j, k}]), (C[{i, j, k}]));
+                EXPECT_EQ((A[{i, j, k}]), (D[{(i*3+j)*4+k}]));
+                EXPECT_EQ((A[{i, j, k}]), (F[{k, j*2+i}]));
+                EXPECT_EQ((A[{i, j, k}]), (G[{i*3+j, k}]));
+            }
+}
+
 TEST(tensorIteratorTest, iterator) {
     st::Tensor A = st::Tensor::rand({2, 3, 4});
     st::Tensor::iterator it = A.begin();
@@ -278,6 +706,939 @@ TEST(tensorExpLazyCaculationTest, lazyEvaluation) {
     std::cout << res << std::endl;
 }
 
+TEST(tensorExpLazyCaculationTest, nodesByValue) {
+    st::Tensor A = st::Tensor::rand({2, 3});
+    st::Tensor B = st::Tensor::rand({2, 3});
+    auto e = A * 2.0 + st::sin(B) - A / B;
+    // nodes hold handles and scalars only, copying a tree never touches a refcount
+    static_assert(std::is_trivially_copyable_v<decltype(e)>);
+    static_assert(sizeof(e) <= 6 * sizeof(void*));
+    auto f = e;
+    st::Tensor res = f.eval();
+    for (st::index_t i = 0; i < 2; ++i)
+        for (st::index_t j = 0; j < 3; ++j)
+            EXPECT_DOUBLE_EQ((A[{i, j}] * 2.0 + std::sin(B[{i, j}]) - A[{i, j}] / B[{i, j}]), (res[{i, j}]));
+    B[{0, 0}] = 1.0;
+    st::Tensor res2 = e;
+    EXPECT_DOUBLE_EQ((A[{0, 0}] * 2.0 + std::sin(1.0) - A[{0, 0}]), (res2[{0, 0}]));
+}
+
+TEST(tensorExpLazyCaculationTest, temporaryOperands) {
+    st::Tensor A = st::Tensor::rand({3, 5});
+    st::Tensor B = st::Tensor::rand({5, 3});
+    // the transposed views and the ones tensor are temporaries, the expressions keep them alive
+    auto e = A.transpose(0, 1) + B;
+    auto m = st::matmul(B.transpose(0, 1), A.transpose(0, 1));
+    auto s = st::sin(st::Tensor::ones({5, 3})) * B;
+    st::Tensor Z = st::Tensor::rand({5, 7, 2});
+    st::Tensor E(e), M(m), S(s);
+    for (st::index_t i = 0; i < 5; ++i)
+        for (st::index_t j = 0; j < 3; ++j) {
+            EXPECT_DOUBLE_EQ((A[{j, i}] + B[{i, j}]), (E[{i, j}]));
+            EXPECT_DOUBLE_EQ((std::sin(1.0) * B[{i, j}]), (S[{i, j}]));
+        }
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 3; ++j) {
+            st::data_t sum = 0;
+            for (st::index_t k = 0; k < 5; ++k)
+                sum += B[{k, i}] * A[{j, k}];
+            EXPECT_NEAR(sum, (M[{i, j}]), 1e-12);
+        }
+}
+
+TEST(tensorExpLazyCaculationTest, fusedKernels) {
+    // large enough to split into parallel chunks and to take the tiled path for the transposed read
+    st::Tensor A = st::Tensor::rand({300, 200});
+    st::Tensor B = st::Tensor::rand({200, 300});
+    st::Tensor col = st::Tensor::rand({300, 1});
+    st::Tensor row = st::Tensor::rand({200});
+    st::Tensor R = A * B.transpose(0, 1) + st::sin(col) - row / 2.0;
+    st::Tensor W = st::where(A > 0.5, A, col);
+    for (st::index_t i = 0; i < 300; i += 7)
+        for (st::index_t j = 0; j < 200; j += 3) {
+            st::data_t expect = A[{i, j}] * B[{j, i}] + std::sin(col[{i, 0}]) - row[{j}] / 2.0;
+            EXPECT_DOUBLE_EQ(expect, (R[{i, j}]));
+            EXPECT_EQ((A[{i, j}] > 0.5 ? A[{i, j}] : col[{i, 0}]), (W[{i, j}]));
+        }
+
+    // a matmul operand is evaluated into a temporary and then read as a leaf
+    st::Tensor C = st::Tensor::rand({4, 5});
+    st::Tensor D = st::Tensor::rand({5, 3});
+    st::Tensor E = st::matmul(C, D) * 2.0 + 1.0;
+    for (st::index_t i = 0; i < 4; ++i)
+        for (st::index_t j = 0; j < 3; ++j) {
+            st::data_t sum = 0;
+            for (st::index_t k = 0; k < 5; ++k)
+                sum += C[{i, k}] * D[{k, j}];
+            EXPECT_NEAR(sum * 2.0 + 1.0, (E[{i, j}]), 1e-12);
+        }
+
+    // more dims than the fused loop takes still evaluate element by element
+    st::Tensor F = st::Tensor::rand({1, 2, 1, 2, 1, 2, 1, 2, 2});
+    st::Tensor G = F + F;
+    EXPECT_DOUBLE_EQ(F.sum() * 2.0, G.sum());
+
+    // errors raised inside a parallel chunk reach the caller
+    st::Tensor Z = st::Tensor::rand({300, 200});
+    Z[{299, 199}] = 0;
+    EXPECT_THROW(({ st::Tensor Q = A / Z; }), st::err::Error);
+}
+
+TEST(tensorExpLazyCaculationTest, stridedGemm) {
+    // big enough for the packed, parallel path, with both operands transposed views
+    st::Tensor A = st::Tensor::rand({130, 270});
+    st::Tensor B = st::Tensor::rand({150, 130});
+    st::Tensor C = st::matmul(A.transpose(0, 1), B.transpose(0, 1));
+    EXPECT_EQ(C.size(), st::Shape({270, 150}));
+    for (st::index_t i = 0; i < 270; i += 11)
+        for (st::index_t j = 0; j < 150; j += 7) {
+            st::data_t sum = 0;
+            for (st::index_t k = 0; k < 130; ++k)
+                sum += A[{k, i}] * B[{j, k}];
+            EXPECT_NEAR(sum, (C[{i, j}]), 1e-9);
+        }
+    // the destination may itself be strided
+    st::Tensor D = st::Tensor::rand({150, 270});
+    st::Tensor Dt = D.transpose(0, 1);
+    Dt = st::matmul(A.transpose(0, 1), B.transpose(0, 1));
+    EXPECT_NEAR((C[{269, 149}]), (D[{149, 269}]), 1e-9);
+    EXPECT_NEAR((C[{5, 3}]), (D[{3, 5}]), 1e-9);
+
+    // constants combine while the expression is built
+    st::Tensor X = st::Tensor::rand({3, 4});
+    auto e = 2.0 * (3.0 * X);
+    static_assert(std::is_same_v<decltype(e.lhs()), const st::ScalarExp&>);
+    EXPECT_DOUBLE_EQ(6.0, e.lhs().item());
+    auto f = (X + 1.0) + 2.0;
+    EXPECT_DOUBLE_EQ(3.0, f.rhs().item());
+    st::Tensor F = f;
+    EXPECT_DOUBLE_EQ((X[{2, 3}] + 3.0), (F[{2, 3}]));
+}
+
+TEST(tensorParallelTest, exceptions) {
+    const st::index_t n = 1 << 16;
+    std::vector<int> seen(n, 0);
+    // a throwing chunk doesn't stop the others, the error reaches the caller
+    EXPECT_THROW(st::parallel_for(0, n, 1, [&](st::index_t begin, st::index_t end) {
+        for (st::index_t i = begin; i < end; ++i) seen[i] = 1;
+        if (end == n) throw std::runtime_error("last chunk");
+    }), std::runtime_error);
+    EXPECT_EQ(n, std::count(seen.begin(), seen.end(), 1));
+    EXPECT_THROW(st::parallel_for(0, n, 1, [&](st::index_t begin, st::index_t) {
+        if (begin == 0) throw std::runtime_error("first chunk");
+    }), std::runtime_error);
+    // the caller isn't left marked as a worker, so later loops still split
+    std::atomic<st::index_t> chunks = 0;
+    st::parallel_for(0, n, 1, [&](st::index_t, st::index_t) { ++chunks; });
+    EXPECT_EQ(std::min<st::index_t>(n, st::get_num_threads()), chunks.load());
+}
+
+TEST(tensorGraphTest, commonSubexpression) {
+    st::Tensor X = st::Tensor::rand({40, 30});
+    st::Tensor Y = st::Tensor::rand({30});
+    st::Graph g;
+    auto x = g.input(X), y = g.input(Y);
+    auto z = x * y + st::sin(y * x);
+    // y*x is recorded as the same node as x*y
+    EXPECT_EQ(5, g.n_nodes());
+    EXPECT_EQ(g.input(X).node(), x.node());
+    st::Tensor Z = z.eval();
+    EXPECT_EQ(1, g.n_materialised());
+    for (st::index_t i = 0; i < 40; i += 3)
+        for (st::index_t j = 0; j < 30; ++j) {
+            st::data_t p = X[{i, j}] * Y[{j}];
+            EXPECT_DOUBLE_EQ(p + std::sin(p), (Z[{i, j}]));
+        }
+
+    // an expensive node read by two kernels is written once, a cheap one is recomputed
+    auto s = st::sin(x) * 2.0;
+    auto a = s + 1.0;
+    auto b = s - y;
+    auto c = (x + 1.0) * (x + 1.0);
+    auto res = g.eval({a, b, c});
+    EXPECT_EQ(4, g.n_materialised());
+    for (st::index_t i = 0; i < 40; i += 7)
+        for (st::index_t j = 0; j < 30; j += 2) {
+            st::data_t sv = std::sin(X[{i, j}]) * 2.0;
+            EXPECT_DOUBLE_EQ(sv + 1.0, (res[0][{i, j}]));
+            EXPECT_DOUBLE_EQ(sv - Y[{j}], (res[1][{i, j}]));
+            EXPECT_DOUBLE_EQ((X[{i, j}] + 1.0) * (X[{i, j}] + 1.0), (res[2][{i, j}]));
+        }
+}
+
+TEST(tensorGraphTest, constants) {
+    st::Graph g;
+    st::Tensor sum = g.eval(g.scalar(2.0) + g.scalar(3.0));
+    EXPECT_EQ(sum.size(), st::Shape({1}));
+    EXPECT_DOUBLE_EQ(5.0, (sum[{0}]));
+    auto res = g.eval({st::sin(g.scalar(1.0)), g.scalar(4.0) * 0.5});
+    EXPECT_DOUBLE_EQ(std::sin(1.0), (res[0][{0}]));
+    EXPECT_DOUBLE_EQ(2.0, (res[1][{0}]));
+}
+
+TEST(tensorGraphTest, sameOperand) {
+    st::Tensor X = st::Tensor::rand({6, 5});
+    st::Tensor S = st::Tensor::rand({5, 5});
+    st::Graph g;
+    auto x = g.input(X), s = g.input(S);
+    // both operands are one node, also after sin(x) * sin(x) is merged into one
+    auto res = g.eval({x * x, st::maximum(x, x), st::sin(x) * st::sin(x), st::matmul(s, s)});
+    for (st::index_t i = 0; i < 6; ++i)
+        for (st::index_t j = 0; j < 5; ++j) {
+            st::data_t v = X[{i, j}];
+            EXPECT_DOUBLE_EQ(v * v, (res[0][{i, j}]));
+            EXPECT_DOUBLE_EQ(v, (res[1][{i, j}]));
+            EXPECT_DOUBLE_EQ(std::sin(v) * std::sin(v), (res[2][{i, j}]));
+        }
+    for (st::index_t i = 0; i < 5; ++i)
+        for (st::index_t j = 0; j < 5; ++j) {
+            st::data_t sum = 0;
+            for (st::index_t k = 0; k < 5; ++k)
+                sum += S[{i, k}] * S[{k, j}];
+            EXPECT_NEAR(sum, (res[3][{i, j}]), 1e-12);
+        }
+    st::Tensor Y = (x + x).eval();
+    EXPECT_DOUBLE_EQ((2.0 * X[{5, 4}]), (Y[{5, 4}]));
+}
+
+TEST(tensorGraphTest, matmulAndErrors) {
+    st::Tensor A = st::Tensor::rand({4, 6});
+    st::Tensor B = st::Tensor::rand({6, 3});
+    st::Graph g;
+    auto a = g.input(A), b = g.input(B);
+    st::Tensor C = (st::matmul(a * 2.0, b) + 1.0).eval();
+    EXPECT_EQ(C.size(), st::Shape({4, 3}));
+    for (st::index_t i = 0; i < 4; ++i)
+        for (st::index_t j = 0; j < 3; ++j) {
+            st::data_t sum = 0;
+            for (st::index_t k = 0; k < 6; ++k)
+                sum += 2.0 * A[{i, k}] * B[{k, j}];
+            EXPECT_NEAR(sum + 1.0, (C[{i, j}]), 1e-12);
+        }
+    EXPECT_THROW((void)st::matmul(a, a), st::err::Error);
+    EXPECT_THROW((void)(a + b), st::err::Error);
+    st::Graph other;
+    EXPECT_THROW((void)(a + other.input(A)), st::err::Error);
+    EXPECT_THROW((a / (a - a)).eval(), st::err::Error);
+}
+
+TEST(tensorGraphTest, rewrites) {
+    st::Tensor X = st::Tensor::rand({5, 4});
+    st::Tensor S = st::Tensor::rand({1});
+    st::Graph g;
+    auto x = g.input(X), s = g.input(S);
+    // identities and constant folding record no new nodes
+    EXPECT_EQ(x.node(), (x * 1.0).node());
+    EXPECT_EQ(x.node(), (1.0 * x + 0.0).node());
+    EXPECT_EQ(x.node(), (x / 1.0 - 0.0).node());
+    EXPECT_EQ(x.node(), (-(-x)).node());
+    EXPECT_EQ(x.node(), st::transpose(st::transpose(x, 0, 1), 1, 0).node());
+    // s + 0 still broadcasts the zero, so it stays
+    EXPECT_EQ(st::Shape({5, 4}), (s + (x * 0.0)).size());
+    auto c = 2.0 * (3.0 * x);
+    EXPECT_EQ(g.node(c.node()).kind, st::Graph::OpKind::Mul);
+    const st::Graph::Node& cn = g.node(c.node());
+    EXPECT_TRUE(cn.lhs == x.node() || cn.rhs == x.node());
+    st::Tensor C = c.eval();
+    EXPECT_DOUBLE_EQ((6.0 * X[{4, 3}]), (C[{4, 3}]));
+
+    // (A*B)*v is recorded as A*(B*v), and transposed inputs go straight to the GEMM
+    st::Tensor A = st::Tensor::rand({30, 40});
+    st::Tensor B = st::Tensor::rand({50, 40});
+    st::Tensor V = st::Tensor::rand({50, 1});
+    auto a = g.input(A), bt = st::transpose(g.input(B), 0, 1), v = g.input(V);
+    auto r = st::matmul(st::matmul(a, bt), v);
+    EXPECT_EQ(a.node(), g.node(r.node()).lhs);
+    EXPECT_EQ(st::Graph::OpKind::MatMul, g.node(g.node(r.node()).rhs).kind);
+    st::Tensor R = (r + 1.0).eval();
+    EXPECT_EQ(R.size(), st::Shape({30, 1}));
+    for (st::index_t i = 0; i < 30; i += 3) {
+        st::data_t sum = 0;
+        for (st::index_t k = 0; k < 40; ++k) {
+            st::data_t bv = 0;
+            for (st::index_t j = 0; j < 50; ++j)
+                bv += B[{j, k}] * V[{j, 0}];
+            sum += A[{i, k}] * bv;
+        }
+        EXPECT_NEAR(sum + 1.0, (R[{i, 0}]), 1e-9);
+    }
+    st::Tensor T = (st::transpose(x, 0, 1) * 2.0).eval();
+    EXPECT_DOUBLE_EQ((2.0 * X[{4, 1}]), (T[{1, 4}]));
+    EXPECT_THROW((void)st::transpose(x, 0, 2), st::err::Error);
+
+    // outputs that rewrite down to an input, or a view of one, don't alias it
+    st::Tensor I = (st::transpose(st::transpose(x, 0, 1), 0, 1) * 1.0 + 0.0).eval();
+    EXPECT_NE(X.data(), I.data());
+    EXPECT_DOUBLE_EQ((X[{4, 3}]), (I[{4, 3}]));
+    st::Tensor Xt = st::transpose(x, 0, 1).eval();
+    EXPECT_DOUBLE_EQ((X[{4, 1}]), (Xt[{1, 4}]));
+    Xt[{1, 4}] = X[{4, 1}] + 1.0;
+    I[{4, 3}] = X[{4, 3}] + 1.0;
+    EXPECT_NE((X[{4, 1}]), (Xt[{1, 4}]));
+    EXPECT_NE((X[{4, 3}]), (I[{4, 3}]));
+}
+
+TEST(tensorGraphTest, memoryPlan) {
+    // buffers alive at the same step never overlap, the rest may share
+    std::vector<st::Lifetime> buffers{{100, 0, 1}, {50, 1, 2}, {100, 2, 3}, {30, 3, 4}, {20, 0, 4}};
+    st::MemoryPlan plan = st::plan_memory(buffers);
+    for (size_t i = 0; i < buffers.size(); ++i)
+        for (size_t j = i + 1; j < buffers.size(); ++j) {
+            bool alive = buffers[i].first <= buffers[j].last && buffers[j].first <= buffers[i].last;
+            bool apart = plan.offset[i] + buffers[i].size <= plan.offset[j] ||
+                         plan.offset[j] + buffers[j].size <= plan.offset[i];
+            EXPECT_TRUE(!alive || apart) << i << " and " << j;
+        }
+    EXPECT_EQ(plan.arena_size, 170u);
+
+    // a chain of products keeps two intermediates at a time, the transpose extends its operand
+    st::Tensor X = st::Tensor::rand({8, 8});
+    st::Graph g;
+    auto x = g.input(X);
+    auto m1 = st::matmul(x, x);
+    auto m2 = st::matmul(st::sin(m1), x);
+    auto m3 = st::matmul(st::transpose(m2, 0, 1), x);
+    auto m4 = st::matmul(st::cos(m3), x);
+    st::Tensor res = (m4 + 1.0).eval();
+    EXPECT_EQ(g.intermediate_size(), 6u * 64);
+    EXPECT_LT(g.arena_size(), g.intermediate_size());
+    st::Tensor e1 = matmul(X, X);
+    st::Tensor e2 = matmul(st::sin(e1), X);
+    st::Tensor e3 = matmul(e2.transpose(0, 1), X);
+    st::Tensor e4 = matmul(st::cos(e3), X);
+    for (st::index_t i = 0; i < 8; ++i)
+        for (st::index_t j = 0; j < 8; ++j) EXPECT_NEAR((e4[{i, j}] + 1.0), (res[{i, j}]), 1e-9);
+}
+
+TEST(tensorLinalgTest, multiDot) {
+    st::Tensor A = st::Tensor::rand({10, 60});
+    st::Tensor B = st::Tensor::rand({60, 5});
+    st::Tensor C = st::Tensor::rand({5, 80});
+    st::Tensor D = st::Tensor::rand({40, 80}).transpose(0, 1);
+    st::Tensor R = st::multi_dot({A, B, C, D});
+    st::Tensor E = st::matmul(st::matmul(st::matmul(A, B), C), D);
+    EXPECT_EQ(R.size(), st::Shape({10, 40}));
+    for (st::index_t i = 0; i < 10; ++i)
+        for (st::index_t j = 0; j < 40; j += 3)
+            EXPECT_NEAR((E[{i, j}]), (R[{i, j}]), 1e-9);
+
+    // vectors at the ends drop their dim
+    st::Tensor u = st::Tensor::rand({10});
+    st::Tensor v = st::Tensor::rand({80});
+    st::Tensor Rv = st::multi_dot({u, A, B, C, v});
+    EXPECT_EQ(Rv.size(), st::Shape({1}));
+    st::Tensor Ev = st::matmul(st::matmul(A, B), C);
+    st::data_t sum = 0;
+    for (st::index_t i = 0; i < 10; ++i)
+        for (st::index_t j = 0; j < 80; ++j)
+            sum += u[{i}] * Ev[{i, j}] * v[{j}];
+    EXPECT_NEAR(sum, Rv.item(), 1e-9);
+    EXPECT_EQ(st::multi_dot({A, B, v.slice(0, 5, 0)}).size(), st::Shape({10}));
+
+    EXPECT_THROW(st::multi_dot({A}), st::err::Error);
+    EXPECT_THROW(st::multi_dot({A, C}), st::err::Error);
+    EXPECT_THROW(st::multi_dot({A, st::Tensor::rand({60, 2, 2})}), st::err::Error);
+}
+
+TEST(tensorLinalgTest, vectorKernels) {
+    // tall enough to split rows across threads, and both layouts of the matrix
+    st::Tensor A = st::Tensor::rand({3000, 37});
+    st::Tensor x = st::Tensor::rand({37});
+    st::Tensor y = st::Tensor::rand({3000});
+    st::Tensor Ax = st::mv(A, x);
+    st::Tensor Aty = st::mv(A.transpose(0, 1), y);
+    EXPECT_EQ(Ax.size(), st::Shape({3000}));
+    EXPECT_EQ(Aty.size(), st::Shape({37}));
+    for (st::index_t i = 0; i < 3000; i += 97) {
+        st::data_t sum = 0;
+        for (st::index_t j = 0; j < 37; ++j)
+            sum += A[{i, j}] * x[{j}];
+        EXPECT_NEAR(sum, (Ax[{i}]), 1e-12);
+    }
+    for (st::index_t j = 0; j < 37; j += 5) {
+        st::data_t sum = 0;
+        for (st::index_t i = 0; i < 3000; ++i)
+            sum += A[{i, j}] * y[{i}];
+        EXPECT_NEAR(sum, (Aty[{j}]), 1e-9);
+    }
+    // an N x 1 right-hand side takes the same path through matmul
+    st::Tensor col = st::matmul(A, x.view({37, 1}));
+    EXPECT_NEAR((Ax[{1234}]), (col[{1234, 0}]), 1e-12);
+
+    st::data_t d = 0;
+    for (st::index_t i = 0; i < 3000; ++i)
+        d += y[{i}] * A[{i, 3}];
+    EXPECT_NEAR(d, st::dot(y, A.select(1, 3)), 1e-9);
+    st::Tensor o = st::outer(x, y);
+    EXPECT_EQ(o.size(), st::Shape({37, 3000}));
+    EXPECT_DOUBLE_EQ((x[{36}] * y[{2999}]), (o[{36, 2999}]));
+    st::Tensor z(y.data(), y.size());
+    st::axpy(2.0, A.select(1, 0), z);
+    EXPECT_DOUBLE_EQ((y[{7}] + 2.0 * A[{7, 0}]), (z[{7}]));
+
+    EXPECT_THROW(st::mv(A, y), st::err::Error);
+    EXPECT_THROW((void)st::dot(x, y), st::err::Error);
+    EXPECT_THROW(st::axpy(1.0, x, z), st::err::Error);
+}
+
+TEST(tensorLinalgTest, factorisations) {
+    // larger than one block, so the blocked updates run
+    const st::index_t n = 150;
+    st::Tensor X = st::Tensor::rand({n, n});
+    st::Tensor A = st::matmul(X, X.transpose(0, 1));
+    for (st::index_t i = 0; i < n; ++i) A[{i, i}] += n;
+    st::Tensor b = st::Tensor::rand({n});
+    st::Tensor x = st::solve(X, b);
+    st::Tensor r = st::mv(X, x);
+    for (st::index_t i = 0; i < n; i += 7)
+        EXPECT_NEAR((b[{i}]), (r[{i}]), 1e-8);
+
+    st::Tensor L = st::cholesky(A);
+    EXPECT_EQ(0.0, (L[{3, 100}]));
+    st::Tensor LLt = st::matmul(L, L.transpose(0, 1));
+    for (st::index_t i = 0; i < n; i += 13)
+        for (st::index_t j = 0; j < n; j += 11)
+            EXPECT_NEAR((A[{i, j}]), (LLt[{i, j}]), 1e-8);
+    st::Tensor B = st::Tensor::rand({n, 3});
+    st::Tensor Y = st::triangular_solve(L, B, false);
+    st::Tensor Z = st::triangular_solve(L.transpose(0, 1), Y, true);
+    st::Tensor AZ = st::matmul(A, Z);
+    EXPECT_NEAR((B[{77, 2}]), (AZ[{77, 2}]), 1e-8);
+
+    st::Tensor Ai = st::inv(A);
+    st::Tensor I = st::matmul(Ai, A);
+    EXPECT_NEAR(1.0, (I[{42, 42}]), 1e-9);
+    EXPECT_NEAR(0.0, (I[{42, 43}]), 1e-9);
+
+    st::Tensor M({2, 1, 0, 1, 3, 2, 1, 1, 1}, {3, 3});
+    EXPECT_NEAR(3.0, st::det(M).item(), 1e-12);
+    st::Tensor S({1, 2, 2, 4}, {2, 2});
+    EXPECT_EQ(0.0, st::det(S).item());
+    EXPECT_THROW(st::solve(S, st::Tensor::rand({2})), st::err::Error);
+    EXPECT_THROW(st::cholesky(-A), st::err::Error);
+    EXPECT_THROW(st::inv(st::Tensor::rand({2, 3})), st::err::Error);
+}
+
+TEST(tensorLinalgTest, qrLstsqAndBatches) {
+    st::Tensor A = st::Tensor::rand({90, 20});
+    st::QRFactor f = st::qr(A);
+    EXPECT_EQ(f.q.size(), st::Shape({90, 20}));
+    EXPECT_EQ(f.r.size(), st::Shape({20, 20}));
+    st::Tensor QtQ = st::matmul(f.q.transpose(0, 1), f.q);
+    st::Tensor QR = st::matmul(f.q, f.r);
+    EXPECT_NEAR(1.0, (QtQ[{5, 5}]), 1e-12);
+    EXPECT_NEAR(0.0, (QtQ[{5, 6}]), 1e-12);
+    EXPECT_NEAR((A[{80, 19}]), (QR[{80, 19}]), 1e-12);
+    EXPECT_EQ(0.0, (f.r[{3, 2}]));
+
+    // the least-squares residual is orthogonal to the columns of A
+    st::Tensor y = st::Tensor::rand({90});
+    st::Tensor w = st::lstsq(A, y);
+    EXPECT_EQ(w.size(), st::Shape({20}));
+    st::Tensor res = y - st::mv(A, w);
+    st::Tensor g = st::mv(A.transpose(0, 1), res);
+    for (st::index_t j = 0; j < 20; ++j)
+        EXPECT_NEAR(0.0, (g[{j}]), 1e-10);
+    // with fewer rows than columns the exact solution of least norm lies in the row space
+    st::Tensor W = st::Tensor::rand({4, 9});
+    st::Tensor v = st::Tensor::rand({4});
+    st::Tensor u = st::lstsq(W, v);
+    st::Tensor Wu = st::mv(W, u);
+    EXPECT_NEAR((v[{3}]), (Wu[{3}]), 1e-12);
+    st::Tensor c = st::lstsq(W.transpose(0, 1), u);
+    st::Tensor back = st::mv(W.transpose(0, 1), c);
+    EXPECT_NEAR((u[{8}]), (back[{8}]), 1e-12);
+
+    // batched solves run one matrix per batch index
+    st::Tensor P = st::Tensor::rand({2, 3, 5, 5});
+    st::Tensor q = st::Tensor::rand({2, 3, 5});
+    st::Tensor z = st::solve(P, q);
+    EXPECT_EQ(z.size(), st::Shape({2, 3, 5}));
+    st::Tensor Pz = st::mv(P.select(0, 1).select(0, 2), z.select(0, 1).select(0, 2));
+    EXPECT_NEAR((q[{1, 2, 4}]), (Pz[{4}]), 1e-9);
+    st::Tensor d = st::det(P);
+    EXPECT_EQ(d.size(), st::Shape({2, 3}));
+    EXPECT_NEAR(st::det(P.select(0, 1).select(0, 2)).item(), (d[{1, 2}]), 1e-12);
+    EXPECT_THROW(st::solve(P, st::Tensor::rand({3, 3, 5})), st::err::Error);
+}
+
+TEST(tensorLinalgTest, eighAndSvd) {
+    auto max_abs = [](const st::Tensor& t) {
+        st::data_t res = 0;
+        for (st::data_t v : t) res = std::max(res, std::abs(v));
+        return res;
+    };
+    st::Tensor X = st::Tensor::rand({40, 40});
+    st::Tensor A = X + X.transpose(0, 1);
+    st::EighResult e = st::eigh(A);
+    st::Tensor AV = st::matmul(A, e.vectors);
+    st::Tensor VtV = st::matmul(e.vectors.transpose(0, 1), e.vectors);
+    for (st::index_t j = 0; j < 40; j += 3) {
+        if (j > 0) EXPECT_LE((e.values[{j - 1}]), (e.values[{j}]));
+        for (st::index_t i = 0; i < 40; i += 7)
+            EXPECT_NEAR((e.values[{j}] * e.vectors[{i, j}]), (AV[{i, j}]), 1e-10);
+        EXPECT_NEAR(1.0, (VtV[{j, j}]), 1e-12);
+    }
+    st::Tensor D({2, 1, 1, 2}, {2, 2});
+    st::Tensor w = st::eigh(D).values;
+    EXPECT_NEAR(1.0, (w[{0}]), 1e-12);
+    EXPECT_NEAR(3.0, (w[{1}]), 1e-12);
+
+    // tall, wide and batched inputs reconstruct from their thin factors
+    for (const st::Shape& shape : {st::Shape({60, 25}), st::Shape({10, 30}), st::Shape({3, 8, 5})}) {
+        st::Tensor M = st::Tensor::rand(shape);
+        st::SVDResult f = st::svd(M);
+        st::index_t nd = shape.n_dim(), k = std::min(shape[nd - 2], shape[nd - 1]);
+        EXPECT_EQ(k, f.s.size(f.s.n_dim() - 1));
+        st::Tensor US = f.u * f.s.unsqueeze(f.s.n_dim() - 1);
+        st::Tensor R = st::matmul(US, f.vh);
+        st::Tensor diff = R - M;
+        EXPECT_NEAR(0.0, max_abs(diff), 1e-10);
+    }
+    st::Tensor M = st::Tensor::rand({30, 20});
+    st::SVDResult f = st::svd(M, 4);
+    EXPECT_EQ(f.u.size(), st::Shape({30, 4}));
+    EXPECT_EQ(f.vh.size(), st::Shape({4, 20}));
+    EXPECT_GE((f.s[{0}]), (f.s[{3}]));
+
+    // an exactly rank-5 matrix is recovered by the randomised SVD
+    st::Tensor P = st::matmul(st::Tensor::randn({200, 5}), st::Tensor::randn({5, 150}));
+    st::SVDResult lr = st::svd_lowrank(P, 5);
+    st::SVDResult full = st::svd(P, 5);
+    for (st::index_t j = 0; j < 5; ++j)
+        EXPECT_NEAR((full.s[{j}]), (lr.s[{j}]), 1e-8 * full.s[{0}]);
+    st::Tensor Pr = st::matmul(lr.u * lr.s, lr.vh);
+    st::Tensor err = Pr - P;
+    EXPECT_NEAR(0.0, max_abs(err), 1e-8);
+    EXPECT_THROW(st::svd_lowrank(P, 0), st::err::Error);
+    EXPECT_THROW(st::eigh(M), st::err::Error);
+}
+
+TEST(tensorLinalgTest, einsum) {
+    st::Tensor A = st::Tensor::rand({3, 4, 5});
+    st::Tensor B = st::Tensor::rand({3, 5, 6});
+    st::Tensor C = st::einsum("bij,bjk->bik", {A, B});
+    EXPECT_EQ(C.size(), st::Shape({3, 4, 6}));
+    for (st::index_t b = 0; b < 3; ++b)
+        for (st::index_t i = 0; i < 4; ++i)
+            for (st::index_t k = 0; k < 6; ++k) {
+                st::data_t sum = 0;
+                for (st::index_t j = 0; j < 5; ++j)
+                    sum += A[{b, i, j}] * B[{b, j, k}];
+                EXPECT_NEAR(sum, (C[{b, i, k}]), 1e-12);
+            }
+
+    // attention scores: the key operand is read transposed, the output is permuted
+    st::Tensor Q = st::Tensor::rand({2, 3, 7, 4});
+    st::Tensor K = st::Tensor::rand({2, 3, 8, 4});
+    st::Tensor S = st::einsum("bhqd,bhkd->bkhq", {Q, K});
+    EXPECT_EQ(S.size(), st::Shape({2, 8, 3, 7}));
+    st::data_t sum = 0;
+    for (st::index_t d = 0; d < 4; ++d)
+        sum += Q[{1, 2, 6, d}] * K[{1, 2, 5, d}];
+    EXPECT_NEAR(sum, (S[{1, 5, 2, 6}]), 1e-12);
+
+    // bilinear form over three operands, a trace, a diagonal and the implicit output
+    st::Tensor x = st::Tensor::rand({4});
+    st::Tensor W = st::Tensor::rand({4, 6});
+    st::Tensor y = st::Tensor::rand({6});
+    st::data_t expect = 0;
+    for (st::index_t i = 0; i < 4; ++i)
+        for (st::index_t j = 0; j < 6; ++j)
+            expect += x[{i}] * W[{i, j}] * y[{j}];
+    EXPECT_NEAR(expect, st::einsum("i,ij,j->", {x, W, y}).item(), 1e-12);
+    st::Tensor M = st::Tensor::rand({5, 5});
+    st::data_t trace = 0;
+    for (st::index_t i = 0; i < 5; ++i) trace += M[{i, i}];
+    EXPECT_NEAR(trace, st::einsum("ii", {M}).item(), 1e-12);
+    st::Tensor diag = st::einsum("ii->i", {M});
+    EXPECT_DOUBLE_EQ((M[{3, 3}]), (diag[{3}]));
+    st::Tensor T = st::einsum("ji", {W});
+    EXPECT_EQ(T.size(), st::Shape({6, 4}));
+    EXPECT_DOUBLE_EQ((W[{1, 5}]), (T[{5, 1}]));
+    st::Tensor rows = st::einsum("ij->i", {W});
+    EXPECT_NEAR(W.slice(2, 3, 0).sum(), (rows[{2}]), 1e-12);
+    st::Tensor outer = st::einsum("i,j->ij", {x, y});
+    EXPECT_DOUBLE_EQ((x[{3}] * y[{2}]), (outer[{3, 2}]));
+
+    EXPECT_THROW(st::einsum("ij,jk->ik", {A, B}), st::err::Error);
+    EXPECT_THROW(st::einsum("ij,jk->ik", {W, W}), st::err::Error);
+    EXPECT_THROW(st::einsum("ij->k", {W}), st::err::Error);
+    EXPECT_THROW(st::einsum("i1", {W}), st::err::Error);
+    // the message names the bad subscript, not the whole equation
+    std::string long_eq(1000, 'i');
+    EXPECT_THROW(st::einsum(long_eq + "1", {W}), st::err::Error);
+    EXPECT_THROW(st::einsum("ij->" + std::string(1000, ' ') + "1", {W}), st::err::Error);
+}
+
+TEST(tensorNNTest, convolution) {
+    // plain loops over the definition
+    auto reference = [](const st::Tensor& x, const st::Tensor& w, const st::ConvOptions& opt,
+                        st::index_t n, st::index_t o, st::index_t oh, st::index_t ow) {
+        st::index_t cg = w.size(1), og = w.size(0) / opt.groups, g = o / og;
+        st::data_t sum = 0;
+        for (st::index_t c = 0; c < cg; ++c)
+            for (st::index_t kh = 0; kh < w.size(2); ++kh)
+                for (st::index_t kw = 0; kw < w.size(3); ++kw) {
+                    int ih = (int)(oh * opt.stride + kh * opt.dilation) - (int)opt.padding;
+                    int iw = (int)(ow * opt.stride + kw * opt.dilation) - (int)opt.padding;
+                    if (ih < 0 || iw < 0 || ih >= (int)x.size(2) || iw >= (int)x.size(3)) continue;
+                    sum += w[{o, c, kh, kw}] * x[{n, g * cg + c, (st::index_t)ih, (st::index_t)iw}];
+                }
+        return sum;
+    };
+    auto check = [&](const st::Shape& xs, const st::Shape& ws, const st::ConvOptions& opt) {
+        st::Tensor x = st::Tensor::rand(xs), w = st::Tensor::rand(ws), b = st::Tensor::rand({ws[0]});
+        st::Tensor y = st::conv2d(x, w, b, opt);
+        for (st::index_t n = 0; n < y.size(0); ++n)
+            for (st::index_t o = 0; o < y.size(1); ++o)
+                for (st::index_t i = 0; i < y.size(2); ++i)
+                    for (st::index_t j = 0; j < y.size(3); ++j)
+                        EXPECT_NEAR((reference(x, w, opt, n, o, i, j) + b[{o}]), (y[{n, o, i, j}]), 1e-12);
+        return y.size();
+    };
+    // im2col + GEMM with groups, stride, padding and dilation
+    EXPECT_EQ(check({2, 8, 9, 11}, {6, 4, 3, 3}, {2, 1, 2, 2}), st::Shape({2, 6, 4, 5}));
+    // 1x1 convolution reads the input directly
+    EXPECT_EQ(check({1, 40, 5, 6}, {7, 40, 1, 1}, {}), st::Shape({1, 7, 5, 6}));
+    // depthwise takes the direct kernel, with borders on both sides
+    EXPECT_EQ(check({2, 6, 7, 7}, {12, 1, 3, 3}, {1, 2, 1, 6}), st::Shape({2, 12, 9, 9}));
+    EXPECT_EQ(check({1, 2, 8, 8}, {3, 2, 2, 3}, {3, 1, 1, 1}), st::Shape({1, 3, 3, 3}));
+
+    st::Tensor x = st::Tensor::rand({2, 4, 20});
+    st::Tensor w = st::Tensor::rand({5, 4, 3});
+    st::Tensor y = st::conv1d(x, w, std::nullopt, {2, 1});
+    EXPECT_EQ(y.size(), st::Shape({2, 5, 10}));
+    st::data_t sum = 0;
+    for (st::index_t c = 0; c < 4; ++c)
+        for (st::index_t k = 0; k < 3; ++k)
+            if (2 * 3 + k >= 1) sum += w[{4, c, k}] * x[{1, c, 2 * 3 + k - 1}];
+    EXPECT_NEAR(sum, (y[{1, 4, 3}]), 1e-12);
+
+    EXPECT_THROW(st::conv2d(st::Tensor::rand({1, 3, 5, 5}), st::Tensor::rand({4, 3, 3, 3}), std::nullopt, {1, 0, 1, 2}),
+                 st::err::Error);
+    EXPECT_THROW(st::conv2d(st::Tensor::rand({1, 3, 2, 2}), st::Tensor::rand({4, 3, 3, 3})), st::err::Error);
+    EXPECT_THROW(st::conv1d(st::Tensor::rand({1, 3, 5}), st::Tensor::rand({4, 2, 3})), st::err::Error);
+}
+
+TEST(tensorNNTest, poolingAndUpsampling) {
+    // a transposed input is read through its strides
+    st::Tensor base = st::Tensor::rand({2, 3, 7, 6});
+    st::Tensor x = base.transpose(2, 3);
+    ASSERT_EQ(x.size(), st::Shape({2, 3, 6, 7}));
+
+    st::Tensor mx = st::max_pool2d(x, 3, 2, 1);
+    st::Tensor avg = st::avg_pool2d(x, 3, 2, 1);
+    ASSERT_EQ(mx.size(), st::Shape({2, 3, 3, 4}));
+    ASSERT_EQ(avg.size(), st::Shape({2, 3, 3, 4}));
+    for (st::index_t n = 0; n < 2; ++n)
+        for (st::index_t c = 0; c < 3; ++c)
+            for (st::index_t i = 0; i < 3; ++i)
+                for (st::index_t j = 0; j < 4; ++j) {
+                    st::data_t best = -1, sum = 0;
+                    for (int y = 2 * (int)i - 1; y < 2 * (int)i + 2; ++y)
+                        for (int z = 2 * (int)j - 1; z < 2 * (int)j + 2; ++z) {
+                            if (y < 0 || z < 0 || y >= 6 || z >= 7) continue;
+                            st::data_t v = x[{n, c, (st::index_t)y, (st::index_t)z}];
+                            best = std::max(best, v);
+                            sum += v;
+                        }
+                    EXPECT_EQ(best, (mx[{n, c, i, j}]));
+                    EXPECT_NEAR(sum / 9, (avg[{n, c, i, j}]), 1e-12);
+                }
+
+    auto [values, indices] = st::max_pool2d_with_indices(x, 2);
+    ASSERT_EQ(indices.size(), st::Shape({2, 3, 3, 3}));
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 3; ++j) {
+            auto at = (st::index_t)indices[{1, 2, i, j}];
+            EXPECT_EQ((x[{1, 2, at / 7, at % 7}]), (values[{1, 2, i, j}]));
+        }
+
+    st::data_t seq[] = {1, 5, 2, 4, 3, 0, 6};
+    st::Tensor line(seq, st::Shape({1, 1, 7}));
+    st::Tensor m1 = st::max_pool1d(line, 2);
+    EXPECT_EQ(m1.size(), st::Shape({1, 1, 3}));
+    EXPECT_EQ((m1[{0, 0, 0}]), 5);
+    EXPECT_EQ((m1[{0, 0, 2}]), 3);
+    // padded positions count towards the average
+    EXPECT_NEAR((st::avg_pool1d(line, 3, 3, 1)[{0, 0, 0}]), 6.0 / 3, 1e-12);
+    // uneven adaptive windows overlap: [0, 3), [2, 5), [4, 7)
+    st::Tensor a1 = st::adaptive_avg_pool1d(line, 3);
+    EXPECT_NEAR((a1[{0, 0, 0}]), 8.0 / 3, 1e-12);
+    EXPECT_NEAR((a1[{0, 0, 1}]), 9.0 / 3, 1e-12);
+    EXPECT_NEAR((a1[{0, 0, 2}]), 9.0 / 3, 1e-12);
+
+    st::Tensor global = st::adaptive_avg_pool2d(x, 1, 1);
+    st::data_t total = 0;
+    for (st::index_t i = 0; i < 6; ++i)
+        for (st::index_t j = 0; j < 7; ++j) total += x[{0, 1, i, j}];
+    EXPECT_NEAR(total / 42, (global[{0, 1, 0, 0}]), 1e-12);
+
+    st::data_t quad[] = {0, 1, 2, 3};
+    st::Tensor q(quad, st::Shape({1, 1, 2, 2}));
+    st::Tensor near = st::upsample_nearest2d(q, 4, 4);
+    EXPECT_EQ((near[{0, 0, 1, 1}]), 0);
+    EXPECT_EQ((near[{0, 0, 2, 3}]), 3);
+    st::Tensor corners = st::upsample_bilinear2d(q, 3, 3, true);
+    EXPECT_NEAR((corners[{0, 0, 1, 1}]), 1.5, 1e-12);
+    EXPECT_NEAR((corners[{0, 0, 2, 2}]), 3, 1e-12);
+    // half-pixel centres: output 1 of 4 samples 0.25 of the way between the inputs
+    st::Tensor half = st::upsample_bilinear2d(q, 4, 4);
+    EXPECT_NEAR((half[{0, 0, 0, 0}]), 0, 1e-12);
+    EXPECT_NEAR((half[{0, 0, 0, 1}]), 0.25, 1e-12);
+    EXPECT_NEAR((half[{0, 0, 1, 1}]), 0.75, 1e-12);
+    EXPECT_NEAR((st::upsample_bilinear2d(x, 6, 7)[{1, 0, 4, 5}]), (x[{1, 0, 4, 5}]), 1e-12);
+
+    EXPECT_THROW(st::max_pool2d(line, 2), st::err::Error);
+    EXPECT_THROW(st::max_pool1d(line, 2, 1, 2), st::err::Error);
+    EXPECT_THROW(st::avg_pool1d(line, 9), st::err::Error);
+}
+
+TEST(tensorNNTest, softmax) {
+    // large values would overflow a plain exp
+    st::Tensor base = st::Tensor::rand({3, 5, 4}) * 1000;
+    st::Tensor x = base.transpose(0, 2);
+    for (int dim = 0; dim < 3; ++dim) {
+        st::Tensor p = st::softmax(x, dim), lp = st::log_softmax(x, dim);
+        st::Tensor lse = st::logsumexp(x, dim), kept = st::logsumexp(x, dim, true);
+        ASSERT_EQ(p.size(), x.size());
+        ASSERT_EQ(lse.size(), st::Shape(x.size(), dim));
+        ASSERT_EQ(kept.n_dim(), 3);
+        EXPECT_EQ(kept.size(dim), 1);
+        for (st::index_t i = 0; i < 4; ++i)
+            for (st::index_t j = 0; j < 5; ++j)
+                for (st::index_t k = 0; k < 3; ++k) {
+                    st::IndexArray idx{i, j, k};
+                    st::data_t m = -1e300, total = 0;
+                    auto at = [&](st::index_t t) { st::IndexArray o{i, j, k}; o[dim] = t; return x.eval(o); };
+                    for (st::index_t t = 0; t < x.size(dim); ++t) m = std::max(m, at(t));
+                    for (st::index_t t = 0; t < x.size(dim); ++t) total += std::exp(at(t) - m);
+                    EXPECT_NEAR(std::exp(x.eval(idx) - m) / total, p.eval(idx), 1e-12);
+                    EXPECT_NEAR(x.eval(idx) - m - std::log(total), lp.eval(idx), 1e-9);
+                    st::IndexArray red{i, j, k};
+                    red[dim] = 0;
+                    EXPECT_NEAR(m + std::log(total), kept.eval(red), 1e-9);
+                }
+    }
+
+    constexpr st::data_t inf = std::numeric_limits<st::data_t>::infinity();
+    st::data_t masked[] = {-inf, 0, -inf, 0};
+    st::Tensor row(masked, st::Shape({4}));
+    st::Tensor p = st::softmax(row, 0);
+    EXPECT_EQ((p[{0}]), 0);
+    EXPECT_NEAR((p[{1}]), 0.5, 1e-15);
+    EXPECT_NEAR((st::logsumexp(row, 0)[{0}]), std::log(2.0), 1e-15);
+    st::data_t empty[] = {-inf, -inf};
+    EXPECT_EQ((st::logsumexp(st::Tensor(empty, st::Shape({2})), 0)[{0}]), -inf);
+
+    EXPECT_THROW(st::softmax(row, 1), st::err::Error);
+}
+
+TEST(tensorNNTest, normalisation) {
+    // a large offset tests the stability of the variance
+    st::Tensor x = st::Tensor::rand({2, 3, 4, 5}) + 1e6;
+    st::Tensor w = st::Tensor::rand({4, 5}), b = st::Tensor::rand({4, 5});
+    st::Tensor ln = st::layer_norm(x, {4, 5}, w, b);
+    st::Tensor rms = st::rms_norm(x, {4, 5}, w);
+    for (st::index_t n = 0; n < 2; ++n)
+        for (st::index_t c = 0; c < 3; ++c) {
+            st::data_t mean = 0, var = 0, squares = 0;
+            for (st::index_t i = 0; i < 4; ++i)
+                for (st::index_t j = 0; j < 5; ++j) mean += x[{n, c, i, j}] / 20;
+            for (st::index_t i = 0; i < 4; ++i)
+                for (st::index_t j = 0; j < 5; ++j) {
+                    st::data_t v = x[{n, c, i, j}];
+                    var += (v - mean) * (v - mean) / 20;
+                    squares += v * v / 20;
+                }
+            for (st::index_t i = 0; i < 4; ++i)
+                for (st::index_t j = 0; j < 5; ++j) {
+                    st::data_t v = x[{n, c, i, j}];
+                    EXPECT_NEAR(((v - mean) / std::sqrt(var + 1e-5) * w[{i, j}] + b[{i, j}]), (ln[{n, c, i, j}]), 1e-6);
+                    EXPECT_NEAR((v / std::sqrt(squares + 1e-5) * w[{i, j}]), (rms[{n, c, i, j}]), 1e-12);
+                }
+        }
+
+    st::Tensor mean = st::Tensor::rand({3}), var = st::Tensor::rand({3}), gamma = st::Tensor::rand({3});
+    st::Tensor bn = st::batch_norm(x, mean, var, gamma, std::nullopt, 1e-3);
+    EXPECT_NEAR(((x[{1, 2, 3, 4}] - mean[{2}]) / std::sqrt(var[{2}] + 1e-3) * gamma[{2}]), (bn[{1, 2, 3, 4}]), 1e-6);
+
+    // in place on a contiguous tensor reuses its storage, a strided one is written back
+    st::Tensor y(x.data(), x.size());
+    const st::data_t* storage = y.data();
+    st::layer_norm_(y, {4, 5}, w, b);
+    EXPECT_EQ(y.data(), storage);
+    EXPECT_NEAR((y[{1, 1, 2, 2}]), (ln[{1, 1, 2, 2}]), 1e-12);
+    st::Tensor base = st::Tensor::rand({5, 3});
+    st::Tensor t = base.transpose(0, 1);
+    st::Tensor expected = st::rms_norm(t, {5});
+    st::rms_norm_(t, {5});
+    EXPECT_NEAR((base[{4, 1}]), (expected[{1, 4}]), 1e-12);
+    st::Tensor z(x.data(), x.size());
+    st::batch_norm_(z, mean, var, gamma, std::nullopt, 1e-3);
+    EXPECT_NEAR((z[{0, 1, 2, 3}]), (bn[{0, 1, 2, 3}]), 1e-12);
+
+    EXPECT_THROW(st::layer_norm(x, {5, 4}), st::err::Error);
+    EXPECT_THROW(st::layer_norm(x, {4, 5}, st::Tensor::rand({5})), st::err::Error);
+    EXPECT_THROW(st::batch_norm(x, st::Tensor::rand({4}), var), st::err::Error);
+}
+
+TEST(tensorAutogradTest, gradients) {
+    using Fn = std::function<st::Variable(const std::vector<st::Variable>&)>;
+    // every gradient element against a central difference of the summed output
+    auto check = [](const Fn& f, const std::vector<st::Tensor>& inputs) {
+        std::vector<st::Variable> vars;
+        for (const auto& t : inputs) vars.emplace_back(t, true);
+        f(vars).sum().backward();
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            ASSERT_TRUE(vars[i].grad().has_value());
+            ASSERT_EQ(vars[i].grad()->size(), inputs[i].size());
+            for (st::index_t j = 0; j < inputs[i].d_size(); ++j) {
+                auto at = [&](st::data_t delta) {
+                    std::vector<st::Variable> moved;
+                    for (size_t k = 0; k < inputs.size(); ++k) {
+                        st::Tensor t(inputs[k].data(), inputs[k].size());
+                        if (k == i) t.data()[j] += delta;
+                        moved.emplace_back(t);
+                    }
+                    return f(moved).value().sum();
+                };
+                EXPECT_NEAR((at(1e-6) - at(-1e-6)) / 2e-6, vars[i].grad()->data()[j], 1e-5);
+            }
+        }
+    };
+    using V = std::vector<st::Variable>;
+    check([](const V& v) { return v[0] * v[1] + v[0] / v[2] - v[1]; },
+          {st::Tensor::rand({3, 4}), st::Tensor::rand({4}), st::Tensor::rand({3, 1}) + 1});
+    check([](const V& v) { return sin(v[0]) * cos(v[0]) + tan(v[0]) * 2 - 3 / (v[0] + 1); },
+          {st::Tensor::rand({2, 3})});
+    check([](const V& v) { return relu(v[0] - 0.5) + abs(v[0] - 0.5) - v[0]; }, {st::Tensor::rand({5})});
+    // broadcast batch on the left, transposed operand on the right
+    check([](const V& v) { return matmul(v[0], v[1].transpose(0, 1)) * v[2]; },
+          {st::Tensor::rand({2, 3, 4}), st::Tensor::rand({5, 4}), st::Tensor::rand({2, 3, 5})});
+    check([](const V& v) {
+        return v[0].slice(1, 3, 0).view({2, 2, 2}).sum(1) + v[0].select(0, 1).unsqueeze(0).slice(0, 2, 1).expand({2, 2});
+    }, {st::Tensor::rand({4, 4})});
+    check([](const V& v) { return (v[0] * v[0]).sum(0).squeeze(0) * v[0].sum(); }, {st::Tensor::rand({1, 3})});
+
+    // a shared input accumulates from both uses, and across calls
+    st::Variable x(st::Tensor::rand({3}), true), c(st::Tensor::rand({3}));
+    st::Variable y = (x * c + x).sum();
+    EXPECT_FALSE(c.requires_grad());
+    y.backward(true);
+    y.backward();
+    for (st::index_t i = 0; i < 3; ++i) EXPECT_NEAR((*x.grad())[{i}], 2 * (c.value()[{i}] + 1), 1e-12);
+    EXPECT_FALSE(c.grad().has_value());
+    // the first call without retain_graph released the saved tensors
+    EXPECT_THROW(y.backward(), st::err::Error);
+    x.zero_grad();
+    EXPECT_FALSE(x.grad().has_value());
+
+    {
+        st::NoGradGuard guard;
+        EXPECT_TRUE((x * 2).is_leaf());
+    }
+    EXPECT_FALSE((x * 2).is_leaf());
+    EXPECT_THROW((x * 2).backward(), st::err::Error);
+    EXPECT_THROW(c.sum().backward(), st::err::Error);
+}
+
+TEST(tensorAutogradTest, checkpoint) {
+    st::Variable w(st::Tensor::rand({4, 4}), true);
+    st::Tensor input = st::Tensor::rand({3, 4});
+    st::CheckpointFn block = [&w](const std::vector<st::Variable>& in) {
+        return sin(matmul(in[0], w)) * in[0];
+    };
+    auto run = [&](bool checkpointed) {
+        st::Variable x(input, true);
+        w.zero_grad();
+        st::Variable h = checkpointed ? st::checkpoint(block, {x}) : block({x});
+        (h * h).sum().backward();
+        return std::make_pair(*x.grad(), *w.grad());
+    };
+    auto [gx, gw] = run(false);
+    auto [cx, cw] = run(true);
+    for (st::index_t i = 0; i < 3; ++i)
+        for (st::index_t j = 0; j < 4; ++j) EXPECT_NEAR((gx[{i, j}]), (cx[{i, j}]), 1e-12);
+    for (st::index_t i = 0; i < 4; ++i)
+        for (st::index_t j = 0; j < 4; ++j) EXPECT_NEAR((gw[{i, j}]), (cw[{i, j}]), 1e-12);
+
+    // only the output is recorded, the ops inside the block are not
+    st::Variable x(input, true);
+    st::Variable h = st::checkpoint(block, {x});
+    ASSERT_FALSE(h.is_leaf());
+    EXPECT_EQ(h.grad_fn()->next.size(), 1u);
+    EXPECT_TRUE(h.grad_fn()->next[0].leaf == x.ptr());
+    EXPECT_TRUE(st::checkpoint(block, {st::Variable(input)}).is_leaf());
+}
+
+TEST(tensorOptimTest, updates) {
+    // reference updates on one element, with the gradient of sum(w * w * c)
+    struct Ref {
+        std::function<void(st::data_t& p, st::data_t g, std::vector<st::data_t>& s, int t)> step;
+    };
+    auto run = [](const std::function<std::unique_ptr<st::Optimizer>(std::vector<st::Variable>)>& make,
+                  const Ref& ref) {
+        // one parameter spans several chunks, one never gets a gradient
+        st::Tensor init = st::Tensor::rand({20000}), c = st::Tensor::rand({20000});
+        st::Variable w(st::Tensor(init.data(), init.size()), true), small(st::Tensor::rand({3}), true);
+        st::Variable unused(st::Tensor::rand({2}), true);
+        st::data_t before = unused.value()[{0}];
+        auto opt = make({w, small, unused});
+        std::vector<std::vector<st::data_t>> state(20000, std::vector<st::data_t>(3, 0));
+        std::vector<st::data_t> expected(init.data(), init.data() + 20000);
+        for (int t = 1; t <= 3; ++t) {
+            opt->zero_grad();
+            (w * w * st::Variable(c)).sum().backward();
+            (small * 2).sum().backward();
+            opt->step();
+            for (st::index_t i = 0; i < 20000; ++i)
+                ref.step(expected[i], 2 * expected[i] * c.data()[i], state[i], t);
+        }
+        for (st::index_t i = 0; i < 20000; i += 997) EXPECT_NEAR(expected[i], (w.value()[{i}]), 1e-12);
+        EXPECT_NEAR(expected[19999], (w.value()[{19999}]), 1e-12);
+        EXPECT_EQ(before, (unused.value()[{0}]));
+        EXPECT_FALSE(unused.grad().has_value());
+    };
+
+    st::SGDOptions sgd{0.1, 0.9, 0, 0.01, true};
+    run([&](auto params) { return std::make_unique<st::SGD>(params, sgd); },
+        {[&](st::data_t& p, st::data_t g, std::vector<st::data_t>& s, int t) {
+            g += sgd.weight_decay * p;
+            s[0] = t == 1 ? g : sgd.momentum * s[0] + g;
+            p -= sgd.lr * (g + sgd.momentum * s[0]);
+        }});
+    run([](auto params) { return std::make_unique<st::SGD>(params, st::SGDOptions{0.5}); },
+        {[](st::data_t& p, st::data_t g, std::vector<st::data_t>&, int) { p -= 0.5 * g; }});
+
+    st::AdamOptions adam{0.01, 0.8, 0.9, 1e-8, 0.1};
+    auto adam_step = [&](bool decoupled) {
+        return [&, decoupled](st::data_t& p, st::data_t g, std::vector<st::data_t>& s, int t) {
+            if (decoupled) p *= 1 - adam.lr * adam.weight_decay;
+            else g += adam.weight_decay * p;
+            s[0] = adam.beta1 * s[0] + (1 - adam.beta1) * g;
+            s[1] = adam.beta2 * s[1] + (1 - adam.beta2) * g * g;
+            st::data_t m = s[0] / (1 - std::pow(adam.beta1, t)), v = s[1] / (1 - std::pow(adam.beta2, t));
+            p -= adam.lr * m / (std::sqrt(v) + adam.eps);
+        };
+    };
+    run([&](auto params) { return std::make_unique<st::Adam>(params, adam); }, {adam_step(false)});
+    run([&](auto params) { return std::make_unique<st::AdamW>(params, adam); }, {adam_step(true)});
+
+    st::RMSpropOptions rms{0.01, 0.9, 1e-8, 0, 0.5, true};
+    run([&](auto params) { return std::make_unique<st::RMSprop>(params, rms); },
+        {[&](st::data_t& p, st::data_t g, std::vector<st::data_t>& s, int) {
+            s[0] = rms.alpha * s[0] + (1 - rms.alpha) * g * g;
+            s[1] = rms.alpha * s[1] + (1 - rms.alpha) * g;
+            s[2] = rms.momentum * s[2] + g / (std::sqrt(s[0] - s[1] * s[1]) + rms.eps);
+            p -= rms.lr * s[2];
+        }});
+
+    EXPECT_THROW(st::SGD({st::Variable(st::Tensor::rand({3, 4}).transpose(0, 1), true)}), st::err::Error);
+    EXPECT_THROW(st::SGD({}, st::SGDOptions{.nesterov = true}), st::err::Error);
+}
+
 TEST(tensorErrorCheck, outOfRange) {
     st::Tensor A = st::Tensor::rand({2, 3});
     EXPECT_THROW((A[{2, 0}]), st::err::Error);
@@ -340,4 +1701,25 @@ TEST(tensorApplicationTest, linearRegression) {
     std::cout << B << std::endl;
     std::cout << "loss:" << std::endl;
     std::cout << loss.sum() << std::endl;
-}
\ No newline at end of file
+}
+
+TEST(tensorApplicationTest, linearRegressionAutograd) {
+    st::Tensor X({1, 2, 4, 5, 6, 7, 8, 9, 10, 11}, {5, 2});
+    st::Tensor Y({3, 9, 13, 17, 21}, {5, 1});
+    st::Variable W(st::Tensor::rand({2, 1}), true), B(st::Tensor::zeros({1, 1}), true);
+    st::Variable x(X), y(Y);
+    st::data_t first = 0, last = 0;
+    for (int i = 0; i < 2000; ++i) {
+        st::Variable d = matmul(x, W) + B - y;
+        st::Variable loss = (d * d).sum() / 5;
+        loss.backward();
+        st::NoGradGuard guard;
+        W.value() -= *W.grad() * 0.002;
+        B.value() -= *B.grad() * 0.002;
+        W.zero_grad();
+        B.zero_grad();
+        if (i == 0) first = loss.value().item();
+        last = loss.value().item();
+    }
+    EXPECT_LT(last, first / 10);
+}